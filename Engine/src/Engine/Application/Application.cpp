@@ -19,6 +19,7 @@
 
 #include <Engine/Display/Rendering/Camera.h>
 #include <Engine/Display/Rendering/Renderable.h>
+#include <Engine/Display/Rendering/Shader.h>
 #include <Engine/Display/Rendering/Texture.h>
 #include <Engine/Resource/Assets.h>
 #include <Engine/Sequencer/Sequencer.h>
@@ -984,6 +985,7 @@ CApplication::CApplication()
 	Tools = false;
 	DefaultExit = true;
 	WaitForInput = false;
+	HeadlessFrames = 0;
 }
 
 CApplication::~CApplication()
@@ -1008,7 +1010,13 @@ void CApplication::Run()
 	GameTimer.Start();
 	RenderTimer.Start();
 
-	const int FPSLimit = CConfiguration::Get().GetInteger( "fps", 300 );
+	// Headless runs are benchmarks, they render as fast as they can.
+	const bool Headless = MainWindow.IsHeadless();
+	const int FPSLimit = Headless ? 0 : CConfiguration::Get().GetInteger( "fps", 300 );
+	uint32_t RenderedFrames = 0;
+
+	CTimer BenchmarkTimer( false );
+	BenchmarkTimer.Start();
 
 	const uint64_t MaximumGameTime = 1000 / CConfiguration::Get().GetInteger( "tickrate", 60 );
 	const uint64_t MaximumInputTime = 1000 / CConfiguration::Get().GetInteger( "pollingrate", 120 );
@@ -1099,9 +1107,24 @@ void CApplication::Run()
 				MainWindow.RenderFrame();
 				RenderTimer.Start();
 			}
+
+			RenderedFrames++;
+			if( Headless && RenderedFrames >= HeadlessFrames )
+			{
+				Close();
+			}
 		}
 	}
 
+	if( Headless )
+	{
+		BenchmarkTimer.Stop();
+
+		const uint64_t ElapsedTime = BenchmarkTimer.GetElapsedTimeMilliseconds();
+		const double AverageFrameTime = RenderedFrames > 0 ? static_cast<double>( ElapsedTime ) / static_cast<double>( RenderedFrames ) : 0.0;
+		Log::Event( "Headless run: %u frames in %llums, %.3fms per frame.\n", RenderedFrames, static_cast<unsigned long long>( ElapsedTime ), AverageFrameTime );
+	}
+
 	// CAngelEngine::Get().Shutdown();
 
 	GameLayersInstance->Shutdown();
@@ -1307,6 +1330,19 @@ void CApplication::ProcessCommandLine( int argc, char ** argv )
 		{
 			WaitForInput = true;
 		}
+		else if( strcmp( argv[Index], "-headless" ) == 0 )
+		{
+			// -headless [frames], renders offscreen without a display and exits after the given number of frames.
+			RedirectLogToConsole();
+
+			HeadlessFrames = 600;
+			if( Index + 1 < argc && argv[Index + 1][0] != '-' )
+			{
+				HeadlessFrames = static_cast<uint32_t>( std::max( atoi( argv[Index + 1] ), 1 ) );
+			}
+
+			MainWindow.SetHeadless( true );
+		}
 	}
 }
 
@@ -1491,7 +1527,8 @@ void CApplication::Initialize()
 
 	// CAngelEngine::Get().Initialize();
 
-	if( WaitForInput )
+	// Nobody can press a key in a headless run.
+	if( WaitForInput && !MainWindow.IsHeadless() )
 	{
 		while( glfwGetKey( WindowHandle, 32 ) != GLFW_PRESS )
 		{
@@ -1502,4 +1539,6 @@ void CApplication::Initialize()
 	}
 
 	GameLayersInstance->Initialize();
+
+	CShader::LogLoadTime();
 }
@@ -48,6 +48,9 @@ private:
 	bool DefaultExit;
 	bool WaitForInput;
 
+	// Frames to render before a headless run exits.
+	uint32_t HeadlessFrames;
+
 	std::vector<DebugUIFunction> DebugUIFunctions;
 	std::map<std::string, std::string> CommandLine;
 };
@@ -43,7 +43,10 @@ void CCamera::Update()
 		Vector3DToInitializerList( CameraSetup.CameraUpVector )
 	);
 
-	ProjectionViewInverseMatrix = glm::inverse( ProjectionMatrix * ViewMatrix );
+	const glm::mat4 ProjectionViewMatrix = ProjectionMatrix * ViewMatrix;
+	ProjectionViewInverseMatrix = glm::inverse( ProjectionViewMatrix );
+
+	Frustum.Extract( ProjectionViewMatrix );
 }
 
 void CCamera::SetFieldOfView( const float& FieldOfView )
@@ -128,7 +131,17 @@ const glm::mat4& CCamera::GetViewProjectionInverse() const
 	return ProjectionViewInverseMatrix;
 }
 
+const FFrustum& CCamera::GetFrustum() const
+{
+	return Frustum;
+}
+
 FCameraSetup& CCamera::GetCameraSetup()
 {
 	return CameraSetup;
 }
+
+const FCameraSetup& CCamera::GetCameraSetup() const
+{
+	return CameraSetup;
+}
@@ -51,8 +51,10 @@ public:
 	const glm::mat4& GetProjectionMatrix() const;
 	const glm::mat4& GetViewMatrix() const;
 	const glm::mat4& GetViewProjectionInverse() const;
+	const FFrustum& GetFrustum() const;
 
 	FCameraSetup& GetCameraSetup();
+	const FCameraSetup& GetCameraSetup() const;
 
 	Vector3D CameraOrientation;
 private:
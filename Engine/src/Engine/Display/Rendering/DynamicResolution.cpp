@@ -0,0 +1,89 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Fractions of the target that trigger a lower or a higher scale, the gap between them keeps the scale from oscillating.
+static const float DecreaseThreshold = 1.05f;
+static const float IncreaseThreshold = 0.85f;
+
+// Frames to wait after a change so the average reflects the new scale.
+static const uint32_t ChangeCooldown = 30;
+
+// Weight of the newest frame in the average, spikes are clamped so a single hitch can't drop the scale to the minimum.
+static const float AverageWeight = 0.1f;
+static const float SpikeLimit = 2.0f;
+
+CDynamicResolution::CDynamicResolution()
+{
+	Enabled = false;
+	Configure( 1.0f, 1.0f, 0.125f, 16.6f );
+}
+
+void CDynamicResolution::Configure( const float MinimumIn, const float MaximumIn, const float StepIn, const float TargetTimeIn )
+{
+	Step = std::max( StepIn, 0.01f );
+	Minimum = std::max( MinimumIn, Step );
+	Maximum = std::max( MaximumIn, Minimum );
+	TargetTime = std::max( TargetTimeIn, 1.0f );
+
+	Scale = Maximum;
+	AverageTime = TargetTime;
+	Cooldown = ChangeCooldown;
+}
+
+float CDynamicResolution::Update( const float FrameTime )
+{
+	if( !Enabled )
+		return Scale;
+
+	AverageTime += ( std::min( FrameTime, TargetTime * SpikeLimit ) - AverageTime ) * AverageWeight;
+
+	if( Cooldown > 0 )
+	{
+		Cooldown--;
+		return Scale;
+	}
+
+	float NewScale = Scale;
+	if( AverageTime > TargetTime * DecreaseThreshold )
+	{
+		// The cost of a frame scales with the amount of pixels so the ratio is applied to both axes.
+		const float Estimate = Scale * std::sqrt( TargetTime / AverageTime );
+		NewScale = std::min( std::floor( Estimate / Step ) * Step, Scale - Step );
+	}
+	else if( AverageTime < TargetTime * IncreaseThreshold )
+	{
+		// Frame times are capped by vertical sync so the scale only goes back up once frames finish well within the target.
+		NewScale = Scale + Step;
+	}
+
+	NewScale = Quantize( std::min( std::max( NewScale, Minimum ), Maximum ) );
+	if( NewScale != Scale )
+	{
+		Scale = NewScale;
+		Cooldown = ChangeCooldown;
+	}
+
+	return Scale;
+}
+
+float CDynamicResolution::GetScale() const
+{
+	return Scale;
+}
+
+bool CDynamicResolution::IsEnabled() const
+{
+	return Enabled;
+}
+
+float CDynamicResolution::Quantize( const float Value ) const
+{
+	// The bounds aren't necessarily multiples of the step.
+	if( Value >= Maximum || Value <= Minimum )
+		return Value;
+
+	return std::round( Value / Step ) * Step;
+}
@@ -0,0 +1,36 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <stdint.h>
+
+// Adjusts the internal render scale to hold a target frame time.
+// The scale moves in quantized steps so render targets are only reallocated when a step is crossed.
+class CDynamicResolution
+{
+public:
+	CDynamicResolution();
+
+	// Frame times are in milliseconds, the scale starts out at the maximum.
+	void Configure( const float Minimum, const float Maximum, const float Step, const float TargetTime );
+
+	// Feeds the duration of the last frame and returns the scale the next frame should be rendered at.
+	float Update( const float FrameTime );
+
+	float GetScale() const;
+	bool IsEnabled() const;
+
+	bool Enabled;
+
+private:
+	float Quantize( const float Value ) const;
+
+	float Scale;
+	float Minimum;
+	float Maximum;
+	float Step;
+	float TargetTime;
+
+	// Smoothed frame time, and the amount of frames to wait after a change before the next one.
+	float AverageTime;
+	uint32_t Cooldown;
+};
@@ -0,0 +1,118 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "GPUTimers.h"
+
+#include <chrono>
+
+#include <Engine/Configuration/Configuration.h>
+#include <Engine/Profiling/Profiling.h>
+
+// Results are collected this many frames after they were issued.
+static const size_t TimerFrames = 4;
+
+CGPUTimers::CGPUTimers()
+{
+	Frames.resize( TimerFrames );
+	Frame = 0;
+
+	Nesting = 0;
+	Active = false;
+	Enabled = CConfiguration::Get().GetInteger( "gputimers", 1 ) > 0;
+
+	Dropped = 0;
+}
+
+CGPUTimers::~CGPUTimers()
+{
+	// The query objects go away with the context.
+	Frames.clear();
+}
+
+bool CGPUTimers::IsEnabled() const
+{
+	return Enabled && CProfiler::Get().IsEnabled();
+}
+
+void CGPUTimers::Begin( const std::string& Name )
+{
+	if( Nesting++ > 0 || !IsEnabled() )
+		return;
+
+	FGPUTimerFrame& Current = Frames[Frame];
+	if( Current.Count == Current.Timers.size() )
+	{
+		FGPUTimer Timer;
+		glGenQueries( 1, &Timer.Query );
+		Current.Timers.emplace_back( Timer );
+	}
+
+	FGPUTimer& Timer = Current.Timers[Current.Count];
+	Timer.Name = FName( Name + " (GPU)" );
+	Timer.StartTime = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	Timer.Depth = CTimerScope::GetDepth();
+
+	glBeginQuery( GL_TIME_ELAPSED, Timer.Query );
+	Active = true;
+}
+
+void CGPUTimers::End()
+{
+	if( Nesting == 0 || --Nesting > 0 || !Active )
+		return;
+
+	glEndQuery( GL_TIME_ELAPSED );
+	Frames[Frame].Count++;
+	Active = false;
+}
+
+void CGPUTimers::Update()
+{
+	if( Active )
+		return;
+
+	Frame = ( Frame + 1 ) % TimerFrames;
+
+	FGPUTimerFrame& Oldest = Frames[Frame];
+	if( Oldest.Count == 0 )
+		return;
+
+	// Queries finish in order so the last one being available means the whole frame is.
+	GLint Available = 0;
+	glGetQueryObjectiv( Oldest.Timers[Oldest.Count - 1].Query, GL_QUERY_RESULT_AVAILABLE, &Available );
+	if( Available )
+	{
+		CProfiler& Profiler = CProfiler::Get();
+		for( size_t Index = 0; Index < Oldest.Count; Index++ )
+		{
+			const FGPUTimer& Timer = Oldest.Timers[Index];
+
+			GLuint64 Elapsed = 0;
+			glGetQueryObjectui64v( Timer.Query, GL_QUERY_RESULT, &Elapsed );
+
+			FProfileTimeEntry Entry = FProfileTimeEntry( Timer.Name, static_cast<int64_t>( Elapsed ), Timer.StartTime, Timer.Depth );
+			Profiler.AddTimeEntry( Entry );
+		}
+	}
+	else
+	{
+		Dropped++;
+	}
+
+	Oldest.Count = 0;
+}
+
+int64_t CGPUTimers::FlushDropped()
+{
+	const int64_t Count = Dropped;
+	Dropped = 0;
+	return Count;
+}
+
+CGPUTimerScope::CGPUTimerScope( const std::string& Name )
+{
+	CGPUTimers::Get().Begin( Name );
+}
+
+CGPUTimerScope::~CGPUTimerScope()
+{
+	CGPUTimers::Get().End();
+}
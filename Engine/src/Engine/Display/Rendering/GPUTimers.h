@@ -0,0 +1,74 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <glad/glad.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <Engine/Utility/Structures/Name.h>
+
+struct FGPUTimer
+{
+	FName Name;
+	GLuint Query = 0;
+
+	// CPU side start time and scope depth, used to show the entry next to its CPU scope.
+	int64_t StartTime = 0;
+	size_t Depth = 0;
+};
+
+struct FGPUTimerFrame
+{
+	std::vector<FGPUTimer> Timers;
+	size_t Count = 0;
+};
+
+// Measures GPU time with GL_TIME_ELAPSED queries and feeds it to the profiler.
+// Queries are read back a few frames after they were issued so the CPU never waits for them.
+class CGPUTimers
+{
+public:
+	~CGPUTimers();
+
+	bool IsEnabled() const;
+
+	// Elapsed time queries can't overlap, nested scopes are counted towards the outermost one.
+	void Begin( const std::string& Name );
+	void End();
+
+	// Collects the results of the oldest frame in the ring and starts a new frame, has to be called once per frame.
+	void Update();
+
+	// Number of frames whose results weren't available yet when they were collected.
+	int64_t FlushDropped();
+
+private:
+	std::vector<FGPUTimerFrame> Frames;
+	size_t Frame;
+
+	uint32_t Nesting;
+	bool Active;
+	bool Enabled;
+
+	int64_t Dropped;
+
+public:
+	static CGPUTimers& Get()
+	{
+		static CGPUTimers StaticInstance;
+		return StaticInstance;
+	}
+private:
+	CGPUTimers();
+
+	CGPUTimers( CGPUTimers const& ) = delete;
+	void operator=( CGPUTimers const& ) = delete;
+};
+
+class CGPUTimerScope
+{
+public:
+	CGPUTimerScope( const std::string& Name );
+	~CGPUTimerScope();
+};
@@ -0,0 +1,173 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "GeometryArena.h"
+
+#include <Engine/Configuration/Configuration.h>
+#include <Engine/Display/Rendering/Mesh.h>
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Profiling/Logging.h>
+
+#include <algorithm>
+
+static bool AllocateRange( std::vector<FArenaRange>& FreeRanges, const uint32_t Size, uint32_t& Offset )
+{
+	for( auto Iterator = FreeRanges.begin(); Iterator != FreeRanges.end(); ++Iterator )
+	{
+		if( Iterator->Size >= Size )
+		{
+			Offset = Iterator->Offset;
+			Iterator->Offset += Size;
+			Iterator->Size -= Size;
+
+			if( Iterator->Size == 0 )
+			{
+				FreeRanges.erase( Iterator );
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void FreeRange( std::vector<FArenaRange>& FreeRanges, const uint32_t Offset, const uint32_t Size )
+{
+	// Ranges are kept sorted by offset so neighbours can be merged.
+	auto Iterator = FreeRanges.begin();
+	while( Iterator != FreeRanges.end() && Iterator->Offset < Offset )
+	{
+		++Iterator;
+	}
+
+	Iterator = FreeRanges.insert( Iterator, { Offset, Size } );
+
+	auto Next = Iterator + 1;
+	if( Next != FreeRanges.end() && Iterator->Offset + Iterator->Size == Next->Offset )
+	{
+		Iterator->Size += Next->Size;
+		FreeRanges.erase( Next );
+	}
+
+	if( Iterator != FreeRanges.begin() )
+	{
+		auto Previous = Iterator - 1;
+		if( Previous->Offset + Previous->Size == Iterator->Offset )
+		{
+			Previous->Size += Iterator->Size;
+			FreeRanges.erase( Iterator );
+		}
+	}
+}
+
+CGeometryArena::CGeometryArena()
+{
+	Enabled = CConfiguration::Get().GetInteger( "geometryarena", 0 ) > 0;
+	PageVertices = static_cast<uint32_t>( CConfiguration::Get().GetInteger( "geometryarenavertices", 1 << 19 ) );
+	PageIndices = static_cast<uint32_t>( CConfiguration::Get().GetInteger( "geometryarenaindices", 1 << 21 ) );
+}
+
+CGeometryArena::~CGeometryArena()
+{
+	for( auto Page : Pages )
+	{
+		delete Page;
+	}
+
+	Pages.clear();
+}
+
+bool CGeometryArena::IsEnabled() const
+{
+	return Enabled;
+}
+
+bool CGeometryArena::Allocate( const uint32_t VertexCount, const uint32_t IndexCount, FGeometryAllocation& Allocation )
+{
+	if( !Enabled || VertexCount == 0 || IndexCount == 0 || VertexCount > PageVertices || IndexCount > PageIndices )
+		return false;
+
+	for( size_t PageIndex = 0; PageIndex <= Pages.size(); PageIndex++ )
+	{
+		FGeometryPage* Page = PageIndex < Pages.size() ? Pages[PageIndex] : CreatePage();
+
+		uint32_t BaseVertex = 0;
+		if( !AllocateRange( Page->FreeVertices, VertexCount, BaseVertex ) )
+			continue;
+
+		uint32_t FirstIndex = 0;
+		if( !AllocateRange( Page->FreeIndices, IndexCount, FirstIndex ) )
+		{
+			FreeRange( Page->FreeVertices, BaseVertex, VertexCount );
+			continue;
+		}
+
+		Allocation.Page = Page;
+		Allocation.BaseVertex = BaseVertex;
+		Allocation.FirstIndex = FirstIndex;
+		Allocation.VertexCount = VertexCount;
+		Allocation.IndexCount = IndexCount;
+
+		return true;
+	}
+
+	return false;
+}
+
+void CGeometryArena::Free( FGeometryAllocation& Allocation )
+{
+	// Pages that have already been released take their ranges with them.
+	if( Allocation.Page && std::find( Pages.begin(), Pages.end(), Allocation.Page ) != Pages.end() )
+	{
+		FreeRange( Allocation.Page->FreeVertices, Allocation.BaseVertex, Allocation.VertexCount );
+		FreeRange( Allocation.Page->FreeIndices, Allocation.FirstIndex, Allocation.IndexCount );
+	}
+
+	Allocation = FGeometryAllocation();
+}
+
+void CGeometryArena::Release()
+{
+	CStateCache& StateCache = CStateCache::Get();
+	for( auto Page : Pages )
+	{
+		StateCache.ReleaseVertexArray( Page->VertexArrayObject );
+		glDeleteVertexArrays( 1, &Page->VertexArrayObject );
+
+		StateCache.ReleaseBuffer( Page->VertexBufferObject );
+		glDeleteBuffers( 1, &Page->VertexBufferObject );
+
+		StateCache.ReleaseBuffer( Page->IndexBufferObject );
+		glDeleteBuffers( 1, &Page->IndexBufferObject );
+
+		delete Page;
+	}
+
+	Pages.clear();
+}
+
+FGeometryPage* CGeometryArena::CreatePage()
+{
+	FGeometryPage* Page = new FGeometryPage();
+	CStateCache& StateCache = CStateCache::Get();
+
+	glGenBuffers( 1, &Page->VertexBufferObject );
+	StateCache.BindBuffer( GL_ARRAY_BUFFER, Page->VertexBufferObject );
+	glBufferData( GL_ARRAY_BUFFER, sizeof( FVertex ) * PageVertices, 0, GL_STATIC_DRAW );
+
+	glGenVertexArrays( 1, &Page->VertexArrayObject );
+	StateCache.BindVertexArray( Page->VertexArrayObject );
+	CMesh::ConfigureVertexAttributes();
+
+	glGenBuffers( 1, &Page->IndexBufferObject );
+	StateCache.BindBuffer( GL_ELEMENT_ARRAY_BUFFER, Page->IndexBufferObject );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( glm::uint ) * PageIndices, 0, GL_STATIC_DRAW );
+
+	Page->FreeVertices.push_back( { 0, PageVertices } );
+	Page->FreeIndices.push_back( { 0, PageIndices } );
+
+	Pages.emplace_back( Page );
+
+	Log::Event( "Created geometry arena page %i.\n", static_cast<int>( Pages.size() ) );
+
+	return Page;
+}
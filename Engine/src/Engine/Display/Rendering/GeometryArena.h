@@ -0,0 +1,79 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <glad/glad.h>
+#include <stdint.h>
+#include <vector>
+
+// Layout expected by glMultiDrawElementsIndirect.
+struct FDrawElementsIndirectCommand
+{
+	GLuint Count;
+	GLuint InstanceCount;
+	GLuint FirstIndex;
+	GLint BaseVertex;
+	GLuint BaseInstance;
+};
+
+struct FArenaRange
+{
+	uint32_t Offset;
+	uint32_t Size;
+};
+
+// A set of shared vertex and index buffers with a single vertex array object.
+struct FGeometryPage
+{
+	GLuint VertexArrayObject = 0;
+	GLuint VertexBufferObject = 0;
+	GLuint IndexBufferObject = 0;
+
+	std::vector<FArenaRange> FreeVertices;
+	std::vector<FArenaRange> FreeIndices;
+};
+
+struct FGeometryAllocation
+{
+	FGeometryPage* Page = nullptr;
+	uint32_t BaseVertex = 0;
+	uint32_t FirstIndex = 0;
+	uint32_t VertexCount = 0;
+	uint32_t IndexCount = 0;
+};
+
+// Sub-allocates static meshes into a few large buffers so they can share a vertex array object.
+class CGeometryArena
+{
+public:
+	~CGeometryArena();
+
+	bool IsEnabled() const;
+
+	bool Allocate( const uint32_t VertexCount, const uint32_t IndexCount, FGeometryAllocation& Allocation );
+	void Free( FGeometryAllocation& Allocation );
+
+	// Deletes the pages and their buffers, has to be called while the context still exists.
+	void Release();
+
+private:
+	FGeometryPage* CreatePage();
+
+	std::vector<FGeometryPage*> Pages;
+
+	uint32_t PageVertices;
+	uint32_t PageIndices;
+
+	bool Enabled;
+
+public:
+	static CGeometryArena& Get()
+	{
+		static CGeometryArena StaticInstance;
+		return StaticInstance;
+	}
+private:
+	CGeometryArena();
+
+	CGeometryArena( CGeometryArena const& ) = delete;
+	void operator=( CGeometryArena const& ) = delete;
+};
@@ -1,15 +1,29 @@
 // Copyright  2017, Christiaan Bakker, All rights reserved.
 #include "Mesh.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <glm/gtc/packing.hpp>
+
+#include <Engine/Display/Rendering/StateCache.h>
 #include <Engine/Profiling/Logging.h>
 #include <Engine/Profiling/Profiling.h>
 
 static std::string GeneratedMesh = "gen";
 
+// Interval between warnings while the GPU is behind on the segment that is about to be written.
+static const GLuint64 RingTimeout = 1000000000;
+
 CMesh::CMesh( EMeshType InMeshType )
 {
 	MeshType = InMeshType;
+	VertexFormat = EVertexFormat::Full;
 	VertexArrayObject = 0;
+	InstanceTransformBuffer = 0;
+	InstanceColorBuffer = 0;
+	InstanceLayerBuffer = 0;
 
 	Location = GeneratedMesh;
 }
@@ -21,17 +35,53 @@ CMesh::~CMesh()
 
 void CMesh::Destroy()
 {
+	// Arena pages are shared, only hand the range back.
+	if( Allocation.Page )
+	{
+		CGeometryArena::Get().Free( Allocation );
+
+		VertexArrayObject = 0;
+		InstanceTransformBuffer = 0;
+		InstanceColorBuffer = 0;
+		InstanceLayerBuffer = 0;
+		VertexBufferData.VertexBufferObject = 0;
+		VertexBufferData.IndexBufferObject = 0;
+		return;
+	}
+
+	// Deleting the buffers below also unmaps the ring.
+	for( uint32_t Segment = 0; Segment < FDynamicRing::Segments; Segment++ )
+	{
+		if( Ring.Fences[Segment] )
+		{
+			glDeleteSync( Ring.Fences[Segment] );
+		}
+	}
+
+	if( Ring.VertexCapacity > 0 )
+	{
+		Allocation = FGeometryAllocation();
+	}
+
+	Ring = FDynamicRing();
+
 	if( VertexBufferData.VertexBufferObject != 0 )
 	{
+		CStateCache::Get().ReleaseVertexArray( VertexArrayObject );
 		glDeleteVertexArrays( 1, &VertexArrayObject );
 		VertexArrayObject = 0;
+		InstanceTransformBuffer = 0;
+		InstanceColorBuffer = 0;
+		InstanceLayerBuffer = 0;
 
+		CStateCache::Get().ReleaseBuffer( VertexBufferData.VertexBufferObject );
 		glDeleteBuffers( 1, &VertexBufferData.VertexBufferObject );
 		VertexBufferData.VertexBufferObject = 0;
 	}
 
 	if( VertexBufferData.IndexBufferObject != 0 )
 	{
+		CStateCache::Get().ReleaseBuffer( VertexBufferData.IndexBufferObject );
 		glDeleteBuffers( 1, &VertexBufferData.IndexBufferObject );
 		VertexBufferData.IndexBufferObject = 0;
 	}
@@ -46,6 +96,17 @@ bool CMesh::Populate( const FPrimitive& Primitive )
 {
 	this->Primitive = Primitive;
 
+	// Dynamic meshes are rewritten with full vertices, only static meshes can be quantized.
+	const bool Compact = MeshType == EMeshType::Static && Primitive.VertexFormat == EVertexFormat::Compact;
+	VertexFormat = Compact ? EVertexFormat::Compact : EVertexFormat::Full;
+
+	// Static indexed meshes are packed into the shared geometry arena when it is enabled.
+	// Arena pages only hold full vertices, compact meshes also decode against their own bounds so they can't share an indirect draw.
+	if( MeshType == EMeshType::Static && VertexFormat == EVertexFormat::Full && VertexBufferData.VertexBufferObject == 0 )
+	{
+		CGeometryArena::Get().Allocate( Primitive.VertexCount, Primitive.IndexCount, Allocation );
+	}
+
 	bool bCreatedVertexBuffer = CreateVertexBuffer();
 	if( bCreatedVertexBuffer )
 	{
@@ -57,6 +118,182 @@ bool CMesh::Populate( const FPrimitive& Primitive )
 	return bCreatedVertexBuffer;
 }
 
+bool CMesh::Reserve( const uint32_t VertexCapacity, const uint32_t IndexCapacity )
+{
+	if( MeshType != EMeshType::Dynamic )
+	{
+		Log::Event( Log::Error, "Only dynamic meshes can reserve a streaming ring.\n" );
+		return false;
+	}
+
+	if( VertexBufferData.VertexBufferObject != 0 )
+	{
+		Log::Event( Log::Error, "Mesh vertex buffer has already been created.\n" );
+		return false;
+	}
+
+	if( VertexCapacity == 0 )
+	{
+		Log::Event( Log::Error, "Mesh vertex buffer has no vertices.\n" );
+		return false;
+	}
+
+	Ring.VertexCapacity = VertexCapacity;
+	Ring.IndexCapacity = std::max( IndexCapacity, 1u );
+
+	const GLsizeiptr VertexSize = sizeof( FVertex ) * Ring.VertexCapacity * FDynamicRing::Segments;
+	const GLsizeiptr IndexSize = sizeof( glm::uint ) * Ring.IndexCapacity * FDynamicRing::Segments;
+
+	// The copy target is used so the bound vertex array object doesn't pick up the index buffer.
+	CStateCache& StateCache = CStateCache::Get();
+	glGenBuffers( 1, &VertexBufferData.VertexBufferObject );
+	glGenBuffers( 1, &VertexBufferData.IndexBufferObject );
+
+	const bool BufferStorage = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+	if( BufferStorage )
+	{
+		// Coherent mappings don't have to be flushed, writes become visible to the next draw.
+		const GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		StateCache.BindBuffer( GL_COPY_WRITE_BUFFER, VertexBufferData.VertexBufferObject );
+		glBufferStorage( GL_COPY_WRITE_BUFFER, VertexSize, nullptr, Flags );
+		Ring.Vertices = static_cast<FVertex*>( glMapBufferRange( GL_COPY_WRITE_BUFFER, 0, VertexSize, Flags ) );
+
+		StateCache.BindBuffer( GL_COPY_WRITE_BUFFER, VertexBufferData.IndexBufferObject );
+		glBufferStorage( GL_COPY_WRITE_BUFFER, IndexSize, nullptr, Flags );
+		Ring.Indices = static_cast<glm::uint*>( glMapBufferRange( GL_COPY_WRITE_BUFFER, 0, IndexSize, Flags ) );
+	}
+	else
+	{
+		StateCache.BindBuffer( GL_COPY_WRITE_BUFFER, VertexBufferData.VertexBufferObject );
+		glBufferData( GL_COPY_WRITE_BUFFER, VertexSize, nullptr, MeshType );
+
+		StateCache.BindBuffer( GL_COPY_WRITE_BUFFER, VertexBufferData.IndexBufferObject );
+		glBufferData( GL_COPY_WRITE_BUFFER, IndexSize, nullptr, MeshType );
+	}
+
+	if( BufferStorage && ( !Ring.Vertices || !Ring.Indices ) )
+	{
+		Log::Event( Log::Error, "Failed to map the streaming ring of a dynamic mesh.\n" );
+		Destroy();
+		return false;
+	}
+
+	VertexBufferData.VertexCount = 0;
+	VertexBufferData.IndexCount = 0;
+	HasIndexBuffer = false;
+
+	return true;
+}
+
+bool CMesh::Update( const FVertex* Vertices, const uint32_t VertexCount, const glm::uint* Indices, const uint32_t IndexCount )
+{
+	if( Ring.VertexCapacity == 0 )
+	{
+		Log::Event( Log::Error, "Dynamic mesh has no streaming ring, call Reserve first.\n" );
+		return false;
+	}
+
+	if( !Vertices || VertexCount > Ring.VertexCapacity || IndexCount > Ring.IndexCapacity || ( IndexCount > 0 && !Indices ) )
+	{
+		Log::Event( Log::Warning, "Dynamic mesh update doesn't fit in the reserved capacity.\n" );
+		return false;
+	}
+
+	// The next segment can only be overwritten once the GPU is done with the draws that read from it.
+	const uint32_t NextSegment = ( Ring.Segment + 1 ) % FDynamicRing::Segments;
+	GLsync& Fence = Ring.Fences[NextSegment];
+	if( Fence )
+	{
+		GLenum Result = glClientWaitSync( Fence, 0, 0 );
+		while( Result == GL_TIMEOUT_EXPIRED )
+		{
+			Result = glClientWaitSync( Fence, GL_SYNC_FLUSH_COMMANDS_BIT, RingTimeout );
+			if( Result == GL_TIMEOUT_EXPIRED )
+			{
+				Log::Event( Log::Warning, "Dynamic mesh update is still waiting for the GPU to release its segment.\n" );
+			}
+		}
+
+		if( Result == GL_WAIT_FAILED )
+		{
+			Log::Event( Log::Error, "Failed to wait for a segment of a dynamic mesh.\n" );
+			return false;
+		}
+
+		glDeleteSync( Fence );
+		Fence = nullptr;
+	}
+
+	// Draws that were issued before this update read from the current segment.
+	if( Ring.Fences[Ring.Segment] )
+	{
+		glDeleteSync( Ring.Fences[Ring.Segment] );
+	}
+
+	Ring.Fences[Ring.Segment] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	Ring.Segment = NextSegment;
+
+	const uint32_t BaseVertex = Ring.Segment * Ring.VertexCapacity;
+	const uint32_t FirstIndex = Ring.Segment * Ring.IndexCapacity;
+
+	// Bounds are gathered from the source, the mapped memory is write-combined and slow to read.
+	for( uint32_t Index = 0; Index < VertexCount; Index++ )
+	{
+		const Vector3D& Position = Vertices[Index].Position;
+		if( Index == 0 )
+		{
+			AABB.Minimum = Position;
+			AABB.Maximum = Position;
+		}
+
+		for( int Axis = 0; Axis < 3; Axis++ )
+		{
+			AABB.Minimum[Axis] = std::min( AABB.Minimum[Axis], Position[Axis] );
+			AABB.Maximum[Axis] = std::max( AABB.Maximum[Axis], Position[Axis] );
+		}
+	}
+
+	if( Ring.Vertices )
+	{
+		memcpy( Ring.Vertices + BaseVertex, Vertices, sizeof( FVertex ) * VertexCount );
+		if( IndexCount > 0 )
+		{
+			memcpy( Ring.Indices + FirstIndex, Indices, sizeof( glm::uint ) * IndexCount );
+		}
+	}
+	else
+	{
+		CStateCache& StateCache = CStateCache::Get();
+		StateCache.BindBuffer( GL_COPY_WRITE_BUFFER, VertexBufferData.VertexBufferObject );
+		glBufferSubData( GL_COPY_WRITE_BUFFER, sizeof( FVertex ) * BaseVertex, sizeof( FVertex ) * VertexCount, Vertices );
+
+		if( IndexCount > 0 )
+		{
+			StateCache.BindBuffer( GL_COPY_WRITE_BUFFER, VertexBufferData.IndexBufferObject );
+			glBufferSubData( GL_COPY_WRITE_BUFFER, sizeof( glm::uint ) * FirstIndex, sizeof( glm::uint ) * IndexCount, Indices );
+		}
+	}
+
+	Allocation.BaseVertex = BaseVertex;
+	Allocation.FirstIndex = FirstIndex;
+	Allocation.VertexCount = VertexCount;
+	Allocation.IndexCount = IndexCount;
+
+	VertexBufferData.VertexCount = VertexCount;
+	VertexBufferData.IndexCount = IndexCount;
+	HasIndexBuffer = IndexCount > 0;
+
+	// Streamed geometry has no CPU copy, so the primitive stays empty and only describes the single level of detail that is drawn.
+	Primitive.VertexCount = 0;
+	Primitive.IndexCount = 0;
+	Primitive.LevelOfDetailCount = 1;
+	Primitive.LevelsOfDetail[0].FirstIndex = 0;
+	Primitive.LevelsOfDetail[0].IndexCount = IndexCount;
+
+	return true;
+}
+
 void CMesh::Prepare( EDrawMode DrawModeOverride )
 {
 	if( IsValid() )
@@ -67,19 +304,19 @@ void CMesh::Prepare( EDrawMode DrawModeOverride )
 
 		if( DrawMode != EDrawMode::None )
 		{
-			glBindVertexArray( VertexArrayObject );
+			CStateCache::Get().BindVertexArray( VertexArrayObject );
 
-			glBindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
+			CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
 
 			if( HasIndexBuffer )
 			{
-				glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
+				CStateCache::Get().BindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
 			}
 		}
 	}
 }
 
-void CMesh::Draw( EDrawMode DrawModeOverride )
+void CMesh::Draw( EDrawMode DrawModeOverride, const uint32_t LevelOfDetail )
 {
 	if( IsValid() )
 	{
@@ -89,16 +326,86 @@ void CMesh::Draw( EDrawMode DrawModeOverride )
 		{
 			if( HasIndexBuffer )
 			{
-				glDrawElements( DrawMode, VertexBufferData.IndexCount, GL_UNSIGNED_INT, 0 );
+				const FLevelOfDetail Level = Primitive.GetLevelOfDetail( LevelOfDetail );
+				const void* IndexOffset = reinterpret_cast<void*>( sizeof( glm::uint ) * ( Allocation.FirstIndex + Level.FirstIndex ) );
+				glDrawElementsBaseVertex( DrawMode, Level.IndexCount, GL_UNSIGNED_INT, IndexOffset, Allocation.BaseVertex );
 			}
 			else
 			{
-				glDrawArrays( DrawMode, 0, VertexBufferData.VertexCount );
+				glDrawArrays( DrawMode, Allocation.BaseVertex, VertexBufferData.VertexCount );
 			}
 		}
 	}
 }
 
+void CMesh::PrepareInstances( GLuint TransformBuffer, GLuint ColorBuffer, GLuint LayerBuffer )
+{
+	// The attribute pointers are stored in the vertex array object so they only have to be set up once per buffer.
+	if( VertexArrayObject == 0 || ( TransformBuffer == InstanceTransformBuffer && ColorBuffer == InstanceColorBuffer && LayerBuffer == InstanceLayerBuffer ) )
+		return;
+
+	CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, TransformBuffer );
+	for( GLuint Column = 0; Column < 4; Column++ )
+	{
+		const GLuint Attribute = EVertexAttribute::InstanceTransform + Column;
+		const void* ColumnPointer = reinterpret_cast<void*>( sizeof( glm::vec4 ) * Column );
+		glEnableVertexAttribArray( Attribute );
+		glVertexAttribPointer( Attribute, 4, GL_FLOAT, GL_FALSE, sizeof( glm::mat4 ), ColumnPointer );
+		glVertexAttribDivisor( Attribute, 1 );
+	}
+
+	CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, ColorBuffer );
+	glEnableVertexAttribArray( EVertexAttribute::InstanceColor );
+	glVertexAttribPointer( EVertexAttribute::InstanceColor, 4, GL_FLOAT, GL_FALSE, sizeof( glm::vec4 ), 0 );
+	glVertexAttribDivisor( EVertexAttribute::InstanceColor, 1 );
+
+	CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, LayerBuffer );
+	glEnableVertexAttribArray( EVertexAttribute::InstanceLayers );
+	glVertexAttribPointer( EVertexAttribute::InstanceLayers, 4, GL_FLOAT, GL_FALSE, sizeof( glm::vec4 ), 0 );
+	glVertexAttribDivisor( EVertexAttribute::InstanceLayers, 1 );
+
+	CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
+
+	InstanceTransformBuffer = TransformBuffer;
+	InstanceColorBuffer = ColorBuffer;
+	InstanceLayerBuffer = LayerBuffer;
+}
+
+void CMesh::DrawInstanced( GLsizei Instances, EDrawMode DrawModeOverride, const uint32_t LevelOfDetail )
+{
+	if( IsValid() )
+	{
+		const GLenum DrawMode = DrawModeOverride != EDrawMode::None ? DrawModeOverride : VertexBufferData.DrawMode;
+
+		if( DrawMode != EDrawMode::None )
+		{
+			if( HasIndexBuffer )
+			{
+				const FLevelOfDetail Level = Primitive.GetLevelOfDetail( LevelOfDetail );
+				const void* IndexOffset = reinterpret_cast<void*>( sizeof( glm::uint ) * ( Allocation.FirstIndex + Level.FirstIndex ) );
+				glDrawElementsInstancedBaseVertex( DrawMode, Level.IndexCount, GL_UNSIGNED_INT, IndexOffset, Instances, Allocation.BaseVertex );
+			}
+			else
+			{
+				glDrawArraysInstanced( DrawMode, Allocation.BaseVertex, VertexBufferData.VertexCount, Instances );
+			}
+		}
+	}
+}
+
+void CMesh::DrawIndirect( GLsizei Commands, EDrawMode DrawModeOverride )
+{
+	if( IsValid() && Allocation.Page )
+	{
+		const GLenum DrawMode = DrawModeOverride != EDrawMode::None ? DrawModeOverride : VertexBufferData.DrawMode;
+
+		if( DrawMode != EDrawMode::None )
+		{
+			glMultiDrawElementsIndirect( DrawMode, GL_UNSIGNED_INT, 0, Commands, 0 );
+		}
+	}
+}
+
 FVertexBufferData& CMesh::GetVertexBufferData()
 {
 	return VertexBufferData;
@@ -119,6 +426,58 @@ const FBounds& CMesh::GetBounds() const
 	return AABB;
 }
 
+uint32_t CMesh::GetLevelOfDetailCount() const
+{
+	return Primitive.GetLevelOfDetailCount();
+}
+
+FLevelOfDetail CMesh::GetLevelOfDetail( const uint32_t Level ) const
+{
+	return Primitive.GetLevelOfDetail( Level );
+}
+
+const FGeometryAllocation& CMesh::GetAllocation() const
+{
+	return Allocation;
+}
+
+void CMesh::ConfigureVertexAttributes( const EVertexFormat::Type Format )
+{
+	if( Format == EVertexFormat::Compact )
+	{
+		glEnableVertexAttribArray( EVertexAttribute::Position );
+		const void* PositionPointer = reinterpret_cast<void*>( offsetof( FCompactVertex, Position ) );
+		glVertexAttribPointer( EVertexAttribute::Position, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof( FCompactVertex ), PositionPointer );
+
+		glEnableVertexAttribArray( EVertexAttribute::TextureCoordinate );
+		const void* CoordinatePointer = reinterpret_cast<void*>( offsetof( FCompactVertex, TextureCoordinate ) );
+		glVertexAttribPointer( EVertexAttribute::TextureCoordinate, 2, GL_HALF_FLOAT, GL_FALSE, sizeof( FCompactVertex ), CoordinatePointer );
+
+		glEnableVertexAttribArray( EVertexAttribute::Normal );
+		const void* NormalPointer = reinterpret_cast<void*>( offsetof( FCompactVertex, Normal ) );
+		glVertexAttribPointer( EVertexAttribute::Normal, 2, GL_SHORT, GL_TRUE, sizeof( FCompactVertex ), NormalPointer );
+
+		return;
+	}
+
+	glEnableVertexAttribArray( EVertexAttribute::Position );
+	const void* PositionPointer = reinterpret_cast<void*>( offsetof( FVertex, Position ) );
+	glVertexAttribPointer( EVertexAttribute::Position, 3, GL_FLOAT, GL_FALSE, sizeof( FVertex ), PositionPointer );
+
+	glEnableVertexAttribArray( EVertexAttribute::TextureCoordinate );
+	const void* CoordinatePointer = reinterpret_cast<void*>( offsetof( FVertex, TextureCoordinate ) );
+	glVertexAttribPointer( EVertexAttribute::TextureCoordinate, 2, GL_FLOAT, GL_FALSE, sizeof( FVertex ), CoordinatePointer );
+
+	glEnableVertexAttribArray( EVertexAttribute::Normal );
+	const void* NormalPointer = reinterpret_cast<void*>( offsetof( FVertex, Normal ) );
+	glVertexAttribPointer( EVertexAttribute::Normal, 3, GL_FLOAT, GL_FALSE, sizeof( FVertex ), NormalPointer );
+}
+
+EVertexFormat::Type CMesh::GetVertexFormat() const
+{
+	return VertexFormat;
+}
+
 const std::string& CMesh::GetLocation() const
 {
 	return Location;
@@ -134,23 +493,13 @@ bool CMesh::CreateVertexArrayObject()
 	if( VertexArrayObject == 0 )
 	{
 		glGenVertexArrays( 1, &VertexArrayObject );
-		glBindVertexArray( VertexArrayObject );
-
-		glBindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
+		CStateCache::Get().BindVertexArray( VertexArrayObject );
 
-		glEnableVertexAttribArray( EVertexAttribute::Position );
-		const void* PositionPointer = reinterpret_cast<void*>( offsetof( FVertex, Position ) );
-		glVertexAttribPointer( EVertexAttribute::Position, 3, GL_FLOAT, GL_FALSE, sizeof( FVertex ), PositionPointer );
-
-		glEnableVertexAttribArray( EVertexAttribute::TextureCoordinate );
-		const void* CoordinatePointer = reinterpret_cast<void*>( offsetof( FVertex, TextureCoordinate ) );
-		glVertexAttribPointer( EVertexAttribute::TextureCoordinate, 2, GL_FLOAT, GL_FALSE, sizeof( FVertex ), CoordinatePointer );
+		CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
 
-		glEnableVertexAttribArray( EVertexAttribute::Normal );
-		const void* NormalPointer = reinterpret_cast<void*>( offsetof( FVertex, Normal ) );
-		glVertexAttribPointer( EVertexAttribute::Normal, 3, GL_FLOAT, GL_FALSE, sizeof( FVertex ), NormalPointer );
+		ConfigureVertexAttributes( VertexFormat );
 
-		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
+		CStateCache::Get().BindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
 
 		return true;
 	}
@@ -170,11 +519,21 @@ bool CMesh::CreateVertexBuffer()
 
 		GenerateAABB();
 
-		const uint32_t Size = sizeof( FVertex ) * Primitive.VertexCount;
+		const uint32_t Stride = VertexFormat == EVertexFormat::Compact ? sizeof( FCompactVertex ) : sizeof( FVertex );
+		const uint32_t Size = Stride * Primitive.VertexCount;
 
-		glGenBuffers( 1, &VertexBufferData.VertexBufferObject );
-		glBindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
-		glBufferData( GL_ARRAY_BUFFER, Size, 0, MeshType );
+		if( Allocation.Page )
+		{
+			VertexArrayObject = Allocation.Page->VertexArrayObject;
+			VertexBufferData.VertexBufferObject = Allocation.Page->VertexBufferObject;
+			CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
+		}
+		else
+		{
+			glGenBuffers( 1, &VertexBufferData.VertexBufferObject );
+			CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
+			glBufferData( GL_ARRAY_BUFFER, Size, 0, MeshType );
+		}
 
 		// Make sure we allocate space for our vertices first.
 		VertexData.Vertices = new FVertex[Primitive.VertexCount];
@@ -188,7 +547,7 @@ bool CMesh::CreateVertexBuffer()
 
 		VertexBufferData.VertexCount = Primitive.VertexCount;
 
-		glBufferSubData( GL_ARRAY_BUFFER, 0, Size, VertexData.Vertices );
+		UploadVertices();
 
 		return true;
 	}
@@ -206,9 +565,18 @@ bool CMesh::CreateIndexBuffer()
 	{
 		const uint32_t Size = sizeof( glm::uint ) * Primitive.IndexCount;
 
-		glGenBuffers( 1, &VertexBufferData.IndexBufferObject );
-		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
-		glBufferData( GL_ELEMENT_ARRAY_BUFFER, Size, 0, MeshType );
+		if( Allocation.Page )
+		{
+			VertexBufferData.IndexBufferObject = Allocation.Page->IndexBufferObject;
+			CStateCache::Get().BindVertexArray( VertexArrayObject );
+			CStateCache::Get().BindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
+		}
+		else
+		{
+			glGenBuffers( 1, &VertexBufferData.IndexBufferObject );
+			CStateCache::Get().BindBuffer( GL_ELEMENT_ARRAY_BUFFER, VertexBufferData.IndexBufferObject );
+			glBufferData( GL_ELEMENT_ARRAY_BUFFER, Size, 0, MeshType );
+		}
 
 		IndexData.Indices = new glm::uint[Primitive.IndexCount];
 		for( size_t Index = 0; Index < Primitive.IndexCount; Index++ )
@@ -218,7 +586,7 @@ bool CMesh::CreateIndexBuffer()
 
 		VertexBufferData.IndexCount = Primitive.IndexCount;
 
-		glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, 0, Size, IndexData.Indices );
+		glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, sizeof( glm::uint ) * Allocation.FirstIndex, Size, IndexData.Indices );
 
 		HasIndexBuffer = true;
 
@@ -281,10 +649,6 @@ void CMesh::GenerateAABB()
 
 void CMesh::GenerateNormals()
 {
-	const uint32_t Size = sizeof( FVertex ) * Primitive.VertexCount;
-
-	glBindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
-
 	if( VertexBufferData.IndexBufferObject == 0 )
 	{
 		for( uint32_t VertexIndex = 0; VertexIndex < Primitive.VertexCount; VertexIndex++ )
@@ -317,9 +681,11 @@ void CMesh::GenerateNormals()
 
 		if( !Primitive.HasNormals )
 		{
-			for( uint32_t Index = 0; Index < Primitive.IndexCount; Index += 3 )
+			// Only the full detail level contributes, the other levels reuse its vertices.
+			const uint32_t IndexCount = Primitive.GetLevelOfDetail( 0 ).IndexCount;
+			for( uint32_t Index = 0; Index < IndexCount; Index += 3 )
 			{
-				if( ( Primitive.IndexCount - Index ) > 2 )
+				if( ( IndexCount - Index ) > 2 )
 				{
 					const Vector3D& Vertex0 = Primitive.Vertices[Primitive.Indices[Index]].Position;
 					const Vector3D& Vertex1 = Primitive.Vertices[Primitive.Indices[Index + 1]].Position;
@@ -349,5 +715,63 @@ void CMesh::GenerateNormals()
 		}
 	}
 
-	glBufferSubData( GL_ARRAY_BUFFER, 0, Size, VertexData.Vertices );
+	UploadVertices();
+}
+
+// Folds the lower hemisphere over the upper one and projects the unit sphere onto the octahedron's square.
+static glm::vec2 EncodeOctahedral( const Vector3D& Normal )
+{
+	const float Length = fabs( Normal.X ) + fabs( Normal.Y ) + fabs( Normal.Z );
+	if( Length <= 0.0f )
+	{
+		return glm::vec2( 0.0f, 0.0f );
+	}
+
+	glm::vec2 Encoded = glm::vec2( Normal.X, Normal.Y ) / Length;
+	if( Normal.Z < 0.0f )
+	{
+		const glm::vec2 Sign = glm::vec2( Encoded.x >= 0.0f ? 1.0f : -1.0f, Encoded.y >= 0.0f ? 1.0f : -1.0f );
+		Encoded = ( glm::vec2( 1.0f ) - glm::abs( glm::vec2( Encoded.y, Encoded.x ) ) ) * Sign;
+	}
+
+	return Encoded;
+}
+
+void CMesh::UploadVertices()
+{
+	if( VertexBufferData.VertexBufferObject == 0 || Primitive.VertexCount == 0 )
+		return;
+
+	CStateCache::Get().BindBuffer( GL_ARRAY_BUFFER, VertexBufferData.VertexBufferObject );
+
+	if( VertexFormat != EVertexFormat::Compact )
+	{
+		const uint32_t Size = sizeof( FVertex ) * Primitive.VertexCount;
+		glBufferSubData( GL_ARRAY_BUFFER, sizeof( FVertex ) * Allocation.BaseVertex, Size, VertexData.Vertices );
+		return;
+	}
+
+	// Flat axes would divide by zero, their vertices all sit on the minimum.
+	const glm::vec3 Minimum = Math::ToGLM( AABB.Minimum );
+	const glm::vec3 Extent = Math::ToGLM( AABB.Maximum ) - Minimum;
+	const glm::vec3 Scale = glm::vec3(
+		Extent.x > 0.0f ? 1.0f / Extent.x : 0.0f,
+		Extent.y > 0.0f ? 1.0f / Extent.y : 0.0f,
+		Extent.z > 0.0f ? 1.0f / Extent.z : 0.0f
+	);
+
+	std::vector<FCompactVertex> CompactVertices( Primitive.VertexCount );
+	for( uint32_t VertexIndex = 0; VertexIndex < Primitive.VertexCount; VertexIndex++ )
+	{
+		const FVertex& Vertex = VertexData.Vertices[VertexIndex];
+		FCompactVertex& CompactVertex = CompactVertices[VertexIndex];
+
+		const glm::vec3 Position = glm::clamp( ( Math::ToGLM( Vertex.Position ) - Minimum ) * Scale, 0.0f, 1.0f );
+		CompactVertex.Position = glm::packUnorm4x16( glm::vec4( Position, 1.0f ) );
+		CompactVertex.TextureCoordinate = glm::packHalf2x16( Math::ToGLM( Vertex.TextureCoordinate ) );
+		CompactVertex.Normal = glm::packSnorm2x16( EncodeOctahedral( Vertex.Normal ) );
+	}
+
+	const uint32_t Size = sizeof( FCompactVertex ) * Primitive.VertexCount;
+	glBufferSubData( GL_ARRAY_BUFFER, 0, Size, CompactVertices.data() );
 }
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <Engine/Display/Rendering/GeometryArena.h>
 #include <Engine/Utility/Math.h>
 #include <Engine/Utility/Primitive.h>
 
@@ -15,7 +16,14 @@ namespace EVertexAttribute
 		Position = 0,
 		TextureCoordinate,
 		Normal,
-		Color
+		Color,
+
+		// Per-instance model matrix, occupies four consecutive locations.
+		InstanceTransform,
+		InstanceColor = InstanceTransform + 4,
+
+		// Per-instance texture array layers of the first four slots.
+		InstanceLayers
 	};
 }
 
@@ -45,6 +53,20 @@ struct FVertexData
 	FVertex* Vertices;
 };
 
+// Quantized layout of EVertexFormat::Compact, 16 bytes instead of the 44 of a full vertex.
+// Shaders decode it when the VertexFormat uniform is set, positions map from the object bounds and normals are octahedral.
+struct FCompactVertex
+{
+	// Unsigned normalized position within the mesh bounds, the fourth component is padding.
+	uint64_t Position;
+
+	// Two half floats.
+	uint32_t TextureCoordinate;
+
+	// Octahedral encoded normal as two signed normalized components.
+	uint32_t Normal;
+};
+
 struct FIndexData
 {
 	~FIndexData()
@@ -69,6 +91,22 @@ struct FVertexBufferData
 	}
 };
 
+// Persistently mapped ring of vertex and index segments, one per frame in flight.
+struct FDynamicRing
+{
+	static const uint32_t Segments = 3;
+
+	// Mappings of the whole ring, only set when buffer storage is supported.
+	FVertex* Vertices = nullptr;
+	glm::uint* Indices = nullptr;
+
+	GLsync Fences[Segments] = {};
+
+	uint32_t VertexCapacity = 0;
+	uint32_t IndexCapacity = 0;
+	uint32_t Segment = 0;
+};
+
 class CMesh
 {
 public:
@@ -81,8 +119,23 @@ public:
 
 	bool Populate( const FPrimitive& Primitive );
 
+	// Allocates the streaming ring of a dynamic mesh, the capacities are per update.
+	bool Reserve( const uint32_t VertexCapacity, const uint32_t IndexCapacity );
+
+	// Writes new geometry into the next segment of the ring without reallocating, indices are relative to the given vertices.
+	// Waits for the GPU only when it is still reading the segment from two updates ago.
+	// Streamed geometry isn't kept on the CPU, the primitive of a ring mesh has no vertices or indices.
+	bool Update( const FVertex* Vertices, const uint32_t VertexCount, const glm::uint* Indices = nullptr, const uint32_t IndexCount = 0 );
+
 	void Prepare( EDrawMode DrawModeOverride );
-	void Draw( EDrawMode DrawModeOverride = None );
+	void Draw( EDrawMode DrawModeOverride = None, const uint32_t LevelOfDetail = 0 );
+
+	// Attaches the per-instance transform, color and texture layer streams to the vertex array object.
+	void PrepareInstances( GLuint TransformBuffer, GLuint ColorBuffer, GLuint LayerBuffer );
+	void DrawInstanced( GLsizei Instances, EDrawMode DrawModeOverride = None, const uint32_t LevelOfDetail = 0 );
+
+	// Issues the indirect commands in the bound draw indirect buffer, only valid for meshes that live in the geometry arena.
+	void DrawIndirect( GLsizei Commands, EDrawMode DrawModeOverride = None );
 
 	FVertexBufferData& GetVertexBufferData();
 	const FVertexData& GetVertexData() const;
@@ -90,6 +143,18 @@ public:
 
 	const FBounds& GetBounds() const;
 
+	// Levels of detail are ranges of the index buffer, levels past the last one return the coarsest level.
+	uint32_t GetLevelOfDetailCount() const;
+	FLevelOfDetail GetLevelOfDetail( const uint32_t Level ) const;
+
+	// Range of the shared geometry arena this mesh occupies, the page is null for meshes with their own buffers.
+	const FGeometryAllocation& GetAllocation() const;
+
+	// Sets up the vertex attribute layout for the bound vertex array and vertex buffer.
+	static void ConfigureVertexAttributes( const EVertexFormat::Type Format = EVertexFormat::Full );
+
+	EVertexFormat::Type GetVertexFormat() const;
+
 	const std::string& GetLocation() const;
 	void SetLocation( const std::string& FileLocation );
 private:
@@ -100,13 +165,23 @@ private:
 	void GenerateAABB();
 	void GenerateNormals();
 
+	// Copies the vertex data into the vertex buffer, packing it first when the mesh uses the compact format.
+	void UploadVertices();
+
 	FVertexBufferData VertexBufferData;
 	FVertexData VertexData;
 	FIndexData IndexData;
 
 	GLuint VertexArrayObject;
+	GLuint InstanceTransformBuffer;
+	GLuint InstanceColorBuffer;
+	GLuint InstanceLayerBuffer;
+
+	FGeometryAllocation Allocation;
+	FDynamicRing Ring;
 	
 	EMeshType MeshType;
+	EVertexFormat::Type VertexFormat;
 
 	uint32_t HasIndexBuffer : 1;
 
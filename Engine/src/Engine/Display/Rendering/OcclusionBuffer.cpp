@@ -0,0 +1,250 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include <Engine/Display/Rendering/Mesh.h>
+
+// Vertices closer to the eye than this are treated as crossing the near plane.
+static const float MinimumW = 1e-3f;
+
+// The hierarchy level is chosen so that a bounding rectangle covers at most this many texels on either axis.
+static const int MaximumTestExtent = 4;
+
+COcclusionBuffer::COcclusionBuffer( const int Width, const int Height )
+{
+	int LevelWidth = Width;
+	int LevelHeight = Height;
+	while( true )
+	{
+		FDepthLevel Level;
+		Level.Width = LevelWidth;
+		Level.Height = LevelHeight;
+		Level.Depth.resize( LevelWidth * LevelHeight, 1.0f );
+		Levels.emplace_back( Level );
+
+		if( LevelWidth == 1 && LevelHeight == 1 )
+			break;
+
+		LevelWidth = std::max( LevelWidth / 2, 1 );
+		LevelHeight = std::max( LevelHeight / 2, 1 );
+	}
+
+	ViewProjection = glm::mat4( 1.0f );
+	OccluderTriangles = 0;
+}
+
+void COcclusionBuffer::Clear( const glm::mat4& ViewProjectionIn )
+{
+	ViewProjection = ViewProjectionIn;
+	std::fill( Levels[0].Depth.begin(), Levels[0].Depth.end(), 1.0f );
+	OccluderTriangles = 0;
+}
+
+void COcclusionBuffer::Rasterize( CMesh* Mesh, const glm::mat4& Model )
+{
+	const FVertexData& VertexData = Mesh->GetVertexData();
+	const FIndexData& IndexData = Mesh->GetIndexData();
+	const FVertexBufferData& BufferData = Mesh->GetVertexBufferData();
+	if( !VertexData.Vertices || BufferData.DrawMode != EDrawMode::Triangles )
+		return;
+
+	const glm::mat4 ModelViewProjection = ViewProjection * Model;
+
+	ClipPositions.resize( BufferData.VertexCount );
+	for( glm::uint Index = 0; Index < BufferData.VertexCount; Index++ )
+	{
+		ClipPositions[Index] = ModelViewProjection * glm::vec4( Math::ToGLM( VertexData.Vertices[Index].Position ), 1.0f );
+	}
+
+	// The full detail level is used so that the occluder never extends past the real surface.
+	const glm::uint Count = IndexData.Indices ? Mesh->GetLevelOfDetail( 0 ).IndexCount : BufferData.VertexCount;
+	const float Width = static_cast<float>( Levels[0].Width );
+	const float Height = static_cast<float>( Levels[0].Height );
+	for( glm::uint Index = 0; Index + 2 < Count; Index += 3 )
+	{
+		glm::vec3 Screen[3];
+		bool Clipped = false;
+		for( glm::uint Corner = 0; Corner < 3; Corner++ )
+		{
+			const glm::uint Vertex = IndexData.Indices ? IndexData.Indices[Index + Corner] : Index + Corner;
+			const glm::vec4& Clip = ClipPositions[Vertex];
+
+			// Dropping triangles that cross the near plane only makes the occluder smaller, which keeps the test conservative.
+			if( Clip.w < MinimumW )
+			{
+				Clipped = true;
+				break;
+			}
+
+			const glm::vec3 Normalized = glm::vec3( Clip ) / Clip.w;
+			Screen[Corner] = glm::vec3( ( Normalized.x * 0.5f + 0.5f ) * Width, ( Normalized.y * 0.5f + 0.5f ) * Height, Normalized.z * 0.5f + 0.5f );
+		}
+
+		if( !Clipped )
+		{
+			RasterizeTriangle( Screen[0], Screen[1], Screen[2] );
+		}
+	}
+}
+
+void COcclusionBuffer::RasterizeTriangle( const glm::vec3& A, const glm::vec3& B, const glm::vec3& C )
+{
+	FDepthLevel& Level = Levels[0];
+
+	float Area = ( B.x - A.x ) * ( C.y - A.y ) - ( B.y - A.y ) * ( C.x - A.x );
+	if( fabs( Area ) < 1e-6f )
+		return;
+
+	// Occluders are rasterized double sided, swap the winding so the edge functions are positive inside.
+	const glm::vec3& V0 = A;
+	const glm::vec3& V1 = Area > 0.0f ? B : C;
+	const glm::vec3& V2 = Area > 0.0f ? C : B;
+	Area = fabs( Area );
+
+	const int MinimumX = std::max( static_cast<int>( floor( std::min( { V0.x, V1.x, V2.x } ) ) ), 0 );
+	const int MinimumY = std::max( static_cast<int>( floor( std::min( { V0.y, V1.y, V2.y } ) ) ), 0 );
+	const int MaximumX = std::min( static_cast<int>( ceil( std::max( { V0.x, V1.x, V2.x } ) ) ), Level.Width - 1 );
+	const int MaximumY = std::min( static_cast<int>( ceil( std::max( { V0.y, V1.y, V2.y } ) ) ), Level.Height - 1 );
+	if( MinimumX > MaximumX || MinimumY > MaximumY )
+		return;
+
+	OccluderTriangles++;
+
+	const float InverseArea = 1.0f / Area;
+	for( int Y = MinimumY; Y <= MaximumY; Y++ )
+	{
+		const float PixelY = Y + 0.5f;
+		for( int X = MinimumX; X <= MaximumX; X++ )
+		{
+			const float PixelX = X + 0.5f;
+			const float W0 = ( V2.x - V1.x ) * ( PixelY - V1.y ) - ( V2.y - V1.y ) * ( PixelX - V1.x );
+			const float W1 = ( V0.x - V2.x ) * ( PixelY - V2.y ) - ( V0.y - V2.y ) * ( PixelX - V2.x );
+			const float W2 = ( V1.x - V0.x ) * ( PixelY - V0.y ) - ( V1.y - V0.y ) * ( PixelX - V0.x );
+			if( W0 < 0.0f || W1 < 0.0f || W2 < 0.0f )
+				continue;
+
+			// Depth over w is linear in screen space.
+			const float Depth = ( W0 * V0.z + W1 * V1.z + W2 * V2.z ) * InverseArea;
+			float& Stored = Level.Depth[Y * Level.Width + X];
+			if( Depth < Stored )
+			{
+				Stored = std::max( Depth, 0.0f );
+			}
+		}
+	}
+}
+
+void COcclusionBuffer::BuildHierarchy()
+{
+	for( size_t Index = 1; Index < Levels.size(); Index++ )
+	{
+		const FDepthLevel& Source = Levels[Index - 1];
+		FDepthLevel& Target = Levels[Index];
+		for( int Y = 0; Y < Target.Height; Y++ )
+		{
+			const int SourceY0 = std::min( Y * 2, Source.Height - 1 );
+			const int SourceY1 = std::min( Y * 2 + 1, Source.Height - 1 );
+			for( int X = 0; X < Target.Width; X++ )
+			{
+				const int SourceX0 = std::min( X * 2, Source.Width - 1 );
+				const int SourceX1 = std::min( X * 2 + 1, Source.Width - 1 );
+
+				// Odd sizes fold the last row or column into the texel that precedes it.
+				float Depth = std::max( {
+					Source.Depth[SourceY0 * Source.Width + SourceX0],
+					Source.Depth[SourceY0 * Source.Width + SourceX1],
+					Source.Depth[SourceY1 * Source.Width + SourceX0],
+					Source.Depth[SourceY1 * Source.Width + SourceX1]
+				} );
+
+				if( X == Target.Width - 1 && Source.Width > Target.Width * 2 )
+				{
+					Depth = std::max( { Depth, Source.Depth[SourceY0 * Source.Width + Source.Width - 1], Source.Depth[SourceY1 * Source.Width + Source.Width - 1] } );
+				}
+
+				if( Y == Target.Height - 1 && Source.Height > Target.Height * 2 )
+				{
+					Depth = std::max( { Depth, Source.Depth[( Source.Height - 1 ) * Source.Width + SourceX0], Source.Depth[( Source.Height - 1 ) * Source.Width + SourceX1] } );
+				}
+
+				if( X == Target.Width - 1 && Y == Target.Height - 1 && Source.Width > Target.Width * 2 && Source.Height > Target.Height * 2 )
+				{
+					Depth = std::max( Depth, Source.Depth.back() );
+				}
+
+				Target.Depth[Y * Target.Width + X] = Depth;
+			}
+		}
+	}
+}
+
+bool COcclusionBuffer::IsVisible( const FBounds& WorldBounds ) const
+{
+	const glm::vec3 Minimum = Math::ToGLM( WorldBounds.Minimum );
+	const glm::vec3 Maximum = Math::ToGLM( WorldBounds.Maximum );
+
+	const FDepthLevel& Base = Levels[0];
+	glm::vec2 ScreenMinimum = glm::vec2( FLT_MAX );
+	glm::vec2 ScreenMaximum = glm::vec2( -FLT_MAX );
+	float NearestDepth = FLT_MAX;
+	for( int Corner = 0; Corner < 8; Corner++ )
+	{
+		const glm::vec3 Position = glm::vec3(
+			Corner & 1 ? Maximum.x : Minimum.x,
+			Corner & 2 ? Maximum.y : Minimum.y,
+			Corner & 4 ? Maximum.z : Minimum.z
+		);
+
+		const glm::vec4 Clip = ViewProjection * glm::vec4( Position, 1.0f );
+
+		// Bounds that cross the near plane can't be projected reliably.
+		if( Clip.w < MinimumW )
+			return true;
+
+		const glm::vec3 Normalized = glm::vec3( Clip ) / Clip.w;
+		const glm::vec2 Screen = glm::vec2( ( Normalized.x * 0.5f + 0.5f ) * Base.Width, ( Normalized.y * 0.5f + 0.5f ) * Base.Height );
+		ScreenMinimum = glm::min( ScreenMinimum, Screen );
+		ScreenMaximum = glm::max( ScreenMaximum, Screen );
+		NearestDepth = std::min( NearestDepth, Normalized.z * 0.5f + 0.5f );
+	}
+
+	if( NearestDepth <= 0.0f )
+		return true;
+
+	int MinimumX = std::max( static_cast<int>( floor( ScreenMinimum.x ) ), 0 );
+	int MinimumY = std::max( static_cast<int>( floor( ScreenMinimum.y ) ), 0 );
+	int MaximumX = std::min( static_cast<int>( floor( ScreenMaximum.x ) ), Base.Width - 1 );
+	int MaximumY = std::min( static_cast<int>( floor( ScreenMaximum.y ) ), Base.Height - 1 );
+	if( MinimumX > MaximumX || MinimumY > MaximumY )
+		return true;
+
+	// Walk up the chain until the rectangle only covers a handful of texels.
+	size_t LevelIndex = 0;
+	while( LevelIndex + 1 < Levels.size() && ( MaximumX - MinimumX >= MaximumTestExtent || MaximumY - MinimumY >= MaximumTestExtent ) )
+	{
+		LevelIndex++;
+		MinimumX = std::min( MinimumX / 2, Levels[LevelIndex].Width - 1 );
+		MinimumY = std::min( MinimumY / 2, Levels[LevelIndex].Height - 1 );
+		MaximumX = std::min( MaximumX / 2, Levels[LevelIndex].Width - 1 );
+		MaximumY = std::min( MaximumY / 2, Levels[LevelIndex].Height - 1 );
+	}
+
+	const FDepthLevel& Level = Levels[LevelIndex];
+	for( int Y = MinimumY; Y <= MaximumY; Y++ )
+	{
+		for( int X = MinimumX; X <= MaximumX; X++ )
+		{
+			if( NearestDepth <= Level.Depth[Y * Level.Width + X] )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+size_t COcclusionBuffer::GetOccluderTriangles() const
+{
+	return OccluderTriangles;
+}
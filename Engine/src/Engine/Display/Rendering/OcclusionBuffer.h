@@ -0,0 +1,47 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Engine/Utility/Math.h>
+
+class CMesh;
+
+// Low resolution software depth buffer with a hierarchical-Z chain.
+// Occluders are rasterized on the CPU so renderables can be rejected before submission without waiting on the GPU.
+class COcclusionBuffer
+{
+public:
+	COcclusionBuffer( const int Width = 256, const int Height = 128 );
+
+	void Clear( const glm::mat4& ViewProjection );
+
+	// Rasterizes the triangles of a mesh, only pixels whose centers are covered are written.
+	void Rasterize( CMesh* Mesh, const glm::mat4& Model );
+
+	// Builds the mip chain, every texel stores the farthest depth of the texels it covers.
+	void BuildHierarchy();
+
+	// Conservative test, returns false only if the bounds are entirely behind the rasterized occluders.
+	bool IsVisible( const FBounds& WorldBounds ) const;
+
+	size_t GetOccluderTriangles() const;
+
+private:
+	struct FDepthLevel
+	{
+		int Width;
+		int Height;
+		std::vector<float> Depth;
+	};
+
+	void RasterizeTriangle( const glm::vec3& A, const glm::vec3& B, const glm::vec3& C );
+
+	std::vector<FDepthLevel> Levels;
+	std::vector<glm::vec4> ClipPositions;
+	glm::mat4 ViewProjection;
+
+	size_t OccluderTriangles;
+};
@@ -0,0 +1,293 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "RenderCommandBuffer.h"
+
+#include <Engine/Display/Rendering/Renderable.h>
+#include <Engine/Display/Rendering/StateCache.h>
+
+// Per-instance streams shared by all command buffers, orphaned before every batch upload.
+static GLuint InstanceTransformBuffer = 0;
+static GLuint InstanceColorBuffer = 0;
+static GLuint InstanceLayerBuffer = 0;
+static GLuint IndirectBuffer = 0;
+
+CRenderCommandBuffer::CRenderCommandBuffer()
+{
+	Instances = 0;
+}
+
+void CRenderCommandBuffer::Reset()
+{
+	Commands.clear();
+	Values.clear();
+	InstanceTransforms.clear();
+	InstanceColors.clear();
+	InstanceLayers.clear();
+	IndirectCommands.clear();
+	Instances = 0;
+}
+
+void CRenderCommandBuffer::UseProgram( CShader* Shader )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::UseProgram;
+	Command.Program.Shader = Shader;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::SetState( const EBlendMode::Type BlendMode, const EDepthMask::Type DepthMask, const EDepthTest::Type DepthTest )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::SetState;
+	Command.State.BlendMode = BlendMode;
+	Command.State.DepthMask = DepthMask;
+	Command.State.DepthTest = DepthTest;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::BindTexture( const ETextureSlot Slot, const GLuint Handle )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::BindTexture;
+	Command.Texture.Slot = Slot;
+	Command.Texture.Handle = Handle;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::BindTextureArray( const ETextureSlot Slot, const GLuint Handle )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::BindTextureArray;
+	Command.Texture.Slot = Slot;
+	Command.Texture.Handle = Handle;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::Uniform1i( const GLint Location, const GLint Value )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::Uniform1i;
+	Command.Integer.Location = Location;
+	Command.Integer.Value = Value;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::Uniform3( const GLint Location, const float* Value )
+{
+	PushUniform( ERenderCommand::Uniform3, Location, Value, 3 );
+}
+
+void CRenderCommandBuffer::Uniform4( const GLint Location, const float* Value )
+{
+	PushUniform( ERenderCommand::Uniform4, Location, Value, 4 );
+}
+
+void CRenderCommandBuffer::UniformMatrix4( const GLint Location, const float* Value )
+{
+	PushUniform( ERenderCommand::UniformMatrix4, Location, Value, 16 );
+}
+
+void CRenderCommandBuffer::DrawMesh( CMesh* Mesh, const EDrawMode DrawMode, const bool Prepare, const uint32_t LevelOfDetail )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::DrawMesh;
+	Command.Draw.Mesh = Mesh;
+	Command.Draw.DrawMode = DrawMode;
+	Command.Draw.LevelOfDetail = LevelOfDetail;
+	Command.Draw.Prepare = Prepare;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::DrawInstanced( const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::DrawInstanced;
+	Command.Batch.Renderable = Renderables[Offset];
+	Command.Batch.FirstInstance = PushInstances( Renderables, Offset, Count );
+	Command.Batch.Instances = static_cast<uint32_t>( Count );
+	Command.Batch.FirstCommand = 0;
+	Command.Batch.Commands = 0;
+	Commands.emplace_back( Command );
+}
+
+void CRenderCommandBuffer::DrawIndirect( const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count )
+{
+	FRenderCommand Command;
+	Command.Type = ERenderCommand::DrawIndirect;
+	Command.Batch.Renderable = Renderables[Offset];
+	Command.Batch.FirstInstance = PushInstances( Renderables, Offset, Count );
+	Command.Batch.Instances = static_cast<uint32_t>( Count );
+	Command.Batch.FirstCommand = static_cast<uint32_t>( IndirectCommands.size() );
+
+	// The base instance selects each draw's transform and color from the instance streams.
+	CMesh* PreviousMesh = nullptr;
+	uint32_t PreviousLevelOfDetail = 0;
+	for( size_t Index = Offset; Index < Offset + Count; Index++ )
+	{
+		CMesh* Mesh = Renderables[Index]->GetMesh();
+		const uint32_t LevelOfDetail = Renderables[Index]->GetRenderData().LevelOfDetail;
+		if( Mesh == PreviousMesh && LevelOfDetail == PreviousLevelOfDetail )
+		{
+			IndirectCommands.back().InstanceCount++;
+			continue;
+		}
+
+		const FGeometryAllocation& Allocation = Mesh->GetAllocation();
+		const FLevelOfDetail Level = Mesh->GetLevelOfDetail( LevelOfDetail );
+
+		FDrawElementsIndirectCommand IndirectCommand;
+		IndirectCommand.Count = Level.IndexCount;
+		IndirectCommand.InstanceCount = 1;
+		IndirectCommand.FirstIndex = Allocation.FirstIndex + Level.FirstIndex;
+		IndirectCommand.BaseVertex = static_cast<GLint>( Allocation.BaseVertex );
+		IndirectCommand.BaseInstance = static_cast<GLuint>( Index - Offset );
+		IndirectCommands.emplace_back( IndirectCommand );
+
+		PreviousMesh = Mesh;
+		PreviousLevelOfDetail = LevelOfDetail;
+	}
+
+	Command.Batch.Commands = static_cast<uint32_t>( IndirectCommands.size() ) - Command.Batch.FirstCommand;
+	Commands.emplace_back( Command );
+}
+
+uint32_t CRenderCommandBuffer::Execute()
+{
+	CStateCache& StateCache = CStateCache::Get();
+
+	uint32_t Calls = 0;
+	for( const auto& Command : Commands )
+	{
+		switch( Command.Type )
+		{
+		case ERenderCommand::UseProgram:
+			Command.Program.Shader->Activate();
+			break;
+		case ERenderCommand::SetState:
+			StateCache.SetBlendMode( Command.State.BlendMode );
+			StateCache.SetDepthMask( Command.State.DepthMask );
+			StateCache.SetDepthTest( Command.State.DepthTest );
+			break;
+		case ERenderCommand::BindTexture:
+			StateCache.BindTexture( Command.Texture.Slot, Command.Texture.Handle );
+			break;
+		case ERenderCommand::BindTextureArray:
+			StateCache.BindTextureArray( Command.Texture.Slot, Command.Texture.Handle );
+			break;
+		case ERenderCommand::Uniform1i:
+			glUniform1i( Command.Integer.Location, Command.Integer.Value );
+			break;
+		case ERenderCommand::Uniform3:
+			glUniform3fv( Command.Uniform.Location, 1, &Values[Command.Uniform.Offset] );
+			break;
+		case ERenderCommand::Uniform4:
+			glUniform4fv( Command.Uniform.Location, 1, &Values[Command.Uniform.Offset] );
+			break;
+		case ERenderCommand::UniformMatrix4:
+			glUniformMatrix4fv( Command.Uniform.Location, 1, GL_FALSE, &Values[Command.Uniform.Offset] );
+			break;
+		case ERenderCommand::DrawMesh:
+			if( Command.Draw.Prepare )
+			{
+				Command.Draw.Mesh->Prepare( Command.Draw.DrawMode );
+			}
+
+			Command.Draw.Mesh->Draw( Command.Draw.DrawMode, Command.Draw.LevelOfDetail );
+			Calls++;
+			break;
+		case ERenderCommand::DrawInstanced:
+		case ERenderCommand::DrawIndirect:
+		{
+			UploadInstances( Command );
+
+			FRenderDataInstanced& RenderData = Command.Batch.Renderable->GetRenderData();
+			RenderData.PositionBufferObject = InstanceTransformBuffer;
+			RenderData.ColorBufferObject = InstanceColorBuffer;
+			RenderData.LayerBufferObject = InstanceLayerBuffer;
+
+			if( Command.Type == ERenderCommand::DrawInstanced )
+			{
+				Command.Batch.Renderable->DrawInstanced( RenderData, static_cast<GLsizei>( Command.Batch.Instances ) );
+			}
+			else
+			{
+				if( IndirectBuffer == 0 )
+				{
+					glGenBuffers( 1, &IndirectBuffer );
+				}
+
+				const size_t CommandsSize = sizeof( FDrawElementsIndirectCommand ) * Command.Batch.Commands;
+				StateCache.BindBuffer( GL_DRAW_INDIRECT_BUFFER, IndirectBuffer );
+				glBufferData( GL_DRAW_INDIRECT_BUFFER, CommandsSize, nullptr, GL_STREAM_DRAW );
+				glBufferSubData( GL_DRAW_INDIRECT_BUFFER, 0, CommandsSize, &IndirectCommands[Command.Batch.FirstCommand] );
+
+				Command.Batch.Renderable->DrawIndirect( RenderData, static_cast<GLsizei>( Command.Batch.Commands ) );
+			}
+
+			Calls++;
+			break;
+		}
+		}
+	}
+
+	return Calls;
+}
+
+size_t CRenderCommandBuffer::GetSize() const
+{
+	return Commands.size();
+}
+
+uint32_t CRenderCommandBuffer::GetInstances() const
+{
+	return Instances;
+}
+
+void CRenderCommandBuffer::PushUniform( const ERenderCommand::Type Type, const GLint Location, const float* Value, const size_t Size )
+{
+	FRenderCommand Command;
+	Command.Type = Type;
+	Command.Uniform.Location = Location;
+	Command.Uniform.Offset = static_cast<uint32_t>( Values.size() );
+	Commands.emplace_back( Command );
+
+	Values.insert( Values.end(), Value, Value + Size );
+}
+
+uint32_t CRenderCommandBuffer::PushInstances( const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count )
+{
+	const uint32_t FirstInstance = static_cast<uint32_t>( InstanceTransforms.size() );
+	for( size_t Index = Offset; Index < Offset + Count; Index++ )
+	{
+		FRenderDataInstanced& InstanceData = Renderables[Index]->GetRenderData();
+		InstanceTransforms.emplace_back( InstanceData.Transform.GetTransformationMatrix() );
+		InstanceColors.emplace_back( InstanceData.Color );
+		InstanceLayers.emplace_back( Renderables[Index]->GetTextureLayers() );
+	}
+
+	Instances += static_cast<uint32_t>( Count );
+	return FirstInstance;
+}
+
+void CRenderCommandBuffer::UploadInstances( const FRenderCommand& Command )
+{
+	if( InstanceTransformBuffer == 0 )
+	{
+		glGenBuffers( 1, &InstanceTransformBuffer );
+		glGenBuffers( 1, &InstanceColorBuffer );
+		glGenBuffers( 1, &InstanceLayerBuffer );
+	}
+
+	const size_t Count = Command.Batch.Instances;
+	CStateCache& StateCache = CStateCache::Get();
+	StateCache.BindBuffer( GL_ARRAY_BUFFER, InstanceTransformBuffer );
+	glBufferData( GL_ARRAY_BUFFER, sizeof( glm::mat4 ) * Count, nullptr, GL_STREAM_DRAW );
+	glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( glm::mat4 ) * Count, &InstanceTransforms[Command.Batch.FirstInstance] );
+
+	StateCache.BindBuffer( GL_ARRAY_BUFFER, InstanceColorBuffer );
+	glBufferData( GL_ARRAY_BUFFER, sizeof( glm::vec4 ) * Count, nullptr, GL_STREAM_DRAW );
+	glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( glm::vec4 ) * Count, &InstanceColors[Command.Batch.FirstInstance] );
+
+	StateCache.BindBuffer( GL_ARRAY_BUFFER, InstanceLayerBuffer );
+	glBufferData( GL_ARRAY_BUFFER, sizeof( glm::vec4 ) * Count, nullptr, GL_STREAM_DRAW );
+	glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( glm::vec4 ) * Count, &InstanceLayers[Command.Batch.FirstInstance] );
+}
@@ -0,0 +1,136 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <Engine/Display/Rendering/GeometryArena.h>
+#include <Engine/Display/Rendering/Mesh.h>
+#include <Engine/Display/Rendering/Shader.h>
+
+class CRenderable;
+
+namespace ERenderCommand
+{
+	enum Type : uint8_t
+	{
+		UseProgram = 0,
+		SetState,
+		BindTexture,
+		BindTextureArray,
+		Uniform1i,
+		Uniform3,
+		Uniform4,
+		UniformMatrix4,
+		DrawMesh,
+		DrawInstanced,
+		DrawIndirect
+	};
+}
+
+struct FRenderCommand
+{
+	ERenderCommand::Type Type;
+	union
+	{
+		struct
+		{
+			CShader* Shader;
+		} Program;
+
+		struct
+		{
+			EBlendMode::Type BlendMode;
+			EDepthMask::Type DepthMask;
+			EDepthTest::Type DepthTest;
+		} State;
+
+		struct
+		{
+			ETextureSlot Slot;
+			GLuint Handle;
+		} Texture;
+
+		// Values are stored in the buffer's value stream.
+		struct
+		{
+			GLint Location;
+			uint32_t Offset;
+		} Uniform;
+
+		// Integers are stored in the command itself.
+		struct
+		{
+			GLint Location;
+			GLint Value;
+		} Integer;
+
+		struct
+		{
+			CMesh* Mesh;
+			EDrawMode DrawMode;
+			uint32_t LevelOfDetail;
+			bool Prepare;
+		} Draw;
+
+		// Instance data and indirect commands are stored in the buffer's instance and command streams.
+		struct
+		{
+			CRenderable* Renderable;
+			uint32_t FirstInstance;
+			uint32_t Instances;
+			uint32_t FirstCommand;
+			uint32_t Commands;
+		} Batch;
+	};
+};
+
+// CPU-side list of state changes and draws.
+// Recording doesn't touch GL so buffers can be filled on worker threads, Execute replays them on the context thread.
+class CRenderCommandBuffer
+{
+public:
+	CRenderCommandBuffer();
+
+	void Reset();
+
+	void UseProgram( CShader* Shader );
+	void SetState( const EBlendMode::Type BlendMode, const EDepthMask::Type DepthMask, const EDepthTest::Type DepthTest );
+	void BindTexture( const ETextureSlot Slot, const GLuint Handle );
+	void BindTextureArray( const ETextureSlot Slot, const GLuint Handle );
+	void Uniform1i( const GLint Location, const GLint Value );
+	void Uniform3( const GLint Location, const float* Value );
+	void Uniform4( const GLint Location, const float* Value );
+	void UniformMatrix4( const GLint Location, const float* Value );
+	void DrawMesh( CMesh* Mesh, const EDrawMode DrawMode, const bool Prepare, const uint32_t LevelOfDetail );
+
+	// Gathers the transforms, colors and texture layers of the given range as instance data.
+	void DrawInstanced( const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count );
+
+	// Same as DrawInstanced but also builds the indirect commands, adjacent renderables with the same mesh and level of detail share a command.
+	void DrawIndirect( const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count );
+
+	// Replays the recorded commands, returns the number of draw calls that were issued.
+	uint32_t Execute();
+
+	size_t GetSize() const;
+
+	// Number of renderables that were recorded as part of an instanced or indirect batch.
+	uint32_t GetInstances() const;
+
+private:
+	void PushUniform( const ERenderCommand::Type Type, const GLint Location, const float* Value, const size_t Size );
+	uint32_t PushInstances( const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count );
+	void UploadInstances( const FRenderCommand& Command );
+
+	std::vector<FRenderCommand> Commands;
+	std::vector<float> Values;
+	std::vector<glm::mat4> InstanceTransforms;
+	std::vector<glm::vec4> InstanceColors;
+	std::vector<glm::vec4> InstanceLayers;
+	std::vector<FDrawElementsIndirectCommand> IndirectCommands;
+
+	uint32_t Instances;
+};
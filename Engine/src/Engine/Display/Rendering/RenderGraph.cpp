@@ -0,0 +1,257 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "RenderGraph.h"
+
+#include <Engine/Display/Rendering/RenderTexture.h>
+#include <Engine/Profiling/Profiling.h>
+
+// Pooled targets that go unused for this many frames are destroyed, this releases targets of stale viewport sizes.
+static const uint32_t MaximumUnusedFrames = 8;
+
+CRenderTargetPool::CRenderTargetPool()
+{
+	Frame = 0;
+}
+
+CRenderTargetPool::~CRenderTargetPool()
+{
+	Clear();
+}
+
+CRenderTexture* CRenderTargetPool::Acquire( const FRenderTargetDescription& Description )
+{
+	for( auto& Target : Targets )
+	{
+		if( !Target.InUse && Target.Description == Description )
+		{
+			Target.InUse = true;
+			Target.LastUsedFrame = Frame;
+			return Target.Texture;
+		}
+	}
+
+	FPooledRenderTarget Target;
+	Target.Texture = new CRenderTexture( "RenderTarget", Description.Width, Description.Height, Description.Format );
+	Target.Texture->Initialize();
+	Target.Description = Description;
+	Target.LastUsedFrame = Frame;
+	Target.InUse = true;
+	Targets.emplace_back( Target );
+
+	return Target.Texture;
+}
+
+void CRenderTargetPool::Release( CRenderTexture* Texture )
+{
+	for( auto& Target : Targets )
+	{
+		if( Target.Texture == Texture )
+		{
+			Target.InUse = false;
+			return;
+		}
+	}
+}
+
+void CRenderTargetPool::Trim( const uint32_t MaximumUnusedFrames )
+{
+	for( size_t Index = 0; Index < Targets.size(); )
+	{
+		FPooledRenderTarget& Target = Targets[Index];
+		if( !Target.InUse && ( Frame - Target.LastUsedFrame ) > MaximumUnusedFrames )
+		{
+			Target.Texture->Destroy();
+			delete Target.Texture;
+
+			Targets[Index] = Targets.back();
+			Targets.pop_back();
+		}
+		else
+		{
+			Index++;
+		}
+	}
+
+	Frame++;
+}
+
+void CRenderTargetPool::Clear()
+{
+	for( auto& Target : Targets )
+	{
+		Target.Texture->Destroy();
+		delete Target.Texture;
+	}
+
+	Targets.clear();
+}
+
+size_t CRenderTargetPool::GetCount() const
+{
+	return Targets.size();
+}
+
+CRenderGraph::CRenderGraph()
+{
+	CulledNodes = 0;
+}
+
+RenderTargetHandle_t CRenderGraph::Create( const std::string& Name, const FRenderTargetDescription& Description )
+{
+	FRenderGraphResource Resource;
+	Resource.Name = Name;
+	Resource.Description = Description;
+	Resource.Texture = nullptr;
+	Resource.Imported = false;
+	Resource.FirstUse = -1;
+	Resource.LastUse = -1;
+	Resources.emplace_back( Resource );
+
+	return static_cast<RenderTargetHandle_t>( Resources.size() - 1 );
+}
+
+RenderTargetHandle_t CRenderGraph::Import( const std::string& Name, CRenderTexture* Texture )
+{
+	FRenderGraphResource Resource;
+	Resource.Name = Name;
+	Resource.Description.Width = Texture->GetWidth();
+	Resource.Description.Height = Texture->GetHeight();
+	Resource.Description.Format = Texture->GetImageFormat();
+	Resource.Texture = Texture;
+	Resource.Imported = true;
+	Resource.FirstUse = -1;
+	Resource.LastUse = -1;
+	Resources.emplace_back( Resource );
+
+	return static_cast<RenderTargetHandle_t>( Resources.size() - 1 );
+}
+
+void CRenderGraph::AddNode( const std::string& Name, const std::vector<RenderTargetHandle_t>& Reads, const std::vector<RenderTargetHandle_t>& Writes, std::function<int64_t()> Execute )
+{
+	FRenderGraphNode Node;
+	Node.Name = Name;
+	Node.Reads = Reads;
+	Node.Writes = Writes;
+	Node.Execute = Execute;
+	Node.Live = false;
+	Nodes.emplace_back( Node );
+}
+
+CRenderTexture* CRenderGraph::GetTarget( const RenderTargetHandle_t Handle ) const
+{
+	if( Handle < 0 || Handle >= static_cast<RenderTargetHandle_t>( Resources.size() ) )
+		return nullptr;
+
+	return Resources[Handle].Texture;
+}
+
+int64_t CRenderGraph::Execute()
+{
+	// Walk the nodes back to front, a node is live when something that is presented or kept around depends on its output.
+	std::vector<bool> Needed( Resources.size(), false );
+	CulledNodes = 0;
+	for( auto Node = Nodes.rbegin(); Node != Nodes.rend(); ++Node )
+	{
+		Node->Live = Node->Writes.empty();
+		for( auto Write : Node->Writes )
+		{
+			if( Write == Backbuffer || Resources[Write].Imported || Needed[Write] )
+			{
+				Node->Live = true;
+			}
+		}
+
+		if( Node->Live )
+		{
+			for( auto Read : Node->Reads )
+			{
+				if( Read != Backbuffer )
+				{
+					Needed[Read] = true;
+				}
+			}
+		}
+		else
+		{
+			CulledNodes++;
+		}
+	}
+
+	// Determine the lifetime of every resource.
+	for( int32_t Index = 0; Index < static_cast<int32_t>( Nodes.size() ); Index++ )
+	{
+		if( !Nodes[Index].Live )
+			continue;
+
+		auto Touch = [&] ( const RenderTargetHandle_t Handle )
+		{
+			if( Handle == Backbuffer )
+				return;
+
+			FRenderGraphResource& Resource = Resources[Handle];
+			if( Resource.FirstUse < 0 )
+			{
+				Resource.FirstUse = Index;
+			}
+
+			Resource.LastUse = Index;
+		};
+
+		for( auto Read : Nodes[Index].Reads )
+		{
+			Touch( Read );
+		}
+
+		for( auto Write : Nodes[Index].Writes )
+		{
+			Touch( Write );
+		}
+	}
+
+	int64_t Result = 0;
+	for( int32_t Index = 0; Index < static_cast<int32_t>( Nodes.size() ); Index++ )
+	{
+		FRenderGraphNode& Node = Nodes[Index];
+		if( !Node.Live )
+			continue;
+
+		for( auto& Resource : Resources )
+		{
+			if( !Resource.Imported && Resource.FirstUse == Index )
+			{
+				Resource.Texture = Pool.Acquire( Resource.Description );
+			}
+		}
+
+		{
+			Profile( Node.Name.c_str() );
+			Result += Node.Execute();
+		}
+
+		// Targets are returned as soon as possible so that later resources of the same size and format can alias them.
+		for( auto& Resource : Resources )
+		{
+			if( !Resource.Imported && Resource.LastUse == Index )
+			{
+				Pool.Release( Resource.Texture );
+				Resource.Texture = nullptr;
+			}
+		}
+	}
+
+	Nodes.clear();
+	Resources.clear();
+
+	Pool.Trim( MaximumUnusedFrames );
+
+	return Result;
+}
+
+size_t CRenderGraph::GetCulledNodes() const
+{
+	return CulledNodes;
+}
+
+size_t CRenderGraph::GetPooledTargets() const
+{
+	return Pool.GetCount();
+}
@@ -0,0 +1,107 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <Engine/Display/Rendering/RenderHandles.h>
+#include <Engine/Display/Rendering/TextureEnumerators.h>
+
+class CRenderTexture;
+
+struct FRenderTargetDescription
+{
+	int Width;
+	int Height;
+	EImageFormat Format;
+
+	bool operator==( const FRenderTargetDescription& Other ) const
+	{
+		return Width == Other.Width && Height == Other.Height && Format == Other.Format;
+	}
+};
+
+struct FPooledRenderTarget
+{
+	CRenderTexture* Texture;
+	FRenderTargetDescription Description;
+	uint32_t LastUsedFrame;
+	bool InUse;
+};
+
+// Keeps render targets alive across frames so that transient targets of the same size and format can share memory.
+class CRenderTargetPool
+{
+public:
+	CRenderTargetPool();
+	~CRenderTargetPool();
+
+	CRenderTexture* Acquire( const FRenderTargetDescription& Description );
+	void Release( CRenderTexture* Texture );
+
+	// Destroys targets that haven't been acquired for the given amount of frames.
+	void Trim( const uint32_t MaximumUnusedFrames );
+	void Clear();
+
+	size_t GetCount() const;
+
+private:
+	std::vector<FPooledRenderTarget> Targets;
+	uint32_t Frame;
+};
+
+struct FRenderGraphResource
+{
+	std::string Name;
+	FRenderTargetDescription Description;
+	CRenderTexture* Texture;
+
+	// Imported resources are owned by the caller and are never culled or pooled.
+	bool Imported;
+
+	// Node indices of the first and last access, used to determine the lifetime of transient targets.
+	int32_t FirstUse;
+	int32_t LastUse;
+};
+
+struct FRenderGraphNode
+{
+	std::string Name;
+	std::vector<RenderTargetHandle_t> Reads;
+	std::vector<RenderTargetHandle_t> Writes;
+	std::function<int64_t()> Execute;
+	bool Live;
+};
+
+// Per-frame list of passes that declare which targets they read and write.
+// Passes that don't contribute to the backbuffer or an imported target are culled,
+// transient targets are acquired from the pool when they are first used and returned after their last use.
+class CRenderGraph
+{
+public:
+	CRenderGraph();
+
+	static const RenderTargetHandle_t Backbuffer = -1;
+
+	RenderTargetHandle_t Create( const std::string& Name, const FRenderTargetDescription& Description );
+	RenderTargetHandle_t Import( const std::string& Name, CRenderTexture* Texture );
+
+	void AddNode( const std::string& Name, const std::vector<RenderTargetHandle_t>& Reads, const std::vector<RenderTargetHandle_t>& Writes, std::function<int64_t()> Execute );
+
+	// Returns the texture that backs a resource while its node is executing, the backbuffer returns null.
+	CRenderTexture* GetTarget( const RenderTargetHandle_t Handle ) const;
+
+	// Compiles and runs the nodes in submission order, returns the sum of their results.
+	int64_t Execute();
+
+	size_t GetCulledNodes() const;
+	size_t GetPooledTargets() const;
+
+private:
+	std::vector<FRenderGraphResource> Resources;
+	std::vector<FRenderGraphNode> Nodes;
+	CRenderTargetPool Pool;
+
+	size_t CulledNodes;
+};
@@ -4,3 +4,4 @@
 #include <stdint.h>
 
 typedef int32_t RenderableHandle_t;
+typedef int32_t RenderTargetHandle_t;
@@ -2,29 +2,31 @@
 #include "RenderPass.h"
 
 #include <Engine/Display/Rendering/Camera.h>
+#include <Engine/Display/Rendering/GPUTimers.h>
 #include <Engine/Display/Rendering/Mesh.h>
 #include <Engine/Display/Rendering/Shader.h>
 #include <Engine/Display/Rendering/Texture.h>
 #include <Engine/Display/Rendering/RenderTexture.h>
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Display/Rendering/UniformBuffer.h>
 #include <Engine/Profiling/Profiling.h>
 #include <Engine/Utility/Math.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-GLuint ShaderProgramHandle = -1;
+#include <algorithm>
+#include <future>
+#include <thread>
 
-static const GLenum DepthTestToEnum[EDepthTest::Maximum]
-{
-	GL_NEVER,
-	GL_LESS,
-	GL_EQUAL,
-	GL_LEQUAL,
-	GL_GREATER,
-	GL_NOTEQUAL,
-	GL_GEQUAL,
-	GL_ALWAYS
-};
+static CUniformBuffer ViewUniformBuffer( EUniformBlock::View );
+
+// Lists are only split across worker threads when every slice gets at least this many renderables.
+static const size_t MinimumSliceSize = 512;
+
+// Command buffers are shared by all passes, passes are replayed one after another on the context thread.
+static std::vector<CRenderCommandBuffer> CommandBuffers;
+static std::vector<size_t> SliceOffsets;
 
 CRenderPass::CRenderPass( const std::string& Name, int Width, int Height, const CCamera& CameraIn, const bool AlwaysClearIn )
 {
@@ -33,6 +35,11 @@ CRenderPass::CRenderPass( const std::string& Name, int Width, int Height, const
 	Camera = CameraIn;
 	AlwaysClear = AlwaysClearIn;
 	Target = nullptr;
+	Calls = 0;
+	Instances = 0;
+	Instancing = true;
+	MultiDraw = true;
+	ParallelRecording = true;
 	BlendMode = EBlendMode::Opaque;
 	DepthMask = EDepthMask::Write;
 	DepthTest = EDepthTest::Less;
@@ -42,6 +49,7 @@ CRenderPass::CRenderPass( const std::string& Name, int Width, int Height, const
 uint32_t CRenderPass::RenderRenderable( CRenderable* Renderable )
 {
 	Profile( PassName.c_str() );
+	CGPUTimerScope GPUTimer( PassName );
 	Begin();
 
 	Draw( Renderable );
@@ -54,6 +62,7 @@ uint32_t CRenderPass::RenderRenderable( CRenderable* Renderable )
 uint32_t CRenderPass::RenderRenderable( CRenderable* Renderable, const std::unordered_map<std::string, Vector4D>& Uniforms )
 {
 	Profile( PassName.c_str() );
+	CGPUTimerScope GPUTimer( PassName );
 	Begin();
 
 	Setup( Renderable, Uniforms );
@@ -67,6 +76,7 @@ uint32_t CRenderPass::RenderRenderable( CRenderable* Renderable, const std::unor
 uint32_t CRenderPass::Render( const std::vector<CRenderable*>& Renderables )
 {
 	Profile( PassName.c_str() );
+	CGPUTimerScope GPUTimer( PassName );
 	Begin();
 
 	for( auto Renderable : Renderables )
@@ -82,12 +92,64 @@ uint32_t CRenderPass::Render( const std::vector<CRenderable*>& Renderables )
 uint32_t CRenderPass::Render( const std::vector<CRenderable*>& Renderables, const std::unordered_map<std::string, Vector4D>& Uniforms )
 {
 	Profile( PassName.c_str() );
+	CGPUTimerScope GPUTimer( PassName );
 	Begin();
 
-	for( auto Renderable : Renderables )
+	size_t Slices = 1;
+	if( ParallelRecording )
+	{
+		const size_t Workers = std::max( std::thread::hardware_concurrency(), 1u );
+		Slices = std::max( std::min( Workers, Renderables.size() / MinimumSliceSize ), size_t( 1 ) );
+	}
+
+	if( CommandBuffers.size() < Slices )
+	{
+		CommandBuffers.resize( Slices );
+	}
+
+	// Move the slice boundaries past runs that can be batched so that batches aren't split.
+	SliceOffsets.clear();
+	SliceOffsets.emplace_back( 0 );
+	for( size_t Slice = 1; Slice < Slices; Slice++ )
+	{
+		size_t Offset = std::max( Renderables.size() * Slice / Slices, SliceOffsets.back() );
+		while( Instancing && Offset > 0 && Offset < Renderables.size() && Renderables[Offset - 1]->CanMultiDraw( Renderables[Offset] ) )
+		{
+			Offset++;
+		}
+
+		SliceOffsets.emplace_back( Offset );
+	}
+
+	SliceOffsets.emplace_back( Renderables.size() );
+
 	{
-		Setup( Renderable, Uniforms );
-		Draw( Renderable);
+		Profile( "Record" );
+		std::vector<std::future<void>> Futures;
+		for( size_t Slice = 1; Slice < Slices; Slice++ )
+		{
+			Futures.emplace_back( std::async( std::launch::async, [&, Slice] ()
+			{
+				Record( CommandBuffers[Slice], Renderables, SliceOffsets[Slice], SliceOffsets[Slice + 1] - SliceOffsets[Slice], Uniforms );
+				CShader::SubmitUniformLookups();
+			} ) );
+		}
+
+		Record( CommandBuffers[0], Renderables, SliceOffsets[0], SliceOffsets[1] - SliceOffsets[0], Uniforms );
+
+		for( auto& Future : Futures )
+		{
+			Future.get();
+		}
+	}
+
+	{
+		Profile( "Replay" );
+		for( size_t Slice = 0; Slice < Slices; Slice++ )
+		{
+			Calls += CommandBuffers[Slice].Execute();
+			Instances += CommandBuffers[Slice].GetInstances();
+		}
 	}
 
 	End();
@@ -115,10 +177,24 @@ void CRenderPass::Clear()
 void CRenderPass::Begin()
 {
 	Calls = 0;
+	Instances = 0;
 	glViewport( 0, 0, ViewportWidth, ViewportHeight );
 
-	// Reset the render data.
-	PreviousRenderData = FRenderDataInstanced();
+	// Reset the recording state.
+	ImmediateState = FRenderRecordState();
+
+	// Shaders that declare the ViewData block read the camera from here instead of loose uniforms.
+	{
+		const FCameraSetup& CameraSetup = Camera.GetCameraSetup();
+
+		FViewData ViewData;
+		ViewData.View = Camera.GetViewMatrix();
+		ViewData.Projection = Camera.GetProjectionMatrix();
+		ViewData.CameraPosition = glm::vec4( Math::ToGLM( CameraSetup.CameraPosition ), 1.0f );
+		ViewData.CameraDirection = glm::vec4( Math::ToGLM( CameraSetup.CameraDirection ), 0.0f );
+		ViewData.Viewport = glm::vec4( ViewportWidth, ViewportHeight, 1.0f / ViewportWidth, 1.0f / ViewportHeight );
+		ViewUniformBuffer.Upload( ViewData );
+	}
 
 	if( Target )
 	{
@@ -140,16 +216,18 @@ void CRenderPass::Begin()
 		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
 	}
 
-	glDepthMask( DepthMask == EDepthMask::Write ? GL_TRUE : GL_FALSE );
-	glDepthFunc( DepthTestToEnum[DepthTest] );
+	CStateCache& StateCache = CStateCache::Get();
+	StateCache.SetBlendMode( BlendMode );
+	StateCache.SetDepthMask( DepthMask );
+	StateCache.SetDepthTest( DepthTest );
 }
 
 void CRenderPass::End()
 {
-	glDisable( GL_BLEND );
-
-	glDepthMask( GL_TRUE );
-	glDepthFunc( GL_LESS );
+	CStateCache& StateCache = CStateCache::Get();
+	StateCache.SetBlendMode( EBlendMode::Opaque );
+	StateCache.SetDepthMask( EDepthMask::Write );
+	StateCache.SetDepthTest( EDepthTest::Less );
 
 	if( Target && Target->Ready() )
 	{
@@ -159,163 +237,240 @@ void CRenderPass::End()
 
 void CRenderPass::Setup( CRenderable* Renderable, const std::unordered_map<std::string, Vector4D>& Uniforms )
 {
-	FRenderDataInstanced& RenderData = Renderable->GetRenderData();
+	ImmediateCommands.Reset();
+	RecordSetup( ImmediateCommands, ImmediateState, Renderable, Uniforms );
+	ImmediateCommands.Execute();
+}
 
-	CShader* Shader = Renderable->GetShader();
-	if( Shader )
+void CRenderPass::Draw( CRenderable* Renderable )
+{
+	ImmediateCommands.Reset();
+	RecordDraw( ImmediateCommands, ImmediateState, Renderable );
+	Calls += ImmediateCommands.Execute();
+}
+
+void CRenderPass::SetCamera( const CCamera& CameraIn )
+{
+	Camera = CameraIn;
+}
+
+void CRenderPass::Record( CRenderCommandBuffer& Buffer, const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count, const std::unordered_map<std::string, Vector4D>& Uniforms ) const
+{
+	Buffer.Reset();
+
+	FRenderRecordState State;
+	for( size_t Index = Offset; Index < Offset + Count; )
 	{
-		const FProgramHandles& Handles = Shader->GetHandles();
-		if( Handles.Program != ShaderProgramHandle )
+		CRenderable* Renderable = Renderables[Index];
+		size_t Run = 1;
+
+		// Renderables are sorted by state so identical ones are already adjacent.
+		bool Indirect = false;
+		CShader* Shader = Renderable->GetShader();
+		if( Instancing && Shader && Shader->GetInstancedVariant() )
 		{
-			ShaderProgramHandle = Shader->Activate();
-		}
+			CMesh* Mesh = Renderable->GetMesh();
+			Indirect = MultiDraw && Mesh && Mesh->GetAllocation().Page;
+
+			while( Index + Run < Offset + Count )
+			{
+				CRenderable* Next = Renderables[Index + Run];
+				if( Indirect ? !Renderable->CanMultiDraw( Next ) : !Renderable->CanInstance( Next ) )
+					break;
 
-		RenderData.ShaderProgram = ShaderProgramHandle;
+				Run++;
+			}
+		}
 
-		for( auto& UniformBuffer : Uniforms )
+		if( Run > 1 )
 		{
-			const GLint UniformBufferLocation = glGetUniformLocation( RenderData.ShaderProgram, UniformBuffer.first.c_str() );
-			if( UniformBufferLocation > -1 )
+			CShader* InstancedShader = Shader->GetInstancedVariant();
+			RecordBatch( Buffer, State, InstancedShader, Uniforms );
+
+			if( Indirect )
+			{
+				// The batch can span several meshes, so it gets the union of their bounds.
+				FBounds Bounds = Renderable->GetMesh()->GetBounds();
+				for( size_t Batched = Index + 1; Batched < Index + Run; Batched++ )
+				{
+					const FBounds& MeshBounds = Renderables[Batched]->GetMesh()->GetBounds();
+					for( int Axis = 0; Axis < 3; Axis++ )
+					{
+						Bounds.Minimum[Axis] = std::min( Bounds.Minimum[Axis], MeshBounds.Minimum[Axis] );
+						Bounds.Maximum[Axis] = std::max( Bounds.Maximum[Axis], MeshBounds.Maximum[Axis] );
+					}
+				}
+
+				// Arena meshes always have full vertices, don't leave the format of an earlier compact mesh behind.
+				RecordBounds( Buffer, InstancedShader, Bounds, EVertexFormat::Full );
+				Buffer.DrawIndirect( Renderables, Index, Run );
+			}
+			else
 			{
-				glUniform4fv( UniformBufferLocation, 1, UniformBuffer.second.Base() );
+				CMesh* Mesh = Renderable->GetMesh();
+				RecordBounds( Buffer, InstancedShader, Mesh->GetBounds(), Mesh->GetVertexFormat() );
+				Buffer.DrawInstanced( Renderables, Index, Run );
 			}
+
+			// Batches always bind their vertex array.
+			const FRenderDataInstanced& RenderData = Renderable->GetRenderData();
+			State.VertexBufferObject = RenderData.VertexBufferObject;
+			State.IndexBufferObject = RenderData.IndexBufferObject;
+		}
+		else
+		{
+			RecordSetup( Buffer, State, Renderable, Uniforms );
+			RecordDraw( Buffer, State, Renderable );
 		}
+
+		Index += Run;
 	}
 }
 
-void CRenderPass::Draw( CRenderable* Renderable )
+void CRenderPass::RecordSetup( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CRenderable* Renderable, const std::unordered_map<std::string, Vector4D>& Uniforms ) const
 {
 	CShader* Shader = Renderable->GetShader();
 	if( Shader )
 	{
-		ConfigureBlendMode( Shader );
-		ConfigureDepthMask( Shader );
-		ConfigureDepthTest( Shader );
-
-		FRenderDataInstanced& RenderData = Renderable->GetRenderData();
-
-		const FProgramHandles& Handles = Shader->GetHandles();
-		if( Handles.Program != ShaderProgramHandle )
-		{
-			ShaderProgramHandle = Shader->Activate();
-		}
-
-		RenderData.ShaderProgram = ShaderProgramHandle;
-
-		const FCameraSetup& CameraSetup = Camera.GetCameraSetup();
-		const glm::mat4& ViewMatrix = Camera.GetViewMatrix();
-		const glm::mat4& ProjectionMatrix = Camera.GetProjectionMatrix();
-
-		const GLint ViewMatrixLocation = glGetUniformLocation( RenderData.ShaderProgram, "View" );
-		if( ViewMatrixLocation > -1 )
-		{
-			glUniformMatrix4fv( ViewMatrixLocation, 1, GL_FALSE, &ViewMatrix[0][0] );
-		}
-
-		const GLint ProjectionMatrixLocation = glGetUniformLocation( RenderData.ShaderProgram, "Projection" );
-		if( ProjectionMatrixLocation > -1 )
-		{
-			glUniformMatrix4fv( ProjectionMatrixLocation, 1, GL_FALSE, &ProjectionMatrix[0][0] );
-		}
+		RecordProgram( Buffer, State, Shader );
+		RecordUniforms( Buffer, State, Shader, Uniforms );
+	}
+}
 
-		const GLint CameraPositionLocation = glGetUniformLocation( RenderData.ShaderProgram, "CameraPosition" );
-		if( CameraPositionLocation > -1 )
-		{
-			glUniform3fv( CameraPositionLocation, 1, CameraSetup.CameraPosition.Base() );
-		}
+void CRenderPass::RecordDraw( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CRenderable* Renderable ) const
+{
+	CShader* Shader = Renderable->GetShader();
+	if( Shader )
+	{
+		Buffer.SetState( Shader->GetBlendMode(), Shader->GetDepthMask(), Shader->GetDepthTest() );
 
-		const GLint CameraDirectionLocation = glGetUniformLocation( RenderData.ShaderProgram, "CameraDirection" );
-		if( CameraDirectionLocation > -1 )
-		{
-			glUniform3fv( CameraDirectionLocation, 1, CameraSetup.CameraDirection.Base() );
-		}
+		RecordProgram( Buffer, State, Shader );
+		RecordCamera( Buffer, State, Shader );
 
-		const GLint ObjectPositionLocation = glGetUniformLocation( RenderData.ShaderProgram, "ObjectPosition" );
+		const FRenderDataInstanced& RenderData = Renderable->GetRenderData();
+		const GLint ObjectPositionLocation = Shader->GetUniformLocation( EUniform::ObjectPosition );
 		if( ObjectPositionLocation > -1 )
 		{
-			glUniform3fv( ObjectPositionLocation, 1, RenderData.Transform.GetPosition().Base() );
+			Buffer.Uniform3( ObjectPositionLocation, RenderData.Transform.GetPosition().Base() );
 		}
 
 		CMesh* Mesh = Renderable->GetMesh();
 		if( Mesh )
 		{
-			auto& AABB = Mesh->GetBounds();
-			const GLint ObjectBoundsMinimumLocation = glGetUniformLocation( RenderData.ShaderProgram, "ObjectBoundsMinimum" );
-			if( ObjectBoundsMinimumLocation > -1 )
-			{
-				glUniform3fv( ObjectBoundsMinimumLocation, 1, AABB.Minimum.Base() );
-			}
-
-			const GLint ObjectBoundsMaximumLocation = glGetUniformLocation( RenderData.ShaderProgram, "ObjectBoundsMaximum" );
-			if( ObjectBoundsMaximumLocation > -1 )
-			{
-				glUniform3fv( ObjectBoundsMaximumLocation, 1, AABB.Maximum.Base() );
-			}
-		}
-
-		// Viewport coordinates
-		{
-			const glm::vec4 Viewport = glm::vec4( ViewportWidth, ViewportHeight, 1.0f / ViewportWidth, 1.0f / ViewportHeight );
-			const GLint ViewportLocation = glGetUniformLocation( RenderData.ShaderProgram, "Viewport" );
-			if( ViewportLocation > -1 )
-			{
-				glUniform4fv( ViewportLocation, 1, glm::value_ptr( Viewport ) );
-			}
+			RecordBounds( Buffer, Shader, Mesh->GetBounds(), Mesh->GetVertexFormat() );
 		}
 
-		Renderable->Draw( RenderData, PreviousRenderData );
-		PreviousRenderData = RenderData;
+		const bool PrepareBuffers = State.VertexBufferObject != RenderData.VertexBufferObject || State.IndexBufferObject != RenderData.IndexBufferObject;
+		Renderable->Record( Buffer, PrepareBuffers );
 
-		Calls++;
+		State.VertexBufferObject = RenderData.VertexBufferObject;
+		State.IndexBufferObject = RenderData.IndexBufferObject;
 	}
 }
 
-void CRenderPass::SetCamera( const CCamera& CameraIn )
+void CRenderPass::RecordBatch( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader, const std::unordered_map<std::string, Vector4D>& Uniforms ) const
 {
-	Camera = CameraIn;
+	Buffer.SetState( Shader->GetBlendMode(), Shader->GetDepthMask(), Shader->GetDepthTest() );
+
+	RecordProgram( Buffer, State, Shader );
+	RecordUniforms( Buffer, State, Shader, Uniforms );
+	RecordCamera( Buffer, State, Shader );
 }
 
-void CRenderPass::ConfigureBlendMode( CShader* Shader )
+void CRenderPass::RecordProgram( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader ) const
 {
-	auto NextBlendMode = Shader->GetBlendMode();
-	if( NextBlendMode != BlendMode )
+	const GLuint Program = Shader->GetHandles().Program;
+	if( Program == State.Program )
+		return;
+
+	State.Program = Program;
+	Buffer.UseProgram( Shader );
+}
+
+void CRenderPass::RecordUniforms( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader, const std::unordered_map<std::string, Vector4D>& Uniforms ) const
+{
+	// Uniform values are stored per program so they only have to be set when the program changes.
+	const GLuint Program = Shader->GetHandles().Program;
+	if( Program == State.UniformsProgram )
+		return;
+
+	State.UniformsProgram = Program;
+
+	for( auto& UniformBuffer : Uniforms )
 	{
-		if( NextBlendMode == EBlendMode::Opaque )
-		{
-			glDisable( GL_BLEND );
-		}
-		else if( NextBlendMode == EBlendMode::Alpha )
+		const GLint UniformBufferLocation = Shader->GetUniformLocation( UniformBuffer.first );
+		if( UniformBufferLocation > -1 )
 		{
-			glEnable( GL_BLEND );
-			glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+			Buffer.Uniform4( UniformBufferLocation, UniformBuffer.second.Base() );
 		}
-		else if( NextBlendMode == EBlendMode::Additive )
-		{
-			glEnable( GL_BLEND );
-			glBlendFunc( GL_ONE, GL_ONE );
-		}
-
-		BlendMode = NextBlendMode;
 	}
 }
 
-void CRenderPass::ConfigureDepthMask( CShader* Shader )
+void CRenderPass::RecordCamera( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader ) const
 {
-	auto NextDepthMask = Shader->GetDepthMask();
-	if( NextDepthMask != DepthMask )
+	const GLuint Program = Shader->GetHandles().Program;
+	if( Program == State.CameraProgram )
+		return;
+
+	State.CameraProgram = Program;
+
+	const FCameraSetup& CameraSetup = Camera.GetCameraSetup();
+	const glm::mat4& ViewMatrix = Camera.GetViewMatrix();
+	const glm::mat4& ProjectionMatrix = Camera.GetProjectionMatrix();
+
+	const GLint ViewMatrixLocation = Shader->GetUniformLocation( EUniform::View );
+	if( ViewMatrixLocation > -1 )
+	{
+		Buffer.UniformMatrix4( ViewMatrixLocation, &ViewMatrix[0][0] );
+	}
+
+	const GLint ProjectionMatrixLocation = Shader->GetUniformLocation( EUniform::Projection );
+	if( ProjectionMatrixLocation > -1 )
 	{
-		glDepthMask( NextDepthMask == EDepthMask::Write ? GL_TRUE : GL_FALSE );
-		DepthMask = NextDepthMask;
+		Buffer.UniformMatrix4( ProjectionMatrixLocation, &ProjectionMatrix[0][0] );
+	}
+
+	const GLint CameraPositionLocation = Shader->GetUniformLocation( EUniform::CameraPosition );
+	if( CameraPositionLocation > -1 )
+	{
+		Buffer.Uniform3( CameraPositionLocation, CameraSetup.CameraPosition.Base() );
+	}
+
+	const GLint CameraDirectionLocation = Shader->GetUniformLocation( EUniform::CameraDirection );
+	if( CameraDirectionLocation > -1 )
+	{
+		Buffer.Uniform3( CameraDirectionLocation, CameraSetup.CameraDirection.Base() );
+	}
+
+	// Viewport coordinates
+	{
+		const glm::vec4 Viewport = glm::vec4( ViewportWidth, ViewportHeight, 1.0f / ViewportWidth, 1.0f / ViewportHeight );
+		const GLint ViewportLocation = Shader->GetUniformLocation( EUniform::Viewport );
+		if( ViewportLocation > -1 )
+		{
+			Buffer.Uniform4( ViewportLocation, glm::value_ptr( Viewport ) );
+		}
 	}
 }
 
-void CRenderPass::ConfigureDepthTest( CShader* Shader )
+void CRenderPass::RecordBounds( CRenderCommandBuffer& Buffer, CShader* Shader, const FBounds& AABB, const EVertexFormat::Type VertexFormat ) const
 {
-	auto NextDepthTest = Shader->GetDepthTest();
-	if( NextDepthTest != DepthTest )
+	const GLint ObjectBoundsMinimumLocation = Shader->GetUniformLocation( EUniform::ObjectBoundsMinimum );
+	if( ObjectBoundsMinimumLocation > -1 )
+	{
+		Buffer.Uniform3( ObjectBoundsMinimumLocation, AABB.Minimum.Base() );
+	}
+
+	const GLint ObjectBoundsMaximumLocation = Shader->GetUniformLocation( EUniform::ObjectBoundsMaximum );
+	if( ObjectBoundsMaximumLocation > -1 )
 	{
-		glDepthFunc( DepthTestToEnum[NextDepthTest] );
+		Buffer.Uniform3( ObjectBoundsMaximumLocation, AABB.Maximum.Base() );
+	}
 
-		DepthTest = NextDepthTest;
+	// Compact positions are decoded against the bounds above, so both are set per mesh.
+	const GLint VertexFormatLocation = Shader->GetUniformLocation( EUniform::VertexFormat );
+	if( VertexFormatLocation > -1 )
+	{
+		Buffer.Uniform1i( VertexFormatLocation, static_cast<GLint>( VertexFormat ) );
 	}
 }
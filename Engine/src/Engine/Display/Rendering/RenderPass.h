@@ -6,6 +6,7 @@
 
 #include <Engine/Display/Rendering/Camera.h>
 #include <Engine/Display/Rendering/Renderable.h>
+#include <Engine/Display/Rendering/RenderCommandBuffer.h>
 
 #include <Engine/Display/Rendering/Shader.h>
 
@@ -13,6 +14,16 @@
 
 class CRenderTexture;
 
+// Tracks what a command buffer has already recorded so redundant uniforms and buffer bindings can be skipped.
+struct FRenderRecordState
+{
+	GLuint Program = 0;
+	GLuint UniformsProgram = 0;
+	GLuint CameraProgram = 0;
+	GLuint VertexBufferObject = 0;
+	GLuint IndexBufferObject = 0;
+};
+
 class CRenderPass
 {
 public:
@@ -36,23 +47,48 @@ public:
 
 	CRenderTexture* Target;
 	CCamera Camera;
-	FRenderDataInstanced PreviousRenderData;
 
 	int ViewportWidth;
 	int ViewportHeight;
 
 	uint32_t Calls;
 
+	// Number of renderables that were drawn as part of an instanced or indirect batch.
+	uint32_t Instances;
+
 	bool AlwaysClear;
 
+	// Collapse runs of renderables that share mesh, shader and textures into instanced draws.
+	bool Instancing;
+
+	// Collapse runs of geometry arena meshes that share shader and textures into a single indirect draw.
+	bool MultiDraw;
+
+	// Record slices of large renderable lists into command buffers on worker threads.
+	bool ParallelRecording;
+
+	// State the pass starts out with, shaders can override it per draw.
 	EBlendMode::Type BlendMode;
 	EDepthMask::Type DepthMask;
 	EDepthTest::Type DepthTest;
 
 private:
-	void ConfigureBlendMode( CShader* Shader );
-	void ConfigureDepthMask( CShader* Shader );
-	void ConfigureDepthTest( CShader* Shader );
+	// Recording only reads pass and renderable data so it can run on any thread.
+	void Record( CRenderCommandBuffer& Buffer, const std::vector<CRenderable*>& Renderables, const size_t Offset, const size_t Count, const std::unordered_map<std::string, Vector4D>& Uniforms ) const;
+	void RecordSetup( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CRenderable* Renderable, const std::unordered_map<std::string, Vector4D>& Uniforms ) const;
+	void RecordDraw( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CRenderable* Renderable ) const;
+
+	// Applies a batch shader's render state and shared uniforms.
+	void RecordBatch( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader, const std::unordered_map<std::string, Vector4D>& Uniforms ) const;
+
+	void RecordProgram( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader ) const;
+	void RecordUniforms( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader, const std::unordered_map<std::string, Vector4D>& Uniforms ) const;
+	void RecordCamera( CRenderCommandBuffer& Buffer, FRenderRecordState& State, CShader* Shader ) const;
+	void RecordBounds( CRenderCommandBuffer& Buffer, CShader* Shader, const FBounds& Bounds, const EVertexFormat::Type VertexFormat ) const;
 
 	std::string PassName;
+
+	// Used by Setup and Draw, which record and replay a single renderable at a time.
+	CRenderCommandBuffer ImmediateCommands;
+	FRenderRecordState ImmediateState;
 };
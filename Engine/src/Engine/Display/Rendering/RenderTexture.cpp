@@ -1,6 +1,7 @@
 // Copyright  2017, Christiaan Bakker, All rights reserved.
 #include "RenderTexture.h"
 
+#include <Engine/Display/Rendering/StateCache.h>
 #include <Engine/Profiling/Logging.h>
 #include <Engine/Utility/Data.h>
 #include <Engine/Utility/File.h>
@@ -9,14 +10,20 @@ CRenderTexture::CRenderTexture() : CTexture()
 {
 	Width = -1;
 	Height = -1;
+	Format = EImageFormat::RGB16F;
+
+	FramebufferHandle = 0;
+	DepthHandle = 0;
+
 	Initialized = false;
 }
 
-CRenderTexture::CRenderTexture( const std::string& Name, int TextureWidth, int TextureHeight ) : CTexture()
+CRenderTexture::CRenderTexture( const std::string& Name, int TextureWidth, int TextureHeight, const EImageFormat FormatIn ) : CTexture()
 {
 	this->Name = Name;
 	Width = TextureWidth;
 	Height = TextureHeight;
+	Format = FormatIn;
 
 	FramebufferHandle = 0;
 	DepthHandle = 0;
@@ -40,9 +47,29 @@ void CRenderTexture::Initialize()
 	glBindFramebuffer( GL_FRAMEBUFFER, FramebufferHandle );
 
 	glGenTextures( 1, &Handle );
-	glBindTexture( GL_TEXTURE_2D, Handle );
+	CStateCache::Get().BindTexture( Handle );
+
+	GLenum InternalFormat = GL_RGB16F;
+	GLenum PixelFormat = GL_RGB;
+	GLenum Type = GL_FLOAT;
+	if( Format == EImageFormat::RGBA16F )
+	{
+		InternalFormat = GL_RGBA16F;
+		PixelFormat = GL_RGBA;
+	}
+	else if( Format == EImageFormat::RGBA8 )
+	{
+		InternalFormat = GL_RGBA8;
+		PixelFormat = GL_RGBA;
+		Type = GL_UNSIGNED_BYTE;
+	}
+	else if( Format == EImageFormat::R32F )
+	{
+		InternalFormat = GL_R32F;
+		PixelFormat = GL_RED;
+	}
 
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB16F, Width, Height, 0, GL_RGB, GL_FLOAT, 0 );
+	glTexImage2D( GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, PixelFormat, Type, 0 );
 
 	// Wrapping parameters
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
@@ -58,7 +85,7 @@ void CRenderTexture::Initialize()
 	glDrawBuffers( 1, DrawBuffers );
 
 	glGenTextures( 1, &DepthHandle );
-	glBindTexture( GL_TEXTURE_2D, DepthHandle );
+	CStateCache::Get().BindTexture( DepthHandle );
 
 	glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, Width, Height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0 );
 
@@ -84,6 +111,31 @@ void CRenderTexture::Initialize()
 	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
 }
 
+void CRenderTexture::Destroy()
+{
+	if( Handle != 0 )
+	{
+		CStateCache::Get().ReleaseTexture( Handle );
+		glDeleteTextures( 1, &Handle );
+		Handle = 0;
+	}
+
+	if( DepthHandle != 0 )
+	{
+		CStateCache::Get().ReleaseTexture( DepthHandle );
+		glDeleteTextures( 1, &DepthHandle );
+		DepthHandle = 0;
+	}
+
+	if( FramebufferHandle != 0 )
+	{
+		glDeleteFramebuffers( 1, &FramebufferHandle );
+		FramebufferHandle = 0;
+	}
+
+	Initialized = false;
+}
+
 void CRenderTexture::Push()
 {
 	glViewport( 0, 0, (GLsizei) Width, (GLsizei) Height );
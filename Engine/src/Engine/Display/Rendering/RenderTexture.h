@@ -14,10 +14,11 @@ class CRenderTexture : public CTexture
 {
 public:
 	CRenderTexture();
-	CRenderTexture( const std::string& Name, int TextureWidth, int TextureHeight );
+	CRenderTexture( const std::string& Name, int TextureWidth, int TextureHeight, const EImageFormat Format = EImageFormat::RGB16F );
 	~CRenderTexture();
 
 	void Initialize();
+	void Destroy();
 	void Push();
 	void Pop();
 
@@ -28,11 +29,5 @@ private:
 	GLuint DepthHandle;
 	FName Name;
 
-	int Width;
-	int Height;
-	int Channels;
-
-	unsigned char* ImageData;
-
 	bool Initialized;
 };
@@ -1,16 +1,49 @@
 // Copyright � 2017, Christiaan Bakker, All rights reserved.
 #include "Renderable.h"
 
+#include <Engine/Display/Rendering/RenderCommandBuffer.h>
 #include <Engine/Display/Rendering/Shader.h>
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Display/Rendering/TextureArray.h>
 #include <Engine/Profiling/Logging.h>
 
 #include <glm/gtc/type_ptr.hpp>
 
+namespace ESortKey
+{
+	// Bit widths of the sort key fields.
+	enum Type
+	{
+		Layer = 2,
+		Program = 12,
+		TextureSet = 12,
+		Mesh = 14,
+		Depth = 24
+	};
+}
+
+static const uint64_t DepthRange = ( uint64_t( 1 ) << ESortKey::Depth ) - 1;
+
+// Slots whose layer is passed through the TextureLayers uniform, array slots past these sample the first layer.
+static const uint32_t LayerSlots = 4;
+
+static uint64_t KeyField( const uint64_t Value, const uint32_t Bits )
+{
+	return Value & ( ( uint64_t( 1 ) << Bits ) - 1 );
+}
+
 CRenderable::CRenderable()
 {
 	Mesh = nullptr;
 	Shader = nullptr;
 	memset( Textures, 0, 32 * sizeof( CTexture* ) );
+
+	TextureMask = 0;
+	TextureSet = 0;
+	TextureGeneration = 0;
+	SortKey = 0;
+
+	Occluder = false;
 }
 
 CRenderable::~CRenderable()
@@ -36,11 +69,22 @@ void CRenderable::SetMesh( CMesh* Mesh )
 	}
 }
 
-CShader* CRenderable::GetShader()
+// Renderables whose shader is still compiling draw with the placeholder.
+static CShader* GetReadyShader( CShader* Shader )
 {
+	if( Shader && !Shader->IsReady() && CShader::GetPlaceholder() )
+	{
+		return CShader::GetPlaceholder();
+	}
+
 	return Shader;
 }
 
+CShader* CRenderable::GetShader()
+{
+	return GetReadyShader( Shader );
+}
+
 void CRenderable::SetShader( CShader* Shader )
 {
 	if( Shader )
@@ -69,22 +113,32 @@ void CRenderable::SetTexture( CTexture* Texture, ETextureSlot Slot )
 	{
 		const auto Index = static_cast<ETextureSlotType>( Slot );
 		this->Textures[Index] = Texture;
+		TextureMask |= 1u << Index;
+
+		UpdateTextureSet();
 	}
 }
 
 void CRenderable::Draw( FRenderData& RenderData, const FRenderData& PreviousRenderData, EDrawMode DrawModeOverride )
 {
-	if( Mesh )
+	CShader* ReadyShader = GetReadyShader( Shader );
+	if( Mesh && ReadyShader )
 	{
 		const EDrawMode DrawMode = DrawModeOverride != None ? DrawModeOverride : RenderData.DrawMode;
-		Prepare( RenderData );
+		Prepare( ReadyShader );
 
-		const glm::mat4 ModelMatrix = RenderData.Transform.GetTransformationMatrix();
-		GLuint ModelMatrixLocation = glGetUniformLocation( RenderData.ShaderProgram, "Model" );
-		glUniformMatrix4fv( ModelMatrixLocation, 1, GL_FALSE, &ModelMatrix[0][0] );
+		const GLint ModelMatrixLocation = ReadyShader->GetUniformLocation( EUniform::Model );
+		if( ModelMatrixLocation > -1 )
+		{
+			const glm::mat4& ModelMatrix = RenderData.Transform.GetTransformationMatrix();
+			glUniformMatrix4fv( ModelMatrixLocation, 1, GL_FALSE, &ModelMatrix[0][0] );
+		}
 
-		GLuint ColorLocation = glGetUniformLocation( RenderData.ShaderProgram, "ObjectColor" );
-		glUniform4fv( ColorLocation, 1, glm::value_ptr( RenderData.Color ) );
+		const GLint ColorLocation = ReadyShader->GetUniformLocation( EUniform::ObjectColor );
+		if( ColorLocation > -1 )
+		{
+			glUniform4fv( ColorLocation, 1, glm::value_ptr( RenderData.Color ) );
+		}
 
 		const FVertexBufferData& Data = Mesh->GetVertexBufferData();
 		const bool BindBuffers = PreviousRenderData.VertexBufferObject != Data.VertexBufferObject || PreviousRenderData.IndexBufferObject != Data.IndexBufferObject;
@@ -93,8 +147,145 @@ void CRenderable::Draw( FRenderData& RenderData, const FRenderData& PreviousRend
 			Mesh->Prepare( DrawMode );
 		}
 
-		Mesh->Draw( DrawMode );
+		Mesh->Draw( DrawMode, RenderData.LevelOfDetail );
+	}
+}
+
+void CRenderable::Record( CRenderCommandBuffer& Buffer, const bool PrepareBuffers, EDrawMode DrawModeOverride )
+{
+	CShader* ReadyShader = GetReadyShader( Shader );
+	if( Mesh && ReadyShader )
+	{
+		const EDrawMode DrawMode = DrawModeOverride != None ? DrawModeOverride : RenderData.DrawMode;
+		const uint32_t TextureArrays = ReadyShader->GetTextureArrays();
+		glm::vec4 Layers( 0.0f );
+
+		// Stop at the highest slot that has a texture.
+		uint32_t Mask = TextureMask;
+		for( uint32_t Index = 0; Mask; Index++, Mask >>= 1 )
+		{
+			CTexture* Texture = Textures[Index];
+			if( !( Mask & 1 ) || !Texture->GetHandle() )
+				continue;
+
+			CTextureArray* Page = Texture->GetPage();
+			if( Page && ( TextureArrays & ( 1u << Index ) ) )
+			{
+				Buffer.BindTextureArray( static_cast<ETextureSlot>( Index ), Page->GetHandle() );
+				if( Index < LayerSlots )
+				{
+					Layers[Index] = static_cast<float>( Texture->GetLayer() );
+				}
+			}
+			else
+			{
+				Buffer.BindTexture( static_cast<ETextureSlot>( Index ), Texture->GetHandle() );
+			}
+		}
+
+		const GLint LayersLocation = ReadyShader->GetUniformLocation( EUniform::TextureLayers );
+		if( TextureArrays && LayersLocation > -1 )
+		{
+			Buffer.Uniform4( LayersLocation, glm::value_ptr( Layers ) );
+		}
+
+		const GLint ModelMatrixLocation = ReadyShader->GetUniformLocation( EUniform::Model );
+		if( ModelMatrixLocation > -1 )
+		{
+			const glm::mat4& ModelMatrix = RenderData.Transform.GetTransformationMatrix();
+			Buffer.UniformMatrix4( ModelMatrixLocation, &ModelMatrix[0][0] );
+		}
+
+		const GLint ColorLocation = ReadyShader->GetUniformLocation( EUniform::ObjectColor );
+		if( ColorLocation > -1 )
+		{
+			Buffer.Uniform4( ColorLocation, glm::value_ptr( RenderData.Color ) );
+		}
+
+		Buffer.DrawMesh( Mesh, DrawMode, PrepareBuffers, RenderData.LevelOfDetail );
+	}
+}
+
+void CRenderable::DrawInstanced( FRenderDataInstanced& RenderData, GLsizei Instances, EDrawMode DrawModeOverride )
+{
+	if( Mesh && Shader )
+	{
+		// Replay has to bind textures for the same program the batch was recorded with.
+		const EDrawMode DrawMode = DrawModeOverride != None ? DrawModeOverride : RenderData.DrawMode;
+		CShader* ReadyShader = GetReadyShader( Shader );
+		CShader* InstancedShader = ReadyShader->GetInstancedVariant();
+		Prepare( InstancedShader ? InstancedShader : ReadyShader );
+
+		// The instance streams are stored in the vertex array object so it always has to be bound.
+		Mesh->Prepare( DrawMode );
+		Mesh->PrepareInstances( RenderData.PositionBufferObject, RenderData.ColorBufferObject, RenderData.LayerBufferObject );
+		Mesh->DrawInstanced( Instances, DrawMode, RenderData.LevelOfDetail );
+	}
+}
+
+void CRenderable::DrawIndirect( FRenderDataInstanced& RenderData, GLsizei Commands, EDrawMode DrawModeOverride )
+{
+	if( Mesh && Shader )
+	{
+		const EDrawMode DrawMode = DrawModeOverride != None ? DrawModeOverride : RenderData.DrawMode;
+		CShader* ReadyShader = GetReadyShader( Shader );
+		CShader* InstancedShader = ReadyShader->GetInstancedVariant();
+		Prepare( InstancedShader ? InstancedShader : ReadyShader );
+
+		Mesh->Prepare( DrawMode );
+		Mesh->PrepareInstances( RenderData.PositionBufferObject, RenderData.ColorBufferObject, RenderData.LayerBufferObject );
+		Mesh->DrawIndirect( Commands, DrawMode );
+	}
+}
+
+bool CRenderable::CanInstance( const CRenderable* Renderable ) const
+{
+	return Renderable && Mesh == Renderable->Mesh && RenderData.LevelOfDetail == Renderable->RenderData.LevelOfDetail && CanMultiDraw( Renderable );
+}
+
+bool CRenderable::CanMultiDraw( const CRenderable* Renderable ) const
+{
+	if( !Renderable || !Mesh || !Renderable->Mesh || Shader != Renderable->Shader )
+		return false;
+
+	if( Mesh != Renderable->Mesh && ( !Mesh->GetAllocation().Page || Mesh->GetAllocation().Page != Renderable->Mesh->GetAllocation().Page ) )
+		return false;
+
+	if( RenderData.DrawMode != Renderable->RenderData.DrawMode || TextureSet != Renderable->TextureSet )
+		return false;
+
+	const CShader* ReadyShader = GetReadyShader( Shader );
+	const CShader* InstancedShader = ReadyShader ? ReadyShader->GetInstancedVariant() : nullptr;
+	const uint32_t TextureArrays = InstancedShader ? InstancedShader->GetTextureArrays() : 0;
+	for( uint32_t Index = 0; Index < TextureSlots; Index++ )
+	{
+		const CTexture* Texture = Textures[Index];
+		const CTexture* Other = Renderable->Textures[Index];
+		if( Texture == Other )
+			continue;
+
+		// Different layers of the same page are bound as one array, the instance stream selects the layer.
+		const bool Layered = Index < LayerSlots && ( TextureArrays & ( 1u << Index ) );
+		if( !Layered || !Texture || !Other || !Texture->GetPage() || Texture->GetPage() != Other->GetPage() )
+			return false;
+	}
+
+	return true;
+}
+
+glm::vec4 CRenderable::GetTextureLayers() const
+{
+	glm::vec4 Layers( 0.0f );
+	for( uint32_t Index = 0; Index < LayerSlots; Index++ )
+	{
+		const CTexture* Texture = Textures[Index];
+		if( Texture && Texture->GetPage() )
+		{
+			Layers[Index] = static_cast<float>( Texture->GetLayer() );
+		}
 	}
+
+	return Layers;
 }
 
 FRenderDataInstanced& CRenderable::GetRenderData()
@@ -102,26 +293,116 @@ FRenderDataInstanced& CRenderable::GetRenderData()
 	return RenderData;
 }
 
-void CRenderable::Prepare( FRenderData& RenderData )
+void CRenderable::UpdateSortKey( const FCameraSetup& CameraSetup )
 {
-	if( Shader )
+	// Packing moves textures into pages.
+	if( TextureGeneration != CTextureArray::GetGeneration() )
 	{
-		const FProgramHandles& Handles = Shader->GetHandles();
-		if( Textures[0] )
+		UpdateTextureSet();
+	}
+
+	const CShader* ReadyShader = GetReadyShader( Shader );
+	const bool Translucent = ReadyShader && ReadyShader->GetBlendMode() != EBlendMode::Opaque;
+	const uint64_t Layer = Translucent ? 1 : 0;
+	const uint64_t Program = KeyField( ReadyShader ? ReadyShader->GetHandles().Program : 0, ESortKey::Program );
+	const uint64_t TextureBits = KeyField( TextureSet ^ ( TextureSet >> ESortKey::TextureSet ), ESortKey::TextureSet );
+	const uint64_t Buffers = KeyField( RenderData.VertexBufferObject ^ ( RenderData.IndexBufferObject << 7 ) ^ ( RenderData.LevelOfDetail << 12 ), ESortKey::Mesh );
+
+	const Vector3D Offset = RenderData.Transform.GetPosition() - CameraSetup.CameraPosition;
+	float Depth = Offset.Dot( CameraSetup.CameraDirection ) / CameraSetup.FarPlaneDistance;
+	Depth = Depth < 0.0f ? 0.0f : ( Depth > 1.0f ? 1.0f : Depth );
+	const uint64_t QuantizedDepth = static_cast<uint64_t>( Depth * DepthRange );
+
+	const uint32_t LayerShift = 64 - ESortKey::Layer;
+	if( Translucent )
+	{
+		// Translucent geometry has to be drawn back-to-front so depth takes priority over state.
+		const uint32_t DepthShift = LayerShift - ESortKey::Depth;
+		const uint32_t ProgramShift = DepthShift - ESortKey::Program;
+		const uint32_t TextureShift = ProgramShift - ESortKey::TextureSet;
+		SortKey = Layer << LayerShift | ( DepthRange - QuantizedDepth ) << DepthShift | Program << ProgramShift | TextureBits << TextureShift | Buffers;
+	}
+	else
+	{
+		// Opaque geometry is grouped by state first and drawn front-to-back within a group.
+		const uint32_t ProgramShift = LayerShift - ESortKey::Program;
+		const uint32_t TextureShift = ProgramShift - ESortKey::TextureSet;
+		const uint32_t MeshShift = TextureShift - ESortKey::Mesh;
+		SortKey = Layer << LayerShift | Program << ProgramShift | TextureBits << TextureShift | Buffers << MeshShift | QuantizedDepth;
+	}
+}
+
+uint64_t CRenderable::GetSortKey() const
+{
+	return SortKey;
+}
+
+bool CRenderable::IsOccluder() const
+{
+	return Occluder;
+}
+
+void CRenderable::SetOccluder( const bool OccluderIn )
+{
+	Occluder = OccluderIn;
+}
+
+void CRenderable::Prepare( CShader* ActiveShader )
+{
+	if( ActiveShader )
+	{
+		CStateCache& StateCache = CStateCache::Get();
+		const uint32_t TextureArrays = ActiveShader->GetTextureArrays();
+		glm::vec4 Layers( 0.0f );
+
+		// Sampler uniforms are assigned to their slot when the shader is linked.
+		uint32_t Mask = TextureMask;
+		for( uint32_t Index = 0; Mask; Index++, Mask >>= 1 )
 		{
-			for( ETextureSlot Slot = ETextureSlot::Slot0; Slot < ETextureSlot::Maximum; )
-			{
-				const auto Index = static_cast<ETextureSlotType>( Slot );
+			if( !( Mask & 1 ) )
+				continue;
 
-				CTexture* Texture = Textures[Index];
-				if( Texture )
+			const ETextureSlot Slot = static_cast<ETextureSlot>( Index );
+			CTexture* Texture = Textures[Index];
+			CTextureArray* Page = Texture->GetPage();
+			if( Page && ( TextureArrays & ( 1u << Index ) ) )
+			{
+				StateCache.BindTextureArray( Slot, Page->GetHandle() );
+				if( Index < LayerSlots )
 				{
-					glUniform1i( glGetUniformLocation( Handles.Program, TextureSlotName[Index] ), Index );
-					Texture->Bind( Slot );
+					Layers[Index] = static_cast<float>( Texture->GetLayer() );
 				}
-
-				Slot = static_cast<ETextureSlot>( Index + 1 );
+			}
+			else
+			{
+				Texture->Bind( Slot );
 			}
 		}
+
+		const GLint LayersLocation = ActiveShader->GetUniformLocation( EUniform::TextureLayers );
+		if( TextureArrays && LayersLocation > -1 )
+		{
+			glUniform4fv( LayersLocation, 1, glm::value_ptr( Layers ) );
+		}
 	}
 }
+
+void CRenderable::UpdateTextureSet()
+{
+	// Hash the textures so renderables that share the same textures end up next to each other, packed textures hash their page instead.
+	// Handles aren't stable identities, streaming swaps them out once the texture has been uploaded.
+	TextureSet = 2166136261u;
+	for( uint32_t Index = 0; Index < TextureSlots; Index++ )
+	{
+		CTexture* Texture = Textures[Index];
+		if( Texture )
+		{
+			CTextureArray* Page = Texture->GetPage();
+			const uint64_t Identity = Page ? reinterpret_cast<uintptr_t>( Page ) : reinterpret_cast<uintptr_t>( Texture );
+			TextureSet ^= static_cast<uint32_t>( Identity ^ ( Identity >> 32 ) ) + Index;
+			TextureSet *= 16777619u;
+		}
+	}
+
+	TextureGeneration = CTextureArray::GetGeneration();
+}
@@ -5,12 +5,15 @@
 // #include <ThirdParty/glfw-3.2.1.bin.WIN64/include/GLFW//glfw3.h>
 #include <glm/glm.hpp>
 
+#include <Engine/Display/Rendering/Camera.h>
 #include <Engine/Display/Rendering/Mesh.h>
 class CShader;
 #include <Engine/Display/Rendering/Texture.h>
 
 #include <Engine/Utility/Math.h>
 
+class CRenderCommandBuffer;
+
 struct FRenderData
 {
 	GLuint VertexBufferObject = 0;
@@ -21,12 +24,16 @@ struct FRenderData
 	glm::vec4 Color;
 
 	EDrawMode DrawMode = None;
+
+	// Index range of the mesh that is drawn, selected by the renderer from the projected size.
+	uint32_t LevelOfDetail = 0;
 };
 
 struct FRenderDataInstanced : public FRenderData
 {
 	GLuint PositionBufferObject = 0;
 	GLuint ColorBufferObject = 0;
+	GLuint LayerBufferObject = 0;
 };
 
 class CRenderable
@@ -46,13 +53,53 @@ public:
 
 	virtual void Draw( FRenderData& RenderData, const FRenderData& PreviousRenderData, EDrawMode DrawModeOverride = None );
 
+	// Records the same work as Draw into a command buffer without touching GL, safe to call from worker threads.
+	virtual void Record( CRenderCommandBuffer& Buffer, const bool PrepareBuffers, EDrawMode DrawModeOverride = None );
+
+	// Draws a batch of instances, the transform and color streams are taken from the render data.
+	virtual void DrawInstanced( FRenderDataInstanced& RenderData, GLsizei Instances, EDrawMode DrawModeOverride = None );
+
+	// Issues the indirect commands in the bound draw indirect buffer with the given instance streams.
+	virtual void DrawIndirect( FRenderDataInstanced& RenderData, GLsizei Commands, EDrawMode DrawModeOverride = None );
+
+	// True if both renderables use the same mesh, level of detail, shader, textures and draw mode.
+	bool CanInstance( const CRenderable* Renderable ) const;
+
+	// True if both renderables use the same shader, textures and draw mode, and either the same mesh or meshes on the same geometry arena page.
+	// Textures the instanced variant samples from a texture array only have to share their page, the layer is passed per instance.
+	bool CanMultiDraw( const CRenderable* Renderable ) const;
+
+	// Layers of the textures in the first four slots that have been packed into a texture array.
+	glm::vec4 GetTextureLayers() const;
+
 	FRenderDataInstanced& GetRenderData();
+
+	// Packs the blend layer, program, texture set, mesh and quantized view depth into a single sortable key.
+	// Textures that have been packed into a texture array contribute their page so renderables that share a page end up next to each other.
+	void UpdateSortKey( const FCameraSetup& CameraSetup );
+	uint64_t GetSortKey() const;
+
+	// Occluders are rasterized into the occlusion buffer before the other renderables are tested against it.
+	bool IsOccluder() const;
+	void SetOccluder( const bool OccluderIn );
 private:
 	CTexture* Textures[TextureSlots];
 	CShader* Shader;
 	CMesh* Mesh;
 
-	void Prepare( FRenderData& RenderData );
+	// Binds the textures for the given program, slots it declares as arrays get the texture's page and layer.
+	void Prepare( CShader* ActiveShader );
+
+	void UpdateTextureSet();
 
 	FRenderDataInstanced RenderData;
+
+	// Bit mask of the slots that have a texture assigned.
+	uint32_t TextureMask;
+
+	uint32_t TextureSet;
+	uint32_t TextureGeneration;
+	uint64_t SortKey;
+
+	bool Occluder;
 };
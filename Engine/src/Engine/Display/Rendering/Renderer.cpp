@@ -11,11 +11,18 @@
 
 #include <Engine/Configuration/Configuration.h>
 
+#include <Engine/Display/Rendering/DynamicResolution.h>
+#include <Engine/Display/Rendering/GPUTimers.h>
 #include <Engine/Display/Rendering/Mesh.h>
 #include <Engine/Display/Rendering/Shader.h>
 #include <Engine/Display/Rendering/Texture.h>
+#include <Engine/Display/Rendering/TextureArray.h>
+#include <Engine/Display/Rendering/TextureStreamer.h>
 #include <Engine/Display/Rendering/RenderTexture.h>
+#include <Engine/Display/Rendering/RenderGraph.h>
 #include <Engine/Display/Rendering/RenderPass.h>
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Display/Rendering/UniformBuffer.h>
 #include <Engine/Display/UserInterface.h>
 
 #include <Engine/Profiling/Logging.h>
@@ -37,29 +44,49 @@ static std::stringstream stream;
 static const size_t RenderableCapacity = 4096;
 
 static CShader* DefaultShader = nullptr;
-GLuint ProgramHandle = -1;
 
-static CRenderTexture Framebuffer;
-static CRenderTexture BufferA;
-static CRenderTexture BufferB;
-
-static CRenderTexture BufferPrevious;
+// Processed frames alternate between these, the one that isn't written this frame is the history.
+static CRenderTexture HistoryBuffers[2];
+static uint32_t HistoryIndex = 0;
 
 static CRenderable FramebufferRenderable;
 
 static CShader* SuperSampleBicubicShader = nullptr;
 static CShader* ImageProcessingShader = nullptr;
 static CShader* ResolveShader = nullptr;
-static CShader* CopyShader = nullptr;
+
+// Does the bicubic resolve and image processing in one pass, the separate passes are used when it isn't available.
+static CShader* PostProcessShader = nullptr;
+static bool FusedPostProcess = true;
+
+static CUniformBuffer FrameUniformBuffer( EUniformBlock::Frame );
 
 static bool SkipRenderPasses = false;
+static bool FrustumCulling = true;
+static bool OcclusionCulling = true;
+static bool LevelOfDetail = true;
+static float LevelOfDetailScale = 1.0f;
+
+// Fraction of a level's size threshold that has to be crossed before it switches, prevents popping back and forth.
+static const float LevelOfDetailHysteresis = 0.15f;
+static bool Instancing = true;
+static bool MultiDraw = true;
+static bool ParallelRecording = true;
 static float SuperSamplingFactor = 2.0f;
 static bool SuperSampling = true;
 
+static CDynamicResolution DynamicResolution;
+static const FName FrameTimeName( "Frametime" );
+
 CRenderer::CRenderer()
 {
 	Renderables.reserve( RenderableCapacity );
 	DynamicRenderables.reserve( RenderableCapacity );
+	VisibleRenderables.reserve( RenderableCapacity );
+	VisibleDynamicRenderables.reserve( RenderableCapacity );
+	SortedRenderables.reserve( RenderableCapacity );
+	SortEntries.reserve( RenderableCapacity );
+	SortScratch.reserve( RenderableCapacity );
 	ForceWireFrame = false;
 
 	ViewportWidth = -1;
@@ -123,6 +150,7 @@ void CRenderer::Initialize()
 {
 	CAssets& Assets = CAssets::Get();
 	DefaultShader = Assets.CreateNamedShader( "Default", "Shaders/Default" );
+	CShader::SetPlaceholder( DefaultShader );
 
 	FPrimitive Triangle;
 	MeshBuilder::Triangle( Triangle, 1.0f );
@@ -151,33 +179,62 @@ void CRenderer::Initialize()
 	FramebufferRenderable.SetShader( SuperSampleBicubicShader );
 
 	ResolveShader = Assets.CreateNamedShader( "Resolve", "Shaders/FullScreenQuad", "Shaders/Resolve" );
-	CopyShader = Assets.CreateNamedShader( "Copy", "Shaders/FullScreenQuad", "Shaders/Copy" );
 	ImageProcessingShader = Assets.CreateNamedShader( "ImageProcessing", "Shaders/FullScreenQuad", "Shaders/ImageProcessing" );
+	PostProcessShader = Assets.CreateNamedShader( "PostProcess", "Shaders/FullScreenQuad", "Shaders/PostProcess" );
 
 	GlobalUniformBuffers.clear();
 
 	SkipRenderPasses = CConfiguration::Get().GetInteger( "skiprenderpasses", 0 ) > 0;
+	FrustumCulling = CConfiguration::Get().GetInteger( "frustumculling", 1 ) > 0;
+	OcclusionCulling = CConfiguration::Get().GetInteger( "occlusionculling", 1 ) > 0;
+	LevelOfDetail = CConfiguration::Get().GetInteger( "levelofdetail", 1 ) > 0;
+	LevelOfDetailScale = CConfiguration::Get().GetFloat( "levelofdetailscale", 1.0f );
+	Instancing = CConfiguration::Get().GetInteger( "instancing", 1 ) > 0;
+	MultiDraw = CConfiguration::Get().GetInteger( "multidraw", 1 ) > 0;
+	ParallelRecording = CConfiguration::Get().GetInteger( "parallelrecording", 1 ) > 0;
 	SuperSampling = CConfiguration::Get().GetInteger( "supersampling", 1 ) > 0;
 	SuperSamplingFactor = CConfiguration::Get().GetFloat( "supersamplingfactor", 2.0f );
+	FusedPostProcess = CConfiguration::Get().GetInteger( "fusedpostprocess", 1 ) > 0;
+
+	if( FusedPostProcess && !PostProcessShader )
+	{
+		Log::Event( Log::Warning, "Fused post-processing is unavailable without \"Shaders/PostProcess\", falling back to separate passes.\n" );
+	}
 
 	if( SuperSamplingFactor < 0.1f )
 	{
 		SuperSamplingFactor = 0.1f;
 	}
+
+	// The configured super sampling factor becomes the upper bound of the render scale.
+	const float MaximumScale = SuperSampling ? SuperSamplingFactor : 1.0f;
+	DynamicResolution.Enabled = CConfiguration::Get().GetInteger( "dynamicresolution", 1 ) > 0;
+	DynamicResolution.Configure(
+		CConfiguration::Get().GetFloat( "dynamicresolutionminimum", 0.5f ),
+		CConfiguration::Get().GetFloat( "dynamicresolutionmaximum", MaximumScale ),
+		CConfiguration::Get().GetFloat( "dynamicresolutionstep", 0.125f ),
+		CConfiguration::Get().GetFloat( "dynamicresolutiontarget", 16.6f )
+	);
 }
 
 void CRenderer::RefreshFrame()
 {
 	// Clean up the renderable queue.
 	Renderables.clear();
+	VisibleRenderables.clear();
+	VisibleDynamicRenderables.clear();
 
-	// Clean up dynamic renderables.
+	// Clean up dynamic renderables, the ones that live in the frame arena are destroyed when it is reset.
 	for( auto Renderable : DynamicRenderables )
 	{
-		delete Renderable;
+		if( !FrameArena.Owns( Renderable ) )
+		{
+			delete Renderable;
+		}
 	}
 
 	DynamicRenderables.clear();
+	FrameArena.Reset();
 
 	UI::Refresh();
 }
@@ -192,255 +249,369 @@ void CRenderer::QueueDynamicRenderable( CRenderable* Renderable )
 	DynamicRenderables.push_back( Renderable );
 }
 
+CRenderable* CRenderer::EmplaceDynamicRenderable()
+{
+	CRenderable* Renderable = FrameArena.Emplace<CRenderable>();
+	DynamicRenderables.push_back( Renderable );
+	return Renderable;
+}
+
+CFrameArena& CRenderer::GetFrameArena()
+{
+	return FrameArena;
+}
+
 void CRenderer::DrawQueuedRenderables()
 {
+	// The user interface renders in between frames and doesn't go through the state cache.
+	// Forget its state before anything below binds through the cache.
+	CStateCache& StateCache = CStateCache::Get();
+	StateCache.Invalidate();
+
+	CShader::Update();
+	CGPUTimers::Get().Update();
+
+	CTextureStreamer& Streamer = CTextureStreamer::Get();
+	Streamer.Update();
+
+	CAssets::Get().PackTextures();
+
 	int FramebufferWidth = ViewportWidth;
 	int FramebufferHeight = ViewportHeight;
 
-	const bool RenderOnlyMainPass = SkipRenderPasses || ForceWireFrame;
+	const bool ValidViewport = ViewportWidth > 0 && ViewportHeight > 0;
+	const bool RenderOnlyMainPass = SkipRenderPasses || ForceWireFrame || !ValidViewport;
 
-	if( !RenderOnlyMainPass && SuperSampling )
+	// The frame time entry of the previous frame drives the render scale of this one.
+	float RenderScale = SuperSampling ? SuperSamplingFactor : 1.0f;
+	if( DynamicResolution.IsEnabled() )
 	{
-		FramebufferWidth *= SuperSamplingFactor;
-		FramebufferHeight *= SuperSamplingFactor;
+		const float FrameTime = static_cast<float>( CProfiler::Get().GetLatestTime( FrameTimeName ) ) / 1000000.0f;
+		RenderScale = DynamicResolution.Update( FrameTime );
 	}
 
-	if( !Framebuffer.Ready() )
+	// Resampling requires the post-processing chain.
+	if( RenderOnlyMainPass )
 	{
-		if( ViewportWidth > -1 && ViewportHeight > -1 )
-		{
-			Framebuffer = CRenderTexture( "Framebuffer", FramebufferWidth, FramebufferHeight );
-			Framebuffer.Initialize();
-		}
+		RenderScale = 1.0f;
 	}
 
-	CRenderPass MainPass( "MainPass", FramebufferWidth, FramebufferHeight, Camera, false );
+	FramebufferWidth = std::max( static_cast<int>( FramebufferWidth * RenderScale ), 1 );
+	FramebufferHeight = std::max( static_cast<int>( FramebufferHeight * RenderScale ), 1 );
 
-	if( !RenderOnlyMainPass )
+	const bool Resample = FramebufferWidth != ViewportWidth || FramebufferHeight != ViewportHeight;
+	SetUniformBuffer( "RenderScale", Vector4D( RenderScale, 1.0f / RenderScale, static_cast<float>( FramebufferWidth ), static_cast<float>( FramebufferHeight ) ) );
+
+	// The history buffers persist across frames, they are the only targets that aren't pooled.
+	for( auto& HistoryBuffer : HistoryBuffers )
 	{
-		MainPass.Target = &Framebuffer;
+		if( ValidViewport && ( !HistoryBuffer.Ready() || HistoryBuffer.GetWidth() != ViewportWidth || HistoryBuffer.GetHeight() != ViewportHeight ) )
+		{
+			HistoryBuffer.Destroy();
+			HistoryBuffer = CRenderTexture( "BufferPrevious", ViewportWidth, ViewportHeight );
+			HistoryBuffer.Initialize();
+		}
 	}
 
+	CRenderPass MainPass( "MainPass", FramebufferWidth, FramebufferHeight, Camera, false );
+	MainPass.Instancing = Instancing;
+	MainPass.MultiDraw = MultiDraw;
+	MainPass.ParallelRecording = ParallelRecording;
+
 	glEnable( GL_DEPTH_TEST );
-	glDepthFunc( GL_LESS );
-	glDepthMask( GL_TRUE );
+	StateCache.SetDepthTest( EDepthTest::Less );
+	StateCache.SetDepthMask( EDepthMask::Write );
 
 	if( ForceWireFrame )
 	{
 		glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
-		glDisable( GL_CULL_FACE );
+		StateCache.SetCulling( false );
 	}
 	else
 	{
 		glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
-		glEnable( GL_CULL_FACE );
+		StateCache.SetCulling( true );
 	}
 
-	auto SortRenderables = [&] ( CRenderable* A, CRenderable* B ) {
-		auto& RenderDataA = A->GetRenderData();
-		auto& RenderDataB = B->GetRenderData();
-
-		const bool ShaderProgram = ExclusiveComparison( RenderDataA.ShaderProgram, RenderDataB.ShaderProgram );
-		const bool VertexBufferObject = ExclusiveComparison( RenderDataA.VertexBufferObject, RenderDataB.VertexBufferObject );
-		const bool IndexBufferObject = ExclusiveComparison( RenderDataA.IndexBufferObject, RenderDataB.IndexBufferObject );
-		
-		auto ShaderA = A->GetShader();
-		auto ShaderB = B->GetShader();
-		bool Distance = false;
-		if( ShaderA && ShaderB )
-		{
-			if( ShaderA->GetBlendMode() == EBlendMode::Alpha )
-			{
-				return false;
-			}
-
-			if( ShaderB->GetBlendMode() == EBlendMode::Alpha )
-			{
-				return true;
-			}
-		}
+	const int64_t RenderablesSize = static_cast<int64_t>( Renderables.size() );
+	const int64_t DynamicRenderablesSize = static_cast<int64_t>( DynamicRenderables.size() );
 
-		return ShaderProgram && VertexBufferObject && IndexBufferObject && Distance;
-	};
+	int64_t CulledRenderables = 0;
+	if( FrustumCulling )
+	{
+		Profile( "Frustum Culling" );
+		CulledRenderables += CullRenderables( Renderables, VisibleRenderables );
+		CulledRenderables += CullRenderables( DynamicRenderables, VisibleDynamicRenderables );
+	}
+	else
+	{
+		VisibleRenderables = Renderables;
+		VisibleDynamicRenderables = DynamicRenderables;
+	}
 
-	std::sort( Renderables.begin(), Renderables.end(), SortRenderables );
-	std::sort( DynamicRenderables.begin(), DynamicRenderables.end(), SortRenderables );
+	int64_t OccludedRenderables = 0;
+	if( OcclusionCulling )
+	{
+		Profile( "Occlusion Culling" );
+		OccludedRenderables = OccludeRenderables();
+	}
 
-	MainPass.Clear();
+	int64_t ReducedRenderables = 0;
+	if( LevelOfDetail )
+	{
+		Profile( "Level of Detail" );
+		ReducedRenderables += SelectLevelsOfDetail( VisibleRenderables );
+		ReducedRenderables += SelectLevelsOfDetail( VisibleDynamicRenderables );
+	}
 
-	int64_t DrawCalls = 0;
+	{
+		Profile( "Sort Renderables" );
+		SortRenderables( VisibleRenderables );
+		SortRenderables( VisibleDynamicRenderables );
+	}
 
+	// Shaders that declare the FrameData block read the frame globals from here instead of loose uniforms.
 	{
-		Profile( "ERenderPassLocation::PreScene" );
-		for( auto& Pass : Passes )
+		FFrameData FrameData;
+		auto Time = GlobalUniformBuffers.find( "Time" );
+		FrameData.Time = Time != GlobalUniformBuffers.end() ? glm::make_vec4( Time->second.Base() ) : glm::vec4( 0.0f );
+		FrameData.Resolution = glm::vec4( ViewportWidth, ViewportHeight, 1.0f / ViewportWidth, 1.0f / ViewportHeight );
+		FrameData.RenderScale = glm::vec4( RenderScale, 1.0f / RenderScale, FramebufferWidth, FramebufferHeight );
+
+		// Programs that read their globals from the block don't have loose uniforms for them, so nothing is uploaded per program.
+		std::fill( std::begin( FrameData.Globals ), std::end( FrameData.Globals ), glm::vec4( 0.0f ) );
+		for( auto& Global : GlobalUniformBuffers )
 		{
-			if( Pass.Pass && Pass.Location == ERenderPassLocation::PreScene )
+			const int32_t Index = CUniformBuffer::GetGlobalIndex( Global.first );
+			if( Index > -1 )
 			{
-				if( !RenderOnlyMainPass )
-				{
-					Pass.Pass->Target = &Framebuffer;
-				}
-
-				DrawCalls += Pass.Pass->Render( GlobalUniformBuffers );
+				FrameData.Globals[Index] = glm::make_vec4( Global.second.Base() );
 			}
 		}
+
+		FrameUniformBuffer.Upload( FrameData );
 	}
 
+	int64_t DrawCalls = 0;
+	int64_t InstancedRenderables = 0;
+
+	RenderTargetHandle_t Scene = CRenderGraph::Backbuffer;
+	if( !RenderOnlyMainPass )
 	{
-		Profile( "Main Pass" );
-		DrawCalls += MainPass.Render( Renderables, GlobalUniformBuffers );
-		DrawCalls += MainPass.Render( DynamicRenderables, GlobalUniformBuffers );
+		Scene = RenderGraph.Create( "Scene", { FramebufferWidth, FramebufferHeight, EImageFormat::RGB16F } );
 	}
 
+	RenderGraph.AddNode( "Clear", {}, { Scene }, [&] () -> int64_t
+	{
+		MainPass.Target = RenderGraph.GetTarget( Scene );
+		MainPass.Clear();
+		return 0;
+	} );
+
+	auto AddPasses = [&] ( const ERenderPassLocation::Type Location, const std::string& NodeName, const std::vector<RenderTargetHandle_t>& Reads, const RenderTargetHandle_t Write )
 	{
-		Profile( "ERenderPassLocation::Scene" );
 		for( auto& Pass : Passes )
 		{
-			if( Pass.Pass && Pass.Location == ERenderPassLocation::Scene )
+			if( Pass.Pass && Pass.Location == Location )
 			{
-				if( !RenderOnlyMainPass )
+				CRenderPass* RenderPass = Pass.Pass;
+				RenderGraph.AddNode( NodeName, Reads, { Write }, [&, RenderPass, Write] () -> int64_t
 				{
-					Pass.Pass->Target = &Framebuffer;
-				}
-
-				DrawCalls += Pass.Pass->Render( GlobalUniformBuffers );
+					RenderPass->Target = RenderGraph.GetTarget( Write );
+					const int64_t Calls = RenderPass->Render( GlobalUniformBuffers );
+					DrawCalls += Calls;
+					return Calls;
+				} );
 			}
 		}
-	}
+	};
 
-	if( !RenderOnlyMainPass && DrawCalls > 0 )
+	AddPasses( ERenderPassLocation::PreScene, "ERenderPassLocation::PreScene", { Scene }, Scene );
+
+	RenderGraph.AddNode( "Main Pass", { Scene }, { Scene }, [&] () -> int64_t
 	{
-		Profile( "Post-Process" );
-		if( !SuperSampling )
-		{
-			BufferA = Framebuffer;
-		}
+		DrawCalls += MainPass.Render( VisibleRenderables, GlobalUniformBuffers );
+		InstancedRenderables += MainPass.Instances;
+		DrawCalls += MainPass.Render( VisibleDynamicRenderables, GlobalUniformBuffers );
+		InstancedRenderables += MainPass.Instances;
+		return 0;
+	} );
 
-		if( MainPass.Target && MainPass.Target->Ready() && SuperSampleBicubicShader && ResolveShader && ImageProcessingShader && CopyShader )
-		{
-			FramebufferRenderable.SetShader( SuperSampleBicubicShader );
-			FramebufferRenderable.SetTexture( MainPass.Target, ETextureSlot::Slot0 );
+	AddPasses( ERenderPassLocation::Scene, "ERenderPassLocation::Scene", { Scene }, Scene );
 
-			if( BufferPrevious.Ready() )
-			{
-				FramebufferRenderable.SetTexture( &BufferPrevious, ETextureSlot::Slot1 );
-			}
+	// Only flip the history when this frame's processed image was actually written.
+	bool HistoryWritten = false;
 
-			if( !BufferA.Ready() )
-			{
-				if( ViewportWidth > -1 && ViewportHeight > -1 )
-				{
-					BufferA = CRenderTexture( "BufferA", ViewportWidth, ViewportHeight );
-				}
-			}
+	if( !RenderOnlyMainPass && SuperSampleBicubicShader && ResolveShader && ImageProcessingShader )
+	{
+		// Processing writes straight into next frame's history, which saves copying it over afterwards.
+		const RenderTargetHandle_t History = RenderGraph.Import( "History", &HistoryBuffers[HistoryIndex] );
+		const RenderTargetHandle_t Processed = RenderGraph.Import( "Processed", &HistoryBuffers[HistoryIndex ^ 1] );
 
-			if( !BufferB.Ready() )
+		RenderTargetHandle_t Color = Scene;
+		if( FusedPostProcess && PostProcessShader )
+		{
+			RenderGraph.AddNode( "PostProcess", { Scene, History }, { Processed }, [&, Scene, History, Processed] () -> int64_t
 			{
-				if( ViewportWidth > -1 && ViewportHeight > -1 )
-				{
-					BufferB = CRenderTexture( "BufferB", ViewportWidth, ViewportHeight );
-					BufferB.Initialize();
-				}
-			}
-
-			if( SuperSampling )
+				if( DrawCalls == 0 )
+					return 0;
+
+				FramebufferRenderable.SetShader( PostProcessShader );
+				FramebufferRenderable.SetTexture( RenderGraph.GetTarget( Scene ), ETextureSlot::Slot0 );
+				FramebufferRenderable.SetTexture( RenderGraph.GetTarget( History ), ETextureSlot::Slot1 );
+
+				CRenderPass PostProcess( "PostProcess", ViewportWidth, ViewportHeight, Camera );
+				PostProcess.Target = RenderGraph.GetTarget( Processed );
+				const int64_t Calls = PostProcess.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
+				DrawCalls += Calls;
+				HistoryWritten = true;
+				return Calls;
+			} );
+
+			// The scene can be a different size than the viewport, the processed image is the anti-aliased result.
+			Color = Processed;
+		}
+		else if( SuperSampling || Resample )
+		{
+			Color = RenderGraph.Create( "AntiAliased", { ViewportWidth, ViewportHeight, EImageFormat::RGB16F } );
+			RenderGraph.AddNode( "AntiAliasingResolve", { Scene, History }, { Color }, [&, Scene, History, Color] () -> int64_t
 			{
-				CRenderPass AntiAliasingResolve( "AntiAliasingResolve", ViewportWidth, ViewportHeight, Camera );
-				AntiAliasingResolve.Target = &BufferA;
-				AntiAliasingResolve.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
-			}
+				if( DrawCalls == 0 )
+					return 0;
 
-			FramebufferRenderable.SetShader( ImageProcessingShader );
+				FramebufferRenderable.SetShader( SuperSampleBicubicShader );
+				FramebufferRenderable.SetTexture( RenderGraph.GetTarget( Scene ), ETextureSlot::Slot0 );
+				FramebufferRenderable.SetTexture( RenderGraph.GetTarget( History ), ETextureSlot::Slot1 );
 
-			CRenderTexture* BufferSource = nullptr;
-			CRenderTexture* BufferTarget = nullptr;
-			if( BufferA.Ready() && BufferB.Ready() )
-			{
-				BufferSource = ( BufferSource == &BufferA ) ? &BufferB : &BufferA;
-				BufferTarget = ( BufferSource == &BufferA ) ? &BufferB : &BufferA;
+				CRenderPass AntiAliasingResolve( "AntiAliasingResolve", ViewportWidth, ViewportHeight, Camera );
+				AntiAliasingResolve.Target = RenderGraph.GetTarget( Color );
+				return AntiAliasingResolve.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
+			} );
+		}
 
-				FramebufferRenderable.SetTexture( BufferSource, ETextureSlot::Slot0 );
+		if( !FusedPostProcess || !PostProcessShader )
+		{
+			RenderGraph.AddNode( "ResolvePass", { Color, History }, { Processed }, [&, Color, History, Processed] () -> int64_t
+			{
+				if( DrawCalls == 0 )
+					return 0;
 
-				if( BufferPrevious.Ready() )
-				{
-					FramebufferRenderable.SetTexture( &BufferPrevious, ETextureSlot::Slot1 );
-				}
+				FramebufferRenderable.SetShader( ImageProcessingShader );
+				FramebufferRenderable.SetTexture( RenderGraph.GetTarget( Color ), ETextureSlot::Slot0 );
+				FramebufferRenderable.SetTexture( RenderGraph.GetTarget( History ), ETextureSlot::Slot1 );
 
 				CRenderPass ResolvePass( "ResolvePass", ViewportWidth, ViewportHeight, Camera );
-				ResolvePass.Target = BufferTarget;
-				DrawCalls += ResolvePass.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
-
-				for( auto& Pass : Passes )
-				{
-					if( Pass.Pass && Pass.Location == ERenderPassLocation::PostProcess )
-					{
-						Pass.Pass->Target = BufferTarget;
-						DrawCalls += Pass.Pass->Render( GlobalUniformBuffers );
-					}
-				}
-			}
-
-			if( !BufferPrevious.Ready() )
-			{
-				if( ViewportWidth > -1 && ViewportHeight > -1 )
-				{
-					BufferPrevious = CRenderTexture( "BufferPrevious", ViewportWidth, ViewportHeight );
-					BufferPrevious.Initialize();
-				}
-			}
+				ResolvePass.Target = RenderGraph.GetTarget( Processed );
+				const int64_t Calls = ResolvePass.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
+				DrawCalls += Calls;
+				HistoryWritten = true;
+				return Calls;
+			} );
+		}
 
-			if( BufferPrevious.Ready() && BufferTarget && BufferTarget->Ready() )
-			{
-				FramebufferRenderable.SetShader( CopyShader );
-				FramebufferRenderable.SetTexture( BufferTarget, ETextureSlot::Slot0 );
+		AddPasses( ERenderPassLocation::PostProcess, "ERenderPassLocation::PostProcess", { Processed }, Processed );
 
-				CRenderPass ResolveToPrevious( "ResolveToPrevious", ViewportWidth, ViewportHeight, Camera );
-				ResolveToPrevious.Target = &BufferPrevious;
-				DrawCalls += ResolveToPrevious.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
-			}
+		RenderGraph.AddNode( "ResolveToViewport", { Processed, Color }, { CRenderGraph::Backbuffer }, [&, Processed, Color] () -> int64_t
+		{
+			if( DrawCalls == 0 )
+				return 0;
+
+			FramebufferRenderable.SetShader( ResolveShader );
+			FramebufferRenderable.SetTexture( RenderGraph.GetTarget( Processed ), ETextureSlot::Slot0 );
+			FramebufferRenderable.SetTexture( RenderGraph.GetTarget( Color ), ETextureSlot::Slot1 );
+
+			CRenderPass ResolveToViewport( "ResolveToViewport", ViewportWidth, ViewportHeight, Camera );
+			const int64_t Calls = ResolveToViewport.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
+			DrawCalls += Calls;
+			return Calls;
+		} );
+	}
 
-			if( BufferPrevious.Ready() && BufferSource && BufferSource->Ready() )
-			{
-				FramebufferRenderable.SetShader( ResolveShader );
-				FramebufferRenderable.SetTexture( &BufferPrevious, ETextureSlot::Slot0 );
-				FramebufferRenderable.SetTexture( BufferSource, ETextureSlot::Slot1 );
+	AddPasses( ERenderPassLocation::Standard, "ERenderPassLocation::Standard", {}, CRenderGraph::Backbuffer );
 
-				CRenderPass ResolveToViewport( "ResolveToViewport", ViewportWidth, ViewportHeight, Camera );
-				DrawCalls += ResolveToViewport.RenderRenderable( &FramebufferRenderable, GlobalUniformBuffers );
-			}
-		}
+	{
+		Profile( "Render Graph" );
+		RenderGraph.Execute();
 	}
 
+	if( HistoryWritten )
 	{
-		Profile( "ERenderPassLocation::Standard" );
-		for( auto& Pass : Passes )
-		{
-			if( Pass.Pass && Pass.Location == ERenderPassLocation::Standard )
-			{
-				Pass.Pass->Target = nullptr;
-				DrawCalls += Pass.Pass->Render( GlobalUniformBuffers );
-			}
-		}
+		HistoryIndex ^= 1;
 	}
 
 	CProfiler& Profiler = CProfiler::Get();
 	FProfileTimeEntry drawCallsEntry = FProfileTimeEntry( "Draw Calls", DrawCalls );
 	Profiler.AddCounterEntry( drawCallsEntry, true );
 
-	int64_t RenderablesSize = static_cast<int64_t>( Renderables.size() );
 	FProfileTimeEntry renderablesEntry = FProfileTimeEntry( "Renderables", RenderablesSize );
 	Profiler.AddCounterEntry( renderablesEntry, true );
 
-	int64_t DynamicRenderablesSize = static_cast<int64_t>( DynamicRenderables.size() );
 	FProfileTimeEntry dynamicRenderablesEntry = FProfileTimeEntry( "Renderables (Dynamic)", DynamicRenderablesSize );
 	Profiler.AddCounterEntry( dynamicRenderablesEntry, true );
 
+	const int64_t VisibleRenderablesSize = static_cast<int64_t>( VisibleRenderables.size() + VisibleDynamicRenderables.size() );
+	FProfileTimeEntry visibleRenderablesEntry = FProfileTimeEntry( "Renderables (Visible)", VisibleRenderablesSize );
+	Profiler.AddCounterEntry( visibleRenderablesEntry, true );
+
+	FProfileTimeEntry culledRenderablesEntry = FProfileTimeEntry( "Renderables (Culled)", CulledRenderables );
+	Profiler.AddCounterEntry( culledRenderablesEntry, true );
+
+	FProfileTimeEntry occludedRenderablesEntry = FProfileTimeEntry( "Renderables (Occluded)", OccludedRenderables );
+	Profiler.AddCounterEntry( occludedRenderablesEntry, true );
+
+	FProfileTimeEntry occluderTrianglesEntry = FProfileTimeEntry( "Occluder Triangles", static_cast<int64_t>( OcclusionBuffer.GetOccluderTriangles() ) );
+	Profiler.AddCounterEntry( occluderTrianglesEntry, true );
+
+	FProfileTimeEntry streamingTexturesEntry = FProfileTimeEntry( "Textures (Streaming)", static_cast<int64_t>( Streamer.GetPending() ) );
+	Profiler.AddCounterEntry( streamingTexturesEntry, true );
+
+	FProfileTimeEntry textureArraysEntry = FProfileTimeEntry( "Texture Arrays", static_cast<int64_t>( CTextureArray::GetPageCount() ) );
+	Profiler.AddCounterEntry( textureArraysEntry, true );
+
+	FProfileTimeEntry droppedTimersEntry = FProfileTimeEntry( "GPU Timers (Dropped)", CGPUTimers::Get().FlushDropped() );
+	Profiler.AddCounterEntry( droppedTimersEntry, true );
+
+	FProfileTimeEntry renderScaleEntry = FProfileTimeEntry( "Render Scale (%)", static_cast<int64_t>( RenderScale * 100.0f + 0.5f ) );
+	Profiler.AddCounterEntry( renderScaleEntry, true );
+
+	FProfileTimeEntry reducedRenderablesEntry = FProfileTimeEntry( "Renderables (Reduced Detail)", ReducedRenderables );
+	Profiler.AddCounterEntry( reducedRenderablesEntry, true );
+
+	FProfileTimeEntry instancedRenderablesEntry = FProfileTimeEntry( "Renderables (Instanced)", InstancedRenderables );
+	Profiler.AddCounterEntry( instancedRenderablesEntry, true );
+
+	FProfileTimeEntry uniformLookupsEntry = FProfileTimeEntry( "Uniform Lookups (Avoided)", CShader::FlushUniformLookups() );
+	Profiler.AddCounterEntry( uniformLookupsEntry, true );
+
+	FProfileTimeEntry stateChangesEntry = FProfileTimeEntry( "State Changes", StateCache.FlushMisses() );
+	Profiler.AddCounterEntry( stateChangesEntry, true );
+
+	FProfileTimeEntry stateChangesSkippedEntry = FProfileTimeEntry( "State Changes (Skipped)", StateCache.FlushHits() );
+	Profiler.AddCounterEntry( stateChangesSkippedEntry, true );
+
+	FProfileTimeEntry renderTargetsEntry = FProfileTimeEntry( "Render Targets (Pooled)", static_cast<int64_t>( RenderGraph.GetPooledTargets() ) );
+	Profiler.AddCounterEntry( renderTargetsEntry, true );
+
+	FProfileTimeEntry culledNodesEntry = FProfileTimeEntry( "Render Graph Nodes (Culled)", static_cast<int64_t>( RenderGraph.GetCulledNodes() ) );
+	Profiler.AddCounterEntry( culledNodesEntry, true );
+
+	FProfileTimeEntry frameArenaEntry = FProfileTimeEntry( "Frame Arena (Bytes)", static_cast<int64_t>( FrameArena.GetUsed() ) );
+	Profiler.AddCounterEntry( frameArenaEntry, true );
+
+	FProfileTimeEntry frameArenaPeakEntry = FProfileTimeEntry( "Frame Arena (High Water Mark)", static_cast<int64_t>( FrameArena.GetHighWaterMark() ) );
+	Profiler.AddCounterEntry( frameArenaPeakEntry, true );
+
 	UI::SetCamera( Camera );
 
 	// Clean up render passes.
 	Passes.clear();
 }
 
+void CRenderer::SetDynamicResolution( const bool Enable )
+{
+	DynamicResolution.Enabled = Enable;
+}
+
 void CRenderer::SetUniformBuffer( const std::string& Name, const Vector4D& Value )
 {
 	GlobalUniformBuffers.insert_or_assign( Name, Value );
@@ -506,6 +677,247 @@ void CRenderer::AddRenderPass( CRenderPass* Pass, ERenderPassLocation::Type Loca
 	Passes.emplace_back( RenderPass );
 }
 
+static FBounds TransformBounds( const FBounds& Bounds, const glm::mat4& Matrix )
+{
+	const glm::vec3 Minimum = Math::ToGLM( Bounds.Minimum );
+	const glm::vec3 Maximum = Math::ToGLM( Bounds.Maximum );
+	const glm::vec3 Center = ( Minimum + Maximum ) * 0.5f;
+	const glm::vec3 Extent = ( Maximum - Minimum ) * 0.5f;
+
+	const glm::vec3 WorldCenter = Matrix * glm::vec4( Center, 1.0f );
+
+	// Project the extent onto the world axes to get a box that encloses the rotated box.
+	glm::vec3 WorldExtent;
+	for( int Axis = 0; Axis < 3; Axis++ )
+	{
+		WorldExtent[Axis] =
+			fabs( Matrix[0][Axis] ) * Extent[0] +
+			fabs( Matrix[1][Axis] ) * Extent[1] +
+			fabs( Matrix[2][Axis] ) * Extent[2];
+	}
+
+	FBounds WorldBounds;
+	WorldBounds.Minimum = Math::FromGLM( WorldCenter - WorldExtent );
+	WorldBounds.Maximum = Math::FromGLM( WorldCenter + WorldExtent );
+	return WorldBounds;
+}
+
+int64_t CRenderer::CullRenderables( const std::vector<CRenderable*>& Queue, std::vector<CRenderable*>& Visible ) const
+{
+	const FFrustum& Frustum = Camera.GetFrustum();
+
+	Visible.clear();
+	for( auto Renderable : Queue )
+	{
+		CMesh* Mesh = Renderable->GetMesh();
+		if( Mesh )
+		{
+			FRenderDataInstanced& RenderData = Renderable->GetRenderData();
+			const FBounds WorldBounds = TransformBounds( Mesh->GetBounds(), RenderData.Transform.GetTransformationMatrix() );
+			if( !Frustum.Contains( WorldBounds ) )
+			{
+				continue;
+			}
+		}
+
+		Visible.emplace_back( Renderable );
+	}
+
+	return static_cast<int64_t>( Queue.size() - Visible.size() );
+}
+
+int64_t CRenderer::OccludeRenderables()
+{
+	OcclusionBuffer.Clear( Camera.GetProjectionMatrix() * Camera.GetViewMatrix() );
+
+	std::vector<CRenderable*>* Lists[] = { &VisibleRenderables, &VisibleDynamicRenderables };
+
+	size_t Occluders = 0;
+	for( auto List : Lists )
+	{
+		for( auto Renderable : *List )
+		{
+			CMesh* Mesh = Renderable->GetMesh();
+			if( Mesh && Renderable->IsOccluder() )
+			{
+				OcclusionBuffer.Rasterize( Mesh, Renderable->GetRenderData().Transform.GetTransformationMatrix() );
+				Occluders++;
+			}
+		}
+	}
+
+	if( Occluders == 0 )
+		return 0;
+
+	OcclusionBuffer.BuildHierarchy();
+
+	int64_t Occluded = 0;
+	for( auto List : Lists )
+	{
+		const size_t Size = List->size();
+		auto Hidden = std::remove_if( List->begin(), List->end(), [this] ( CRenderable* Renderable )
+		{
+			CMesh* Mesh = Renderable->GetMesh();
+			if( !Mesh || Renderable->IsOccluder() )
+				return false;
+
+			const FBounds WorldBounds = TransformBounds( Mesh->GetBounds(), Renderable->GetRenderData().Transform.GetTransformationMatrix() );
+			return !OcclusionBuffer.IsVisible( WorldBounds );
+		} );
+
+		List->erase( Hidden, List->end() );
+		Occluded += static_cast<int64_t>( Size - List->size() );
+	}
+
+	return Occluded;
+}
+
+// Projected size below which a level of detail is used, as a fraction of the viewport height.
+static float LevelOfDetailThreshold( const uint32_t Level )
+{
+	return LevelOfDetailScale * 0.5f / static_cast<float>( 1 << Level );
+}
+
+int64_t CRenderer::SelectLevelsOfDetail( std::vector<CRenderable*>& Queue ) const
+{
+	const FCameraSetup& CameraSetup = Camera.GetCameraSetup();
+	const float ProjectionScale = Camera.GetProjectionMatrix()[1][1];
+
+	int64_t Reduced = 0;
+	for( auto Renderable : Queue )
+	{
+		CMesh* Mesh = Renderable->GetMesh();
+		if( !Mesh )
+			continue;
+
+		FRenderDataInstanced& RenderData = Renderable->GetRenderData();
+		const uint32_t Levels = Mesh->GetLevelOfDetailCount();
+		if( Levels < 2 )
+		{
+			RenderData.LevelOfDetail = 0;
+			continue;
+		}
+
+		const FBounds WorldBounds = TransformBounds( Mesh->GetBounds(), RenderData.Transform.GetTransformationMatrix() );
+		const Vector3D Center = ( WorldBounds.Minimum + WorldBounds.Maximum ) * 0.5f;
+		const float Radius = ( WorldBounds.Maximum - WorldBounds.Minimum ).Length() * 0.5f;
+		const float Distance = ( Center - CameraSetup.CameraPosition ).Length();
+
+		uint32_t Level = 0;
+		if( Distance > Radius )
+		{
+			const float ScreenSize = Radius * ProjectionScale / Distance;
+
+			// Step from the current level so that a level only changes once the size is past its threshold by a margin.
+			Level = std::min( RenderData.LevelOfDetail, Levels - 1 );
+			while( Level + 1 < Levels && ScreenSize < LevelOfDetailThreshold( Level + 1 ) * ( 1.0f - LevelOfDetailHysteresis ) )
+			{
+				Level++;
+			}
+
+			while( Level > 0 && ScreenSize > LevelOfDetailThreshold( Level ) * ( 1.0f + LevelOfDetailHysteresis ) )
+			{
+				Level--;
+			}
+		}
+
+		RenderData.LevelOfDetail = Level;
+		if( Level > 0 )
+		{
+			Reduced++;
+		}
+	}
+
+	return Reduced;
+}
+
+// Least significant digit radix sort, 8 bits per pass.
+static void RadixSort( std::vector<FRenderSortEntry>& Entries, std::vector<FRenderSortEntry>& Scratch )
+{
+	static const uint32_t RadixBits = 8;
+	static const uint32_t Buckets = 1 << RadixBits;
+	static const uint32_t Passes = 64 / RadixBits;
+
+	const size_t Count = Entries.size();
+	Scratch.resize( Count );
+
+	size_t Histograms[Passes][Buckets];
+	memset( Histograms, 0, sizeof( Histograms ) );
+
+	// Gather the histograms of every digit in a single sweep.
+	for( size_t Index = 0; Index < Count; Index++ )
+	{
+		const uint64_t Key = Entries[Index].Key;
+		for( uint32_t Pass = 0; Pass < Passes; Pass++ )
+		{
+			Histograms[Pass][( Key >> ( Pass * RadixBits ) ) & ( Buckets - 1 )]++;
+		}
+	}
+
+	FRenderSortEntry* Source = Entries.data();
+	FRenderSortEntry* Target = Scratch.data();
+
+	for( uint32_t Pass = 0; Pass < Passes; Pass++ )
+	{
+		size_t* Histogram = Histograms[Pass];
+		const uint32_t Shift = Pass * RadixBits;
+
+		// Skip digits that are identical for every key.
+		if( Histogram[( Source[0].Key >> Shift ) & ( Buckets - 1 )] == Count )
+			continue;
+
+		size_t Offset = 0;
+		for( uint32_t Bucket = 0; Bucket < Buckets; Bucket++ )
+		{
+			const size_t BucketSize = Histogram[Bucket];
+			Histogram[Bucket] = Offset;
+			Offset += BucketSize;
+		}
+
+		for( size_t Index = 0; Index < Count; Index++ )
+		{
+			const size_t Bucket = ( Source[Index].Key >> Shift ) & ( Buckets - 1 );
+			Target[Histogram[Bucket]++] = Source[Index];
+		}
+
+		std::swap( Source, Target );
+	}
+
+	if( Source != Entries.data() )
+	{
+		memcpy( Entries.data(), Source, Count * sizeof( FRenderSortEntry ) );
+	}
+}
+
+void CRenderer::SortRenderables( std::vector<CRenderable*>& Queue )
+{
+	if( Queue.size() < 2 )
+		return;
+
+	const FCameraSetup& CameraSetup = Camera.GetCameraSetup();
+
+	SortEntries.clear();
+	for( size_t Index = 0; Index < Queue.size(); Index++ )
+	{
+		Queue[Index]->UpdateSortKey( CameraSetup );
+
+		FRenderSortEntry Entry;
+		Entry.Key = Queue[Index]->GetSortKey();
+		Entry.Index = static_cast<uint32_t>( Index );
+		SortEntries.emplace_back( Entry );
+	}
+
+	RadixSort( SortEntries, SortScratch );
+
+	SortedRenderables.clear();
+	for( auto& Entry : SortEntries )
+	{
+		SortedRenderables.emplace_back( Queue[Entry.Index] );
+	}
+
+	Queue.swap( SortedRenderables );
+}
+
 void CRenderer::RefreshShaderHandle( CRenderable* Renderable )
 {
 	CShader* Shader = Renderable->GetShader();
@@ -514,9 +926,5 @@ void CRenderer::RefreshShaderHandle( CRenderable* Renderable )
 		Shader = DefaultShader;
 	}
 
-	const FProgramHandles& Handles = Shader->GetHandles();
-	if( Handles.Program != ProgramHandle )
-	{
-		ProgramHandle = Shader->Activate();
-	}
+	Shader->Activate();
 }
@@ -4,10 +4,14 @@
 #include <vector>
 #include <unordered_map>
 
+#include <Engine/Display/Rendering/OcclusionBuffer.h>
+#include <Engine/Display/Rendering/RenderGraph.h>
 #include <Engine/Display/Rendering/RenderPass.h>
 
 #include "Camera.h"
 
+#include <Engine/Utility/FrameArena.h>
+
 class CMesh;
 class CShader;
 class CRenderable;
@@ -29,6 +33,12 @@ struct FRenderPass
 	CRenderPass* Pass;
 };
 
+struct FRenderSortEntry
+{
+	uint64_t Key;
+	uint32_t Index;
+};
+
 class CRenderer
 {
 public:
@@ -40,10 +50,19 @@ public:
 
 	void QueueRenderable( CRenderable* Renderable );
 	void QueueDynamicRenderable( CRenderable* Renderable );
+
+	// Creates a dynamic renderable in the frame arena and queues it, it is released by RefreshFrame.
+	CRenderable* EmplaceDynamicRenderable();
+
+	// Transient memory that is reset by RefreshFrame.
+	CFrameArena& GetFrameArena();
 	void DrawQueuedRenderables();
 
 	void SetUniformBuffer( const std::string& Name, const Vector4D& Value );
 
+	// Overrides the dynamicresolution setting, the render scale stays fixed while it is disabled.
+	void SetDynamicResolution( const bool Enable );
+
 	const CCamera& GetCamera() const;
 	void SetCamera( const CCamera& CameraIn );
 	void SetViewport( int& Width, int& Height );
@@ -59,10 +78,33 @@ protected:
 	void RefreshShaderHandle( CRenderable* Renderable );
 
 private:
+	// Collects renderables that intersect the camera frustum, returns the amount that was culled.
+	int64_t CullRenderables( const std::vector<CRenderable*>& Queue, std::vector<CRenderable*>& Visible ) const;
+
+	// Removes renderables that are hidden behind occluders from the visible lists, returns the amount that was culled.
+	int64_t OccludeRenderables();
+
+	// Picks a level of detail for every renderable from its projected size, returns the amount that doesn't use full detail.
+	int64_t SelectLevelsOfDetail( std::vector<CRenderable*>& Queue ) const;
+
+	// Orders renderables by their packed sort keys.
+	void SortRenderables( std::vector<CRenderable*>& Queue );
+
 	std::vector<CRenderable*> Renderables;
 	std::vector<CRenderable*> DynamicRenderables;
+	std::vector<CRenderable*> VisibleRenderables;
+	std::vector<CRenderable*> VisibleDynamicRenderables;
+	std::vector<CRenderable*> SortedRenderables;
+	std::vector<FRenderSortEntry> SortEntries;
+	std::vector<FRenderSortEntry> SortScratch;
 	std::unordered_map<std::string, Vector4D> GlobalUniformBuffers;
 
+	CFrameArena FrameArena;
+	COcclusionBuffer OcclusionBuffer;
+
+	// Rebuilt every frame from the main pass and the render passes that were added.
+	CRenderGraph RenderGraph;
+
 	CCamera Camera;
 	
 	int ViewportWidth;
@@ -1,27 +1,275 @@
 // Copyright  2017, Christiaan Bakker, All rights reserved.
 #include "Shader.h"
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Display/Rendering/UniformBuffer.h>
+#include <Engine/Configuration/Configuration.h>
+#include <Engine/Display/Window.h>
 #include <Engine/Profiling/Logging.h>
-
+#include <Engine/Utility/Timer.h>
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 
 #define AutoReload 0
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Counted per thread so that recording on worker threads doesn't contend on a shared counter.
+static thread_local int64_t UniformLookups = 0;
+static std::atomic<int64_t> SubmittedUniformLookups( 0 );
+
+static const char* ProgramCacheDirectory = "Cache/Shaders/";
+
+// Programs are only created on the thread that owns the context.
+static int64_t ProgramLoadTime = 0;
+static uint32_t CompiledPrograms = 0;
+static uint32_t CachedPrograms = 0;
+
+namespace EShaderCompilation
+{
+	enum Type
+	{
+		Immediate = 0,
+
+		// The driver compiles on its own threads, GL_KHR_parallel_shader_compile.
+		Parallel,
+
+		// Compiled on a worker thread that uses the shared thread context.
+		Worker
+	};
+}
+
+// Include files with their nested includes expanded, shared by every shader that includes them.
+struct FInclude
+{
+	std::string Source;
+
+	// The include itself and everything it includes, with the modification time each had when it was expanded.
+	std::unordered_map<std::string, time_t> Files;
+};
+
+static std::unordered_map<std::string, FInclude> IncludeCache;
+
+// Maps every file that shaders were processed from to those shaders.
+static std::unordered_map<std::string, std::unordered_set<CShader*>> Dependents;
+
+static const uint32_t MaximumIncludeDepth = 16;
+
+static time_t GetModificationTime( const std::string& Location )
+{
+	struct stat Statistics;
+	return stat( Location.c_str(), &Statistics ) == 0 ? Statistics.st_mtime : 0;
+}
+
+// Resolves an #include "File" directive to its location in the shader directory.
+static bool ParseInclude( const std::string& Line, std::string& Location )
+{
+	std::stringstream Stream( Line );
+	std::string Preprocessor;
+	Stream >> Preprocessor;
+
+	if( Preprocessor != "#include" )
+		return false;
+
+	std::string Path;
+	Stream >> Path;
+
+	if( Path.length() < 2 )
+		return false;
+
+	Location = "Shaders/" + Path.substr( 1, Path.length() - 2 );
+	return true;
+}
+
+static const FInclude* LoadInclude( const std::string& Location, const uint32_t Depth = 0 )
+{
+	auto Iterator = IncludeCache.find( Location );
+	if( Iterator != IncludeCache.end() )
+	{
+		bool Current = true;
+		for( auto& File : Iterator->second.Files )
+		{
+			if( GetModificationTime( File.first ) != File.second )
+			{
+				Current = false;
+				break;
+			}
+		}
+
+		if( Current )
+			return &Iterator->second;
+	}
+
+	if( Depth > MaximumIncludeDepth )
+	{
+		Log::Event( Log::Error, "Too many nested includes at \"%s\", does it include itself?\n", Location.c_str() );
+		return nullptr;
+	}
+
+	CFile IncludeSource( Location.c_str() );
+	if( !IncludeSource.Load() )
+		return nullptr;
+
+	FInclude Include;
+	Include.Files.insert_or_assign( Location, IncludeSource.ModificationDate() );
+
+	std::stringstream StringStream;
+	StringStream << IncludeSource.Fetch<char>();
+
+	std::stringstream OutputStream;
+	std::string Line;
+	while( std::getline( StringStream, Line ) )
+	{
+		std::string NestedLocation;
+		if( ParseInclude( Line, NestedLocation ) )
+		{
+			// The cache can grow while loading so the entry is used before loading anything else.
+			const FInclude* Nested = LoadInclude( NestedLocation, Depth + 1 );
+			if( Nested )
+			{
+				OutputStream << "\n" << Nested->Source << "\n";
+				Include.Files.insert( Nested->Files.begin(), Nested->Files.end() );
+			}
+		}
+		else
+		{
+			OutputStream << Line << "\n";
+		}
+	}
+
+	Include.Source = OutputStream.str();
+
+	FInclude& Entry = IncludeCache[Location];
+	Entry = std::move( Include );
+	return &Entry;
+}
+
+static std::vector<CShader*> PendingShaders;
+static CShader* PlaceholderShader = nullptr;
+
+// There is only one thread context so worker compilations take turns.
+static std::mutex ThreadContextLock;
+
+typedef void ( APIENTRYP MaxShaderCompilerThreadsFunction )( GLuint Count );
+
+static EShaderCompilation::Type GetCompilationMode()
+{
+	static bool Initialized = false;
+	static EShaderCompilation::Type Mode = EShaderCompilation::Immediate;
+	if( Initialized )
+		return Mode;
+
+	Initialized = true;
+	if( CConfiguration::Get().GetInteger( "asynchronousshaders", 1 ) < 1 )
+		return Mode;
+
+	const char* ExtensionNames[] = { "GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile" };
+	const char* FunctionNames[] = { "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB" };
+	for( uint32_t Index = 0; Index < 2; Index++ )
+	{
+		if( glfwExtensionSupported( ExtensionNames[Index] ) )
+		{
+			// Let the driver decide how many threads it uses.
+			auto MaxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsFunction>( glfwGetProcAddress( FunctionNames[Index] ) );
+			if( MaxShaderCompilerThreads )
+			{
+				MaxShaderCompilerThreads( 0xFFFFFFFF );
+			}
+
+			Log::Event( "Compiling shaders in parallel using %s.\n", ExtensionNames[Index] );
+			Mode = EShaderCompilation::Parallel;
+			return Mode;
+		}
+	}
+
+	// Without the extension compiles can only move to the worker context, where they still run one at a time.
+	// That only takes them off the main thread, so it has to be asked for.
+	if( CConfiguration::Get().GetInteger( "workershadercompilation", 0 ) > 0 && CWindow::ThreadContext( false ) )
+	{
+		Log::Event( "Compiling shaders on a worker context.\n" );
+		Mode = EShaderCompilation::Worker;
+	}
+
+	return Mode;
+}
+
+static GLuint CreateProgram( const GLuint VertexShader, const GLuint FragmentShader, const bool Retrievable )
+{
+	GLuint ProgramHandle = glCreateProgram();
+
+	// Attach shaders to program
+	glAttachShader( ProgramHandle, VertexShader );
+	glAttachShader( ProgramHandle, FragmentShader );
+
+	// Only programs that will be written to the cache should ask the driver to keep their binary around.
+	if( Retrievable )
+	{
+		glProgramParameteri( ProgramHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+	}
+
+	// Link and set program to use
+	glLinkProgram( ProgramHandle );
+
+	return ProgramHandle;
+}
+
 CShader::CShader()
 {
 	BlendMode = EBlendMode::Opaque;
 	DepthMask = EDepthMask::Write;
 	DepthTest = EDepthTest::Less;
+
+	Instancing = false;
+	InstancedVariant = nullptr;
+
+	Asynchronous = false;
+	Pending = false;
+	PendingProgram = 0;
+
+	ModificationTime = 0;
 }
 
 CShader::~CShader()
 {
+	if( Pending )
+	{
+		PendingShaders.erase( std::remove( PendingShaders.begin(), PendingShaders.end(), this ), PendingShaders.end() );
+
+		if( PendingWork.valid() )
+		{
+			PendingProgram = PendingWork.get();
+		}
+
+		CStateCache::Get().ReleaseProgram( PendingProgram );
+		glDeleteProgram( PendingProgram );
+		glDeleteShader( Handles.VertexShader );
+		glDeleteShader( Handles.FragmentShader );
+	}
 
+	ResetDependencies();
+
+	delete InstancedVariant;
 }
 
 bool CShader::Load( bool ShouldLink )
 {
 	if( VertexLocation.length() > 0 && FragmentLocation.length() > 0 )
 	{
+		ResetDependencies();
+
 		const bool LoadedVertexShader = Load( VertexLocation.c_str(), Handles.VertexShader, EShaderType::Vertex );
 		const bool LoadedFragmentShader = Load( FragmentLocation.c_str(), Handles.FragmentShader, EShaderType::Fragment );
 
@@ -29,7 +277,7 @@ bool CShader::Load( bool ShouldLink )
 		{
 			Link();
 
-			return Handles.Program != 0;
+			return Handles.Program != 0 || Pending;
 		}
 	}
 
@@ -50,6 +298,8 @@ bool CShader::Load( const char* FileLocation, bool ShouldLink )
 	VertexLocation = VertexPath.str();
 	FragmentLocation = FragmentPath.str();
 
+	ResetDependencies();
+
 	const bool LoadedVertexShader = Load( VertexPath.str().c_str(), Handles.VertexShader, EShaderType::Vertex );
 	const bool LoadedFragmentShader = Load( FragmentPath.str().c_str(), Handles.FragmentShader, EShaderType::Fragment );
 
@@ -57,7 +307,7 @@ bool CShader::Load( const char* FileLocation, bool ShouldLink )
 	{
 		Link();
 
-		return Handles.Program != 0;
+		return Handles.Program != 0 || Pending;
 	}
 
 	return false;
@@ -77,6 +327,8 @@ bool CShader::Load( const char* VertexLocationIn, const char* FragmentLocationIn
 	VertexLocation = VertexPath.str();
 	FragmentLocation = FragmentPath.str();
 
+	ResetDependencies();
+
 	const bool LoadedVertexShader = Load( VertexPath.str().c_str(), Handles.VertexShader, EShaderType::Vertex );
 	const bool LoadedFragmentShader = Load( FragmentPath.str().c_str(), Handles.FragmentShader, EShaderType::Fragment );
 
@@ -84,7 +336,7 @@ bool CShader::Load( const char* VertexLocationIn, const char* FragmentLocationIn
 	{
 		Link();
 
-		return Handles.Program != 0;
+		return Handles.Program != 0 || Pending;
 	}
 
 	return false;
@@ -99,10 +351,21 @@ bool CShader::Load( const char* FileLocation, GLuint& HandleIn, EShaderType Shad
 
 	if( Loaded )
 	{
+		AddDependency( ShaderSource.Location(), ShaderSource.ModificationDate() );
+
 		std::string Data = Process( ShaderSource );
 		const char* ShaderData = Data.c_str();
 		if( ShaderData )
 		{
+			if( ShaderType == EShaderType::Vertex )
+			{
+				VertexSource = Data;
+			}
+			else if( ShaderType == EShaderType::Fragment )
+			{
+				FragmentSource = Data;
+			}
+
 			GLuint ShaderTypeGL = static_cast<GLuint>( ShaderType );
 
 			HandleIn = glCreateShader( ShaderTypeGL );
@@ -117,10 +380,23 @@ bool CShader::Load( const char* FileLocation, GLuint& HandleIn, EShaderType Shad
 
 bool CShader::Reload()
 {
+	if( Pending )
+		return false;
+
 	Log::Event( "Recompiling \"%s\"...\n", FragmentLocation.c_str() );
 	return Load();
 }
 
+void CShader::SetAsynchronous( const bool AsynchronousIn )
+{
+	Asynchronous = AsynchronousIn;
+}
+
+bool CShader::IsReady() const
+{
+	return Handles.Program != 0;
+}
+
 GLuint CShader::Activate()
 {
 #if AutoReload == 1
@@ -133,7 +409,7 @@ GLuint CShader::Activate()
 	}
 #endif
 
-	glUseProgram( Handles.Program );
+	CStateCache::Get().UseProgram( Handles.Program );
 
 	return Handles.Program;
 }
@@ -158,6 +434,92 @@ const EDepthTest::Type& CShader::GetDepthTest() const
 	return DepthTest;
 }
 
+CShader* CShader::GetInstancedVariant() const
+{
+	return InstancedVariant && InstancedVariant->IsReady() ? InstancedVariant : nullptr;
+}
+
+GLint CShader::GetUniformLocation( const EUniform::Type& Uniform ) const
+{
+	UniformLookups++;
+	return Locations.Uniforms[Uniform];
+}
+
+GLint CShader::GetUniformLocation( const ETextureSlot& Slot ) const
+{
+	UniformLookups++;
+	return Locations.Textures[static_cast<ETextureSlotType>( Slot )];
+}
+
+GLint CShader::GetUniformLocation( const std::string& Name ) const
+{
+	UniformLookups++;
+
+	auto Iterator = Locations.Named.find( Name );
+	if( Iterator != Locations.Named.end() )
+	{
+		return Iterator->second;
+	}
+
+	return -1;
+}
+
+uint32_t CShader::GetTextureArrays() const
+{
+	return Locations.TextureArrays;
+}
+
+int64_t CShader::FlushUniformLookups()
+{
+	SubmitUniformLookups();
+	return SubmittedUniformLookups.exchange( 0 );
+}
+
+void CShader::SubmitUniformLookups()
+{
+	SubmittedUniformLookups += UniformLookups;
+	UniformLookups = 0;
+}
+
+void CShader::LogLoadTime()
+{
+	if( CompiledPrograms == 0 && CachedPrograms == 0 )
+		return;
+
+	Log::Event( "Created %u shader programs in %.2fms (%u compiled, %u from the program cache).\n", CompiledPrograms + CachedPrograms, static_cast<double>( ProgramLoadTime ) / 1000.0, CompiledPrograms, CachedPrograms );
+
+	ProgramLoadTime = 0;
+	CompiledPrograms = 0;
+	CachedPrograms = 0;
+}
+
+void CShader::Update()
+{
+	for( size_t Index = 0; Index < PendingShaders.size(); )
+	{
+		// Finished shaders can submit their instanced variant, which is appended and checked later in this loop.
+		if( PendingShaders[Index]->Finish() )
+		{
+			PendingShaders[Index] = PendingShaders.back();
+			PendingShaders.pop_back();
+		}
+		else
+		{
+			Index++;
+		}
+	}
+}
+
+void CShader::SetPlaceholder( CShader* Shader )
+{
+	PlaceholderShader = Shader;
+}
+
+CShader* CShader::GetPlaceholder()
+{
+	return PlaceholderShader;
+}
+
 bool LogShaderCompilationErrors( GLuint v )
 {
 	GLint ByteLength = 0;
@@ -210,6 +572,13 @@ std::string CShader::Process(const CFile& File)
 
 	std::stringstream OutputStream;
 
+	// Sources that omit the #version directive get the definitions at the top.
+	const bool HasVersion = strstr( ShaderData, "#version" ) != nullptr;
+	if( !HasVersion )
+	{
+		OutputStream << Defines;
+	}
+
 	std::string Line;
 	while( std::getline( StringStream, Line ) )
 	{
@@ -220,23 +589,25 @@ std::string CShader::Process(const CFile& File)
 			std::string Preprocessor;
 			Stream >> Preprocessor;
 
-			if( Preprocessor == "#include" )
+			if( Preprocessor == "#version" )
+			{
+				OutputStream << Line << "\n" << Defines;
+				bParsed = true;
+			}
+			else if( Preprocessor == "#include" )
 			{
-				std::string Path;
-				Stream >> Path;
-
-				Path = Path.substr(1, Path.length() - 2);
 				bParsed = true;
 
-				std::stringstream ShaderPath;
-				ShaderPath << "Shaders/" << Path;
-				CFile IncludeSource( ShaderPath.str().c_str() );
-				const bool Loaded = IncludeSource.Load();
-
-				if( Loaded )
+				std::string Location;
+				const FInclude* Include = ParseInclude( Line, Location ) ? LoadInclude( Location ) : nullptr;
+				if( Include )
 				{
-					const char* IncludeData = IncludeSource.Fetch<char>();
-					OutputStream << "\n" << IncludeData << "\n";
+					for( auto& File : Include->Files )
+					{
+						AddDependency( File.first, File.second );
+					}
+
+					OutputStream << "\n" << Include->Source << "\n";
 				}
 			}
 			else if( Preprocessor == "#blendmode" )
@@ -311,6 +682,34 @@ std::string CShader::Process(const CFile& File)
 					DepthTest = EDepthTest::Always;
 				}
 
+				bParsed = true;
+			}
+			else if( Preprocessor == "#instancing" )
+			{
+				std::string Mode;
+				Stream >> Mode;
+
+				Instancing = Mode != "0";
+
+				bParsed = true;
+			}
+			else if( Preprocessor == "#global" )
+			{
+				std::string Name;
+				Stream >> Name;
+
+				// Globals are read from the FrameData block, which the shader has to declare before using them.
+				const int32_t Index = CUniformBuffer::GetGlobalIndex( Name );
+				if( Index > -1 )
+				{
+					OutputStream << "#define " << Name << " Globals[" << Index << "]\n";
+				}
+				else
+				{
+					Log::Event( Log::Warning, "Out of frame globals, \"%s\" falls back to a loose uniform.\n", Name.c_str() );
+					OutputStream << "uniform vec4 " << Name << ";\n";
+				}
+
 				bParsed = true;
 			}
 		}
@@ -324,6 +723,54 @@ std::string CShader::Process(const CFile& File)
 	return OutputStream.str();
 }
 
+void CShader::ResetDependencies()
+{
+	for( auto& Dependency : Dependencies )
+	{
+		auto Iterator = Dependents.find( Dependency.first );
+		if( Iterator != Dependents.end() )
+		{
+			Iterator->second.erase( this );
+		}
+	}
+
+	Dependencies.clear();
+}
+
+void CShader::AddDependency( const std::string& Location, const time_t ModificationTimeIn )
+{
+	Dependencies.insert_or_assign( Location, ModificationTimeIn );
+
+	// Variants are recreated by the shader they belong to.
+	if( Defines.empty() )
+	{
+		Dependents[Location].insert( this );
+	}
+}
+
+std::vector<CShader*> CShader::GetOutdated()
+{
+	// Every file is checked once, no matter how many shaders use it.
+	std::unordered_set<CShader*> Outdated;
+	for( auto& Dependent : Dependents )
+	{
+		if( Dependent.second.empty() )
+			continue;
+
+		const time_t FileModificationTime = GetModificationTime( Dependent.first );
+		for( auto Shader : Dependent.second )
+		{
+			auto Iterator = Shader->Dependencies.find( Dependent.first );
+			if( Iterator != Shader->Dependencies.end() && Iterator->second != FileModificationTime )
+			{
+				Outdated.insert( Shader );
+			}
+		}
+	}
+
+	return std::vector<CShader*>( Outdated.begin(), Outdated.end() );
+}
+
 GLuint CShader::Link()
 {
 	if( Handles.VertexShader == 0 || Handles.FragmentShader == 0 )
@@ -332,6 +779,55 @@ GLuint CShader::Link()
 		return 0;
 	}
 
+	CTimer LoadTimer;
+	LoadTimer.Start();
+
+	const std::string CacheLocation = GetProgramCacheLocation();
+	const bool Cached = LoadProgramBinary( CacheLocation );
+	if( Cached )
+	{
+		// The shader objects were only created to process their sources.
+		glDeleteShader( Handles.VertexShader );
+		glDeleteShader( Handles.FragmentShader );
+
+		CachedPrograms++;
+	}
+	else if( Asynchronous && Submit( CacheLocation ) )
+	{
+		LoadTimer.Stop();
+		ProgramLoadTime += LoadTimer.GetElapsedTimeMicroseconds();
+		CompiledPrograms++;
+
+		// The current program, if any, stays in use until Finish replaces it.
+		return Handles.Program;
+	}
+	else
+	{
+		if( Compile( !CacheLocation.empty() ) == 0 )
+		{
+			return 0;
+		}
+
+		SaveProgramBinary( CacheLocation );
+
+		CompiledPrograms++;
+	}
+
+	LoadTimer.Stop();
+	ProgramLoadTime += LoadTimer.GetElapsedTimeMicroseconds();
+
+	Reflect();
+
+	if( Instancing && Defines.empty() )
+	{
+		CreateInstancedVariant();
+	}
+
+	return Handles.Program;
+}
+
+GLuint CShader::Compile( const bool Retrievable )
+{
 	// Compile all shaders
 	bool ShaderCompiled = false;
 	bool Debugger = false;
@@ -365,14 +861,7 @@ GLuint CShader::Link()
 	}
 
 	// Create the program
-	GLuint ProgramHandle = glCreateProgram();
-
-	// Attach shaders to program
-	glAttachShader( ProgramHandle, Handles.VertexShader );
-	glAttachShader( ProgramHandle, Handles.FragmentShader );
-
-	// Link and set program to use
-	glLinkProgram( ProgramHandle );
+	GLuint ProgramHandle = CreateProgram( Handles.VertexShader, Handles.FragmentShader, Retrievable );
 
 	const bool HasErrorsProgram = LogProgramCompilationErrors( ProgramHandle );
 
@@ -381,10 +870,343 @@ GLuint CShader::Link()
 
 	if( HasErrorsProgram )
 	{
+		CStateCache::Get().ReleaseProgram( ProgramHandle );
+		glDeleteProgram( ProgramHandle );
 		return 0;
 	}
 
-	Handles.Program = ProgramHandle;
+	ReplaceProgram( ProgramHandle );
 
 	return ProgramHandle;
 }
+
+bool CShader::Submit( const std::string& CacheLocation )
+{
+	const EShaderCompilation::Type Mode = GetCompilationMode();
+	if( Mode == EShaderCompilation::Immediate )
+		return false;
+
+	const bool Retrievable = !CacheLocation.empty();
+	if( Mode == EShaderCompilation::Parallel )
+	{
+		// None of these wait for the driver, the completion status is polled in Finish.
+		glCompileShader( Handles.VertexShader );
+		glCompileShader( Handles.FragmentShader );
+		PendingProgram = CreateProgram( Handles.VertexShader, Handles.FragmentShader, Retrievable );
+	}
+	else
+	{
+		// The worker context only sees the shader sources once this context has submitted them.
+		GLsync SourceFence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		glFlush();
+
+		const GLuint VertexShader = Handles.VertexShader;
+		const GLuint FragmentShader = Handles.FragmentShader;
+		PendingWork = std::async( std::launch::async, [VertexShader, FragmentShader, SourceFence, Retrievable] () {
+			std::lock_guard<std::mutex> Lock( ThreadContextLock );
+			CWindow::ThreadContext();
+
+			glClientWaitSync( SourceFence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED );
+			glDeleteSync( SourceFence );
+
+			glCompileShader( VertexShader );
+			glCompileShader( FragmentShader );
+			const GLuint ProgramHandle = CreateProgram( VertexShader, FragmentShader, Retrievable );
+
+			// The program has to be complete before the main context can use it.
+			glFinish();
+			glfwMakeContextCurrent( nullptr );
+
+			return ProgramHandle;
+		} );
+	}
+
+	PendingCacheLocation = CacheLocation;
+	Pending = true;
+	PendingShaders.emplace_back( this );
+
+	return true;
+}
+
+bool CShader::Finish()
+{
+	if( PendingWork.valid() )
+	{
+		if( PendingWork.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+			return false;
+
+		PendingProgram = PendingWork.get();
+	}
+	else
+	{
+		GLint Completed = GL_FALSE;
+		glGetProgramiv( PendingProgram, GL_COMPLETION_STATUS_KHR, &Completed );
+		if( Completed == GL_FALSE )
+			return false;
+	}
+
+	Pending = false;
+
+	const bool HasErrorsVS = LogShaderCompilationErrors( Handles.VertexShader );
+	const bool HasErrorsFS = LogShaderCompilationErrors( Handles.FragmentShader );
+
+	GLint Linked = GL_FALSE;
+	glGetProgramiv( PendingProgram, GL_LINK_STATUS, &Linked );
+
+	glDeleteShader( Handles.VertexShader );
+	glDeleteShader( Handles.FragmentShader );
+
+	if( HasErrorsVS || HasErrorsFS || Linked != GL_TRUE )
+	{
+		LogProgramCompilationErrors( PendingProgram );
+		Log::Event( Log::Error, "Failed to compile shader \"%s\".\n", FragmentLocation.c_str() );
+
+		CStateCache::Get().ReleaseProgram( PendingProgram );
+		glDeleteProgram( PendingProgram );
+		PendingProgram = 0;
+		return true;
+	}
+
+	ReplaceProgram( PendingProgram );
+	PendingProgram = 0;
+
+	Reflect();
+	SaveProgramBinary( PendingCacheLocation );
+
+	if( Instancing && Defines.empty() )
+	{
+		CreateInstancedVariant();
+	}
+
+	return true;
+}
+
+// 64-bit FNV-1a.
+static uint64_t HashString( uint64_t Hash, const char* String )
+{
+	if( !String )
+		return Hash;
+
+	for( ; *String != '\0'; String++ )
+	{
+		Hash ^= static_cast<uint8_t>( *String );
+		Hash *= 1099511628211ull;
+	}
+
+	return Hash;
+}
+
+std::string CShader::GetProgramCacheLocation() const
+{
+	if( CConfiguration::Get().GetInteger( "shadercache", 1 ) < 1 )
+		return std::string();
+
+	if( !GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary )
+		return std::string();
+
+	// Drivers without any binary formats can't give us a program to store.
+	GLint Formats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &Formats );
+	if( Formats < 1 )
+		return std::string();
+
+	// Binaries are only valid for the driver that produced them.
+	uint64_t Hash = 14695981039346656037ull;
+	Hash = HashString( Hash, VertexSource.c_str() );
+	Hash = HashString( Hash, FragmentSource.c_str() );
+	Hash = HashString( Hash, reinterpret_cast<const char*>( glGetString( GL_VENDOR ) ) );
+	Hash = HashString( Hash, reinterpret_cast<const char*>( glGetString( GL_RENDERER ) ) );
+	Hash = HashString( Hash, reinterpret_cast<const char*>( glGetString( GL_VERSION ) ) );
+
+	std::stringstream Location;
+	Location << ProgramCacheDirectory << std::hex << std::setw( 16 ) << std::setfill( '0' ) << Hash << ".bin";
+	return Location.str();
+}
+
+bool CShader::LoadProgramBinary( const std::string& CacheLocation )
+{
+	if( CacheLocation.empty() )
+		return false;
+
+	std::ifstream Stream( CacheLocation.c_str(), std::ios::in | std::ios::binary );
+	if( Stream.fail() )
+		return false;
+
+	GLenum Format = 0;
+	Stream.read( reinterpret_cast<char*>( &Format ), sizeof( Format ) );
+
+	std::vector<char> Binary( ( std::istreambuf_iterator<char>( Stream ) ), std::istreambuf_iterator<char>() );
+	if( Binary.empty() )
+		return false;
+
+	const GLuint ProgramHandle = glCreateProgram();
+	glProgramBinary( ProgramHandle, Format, Binary.data(), static_cast<GLsizei>( Binary.size() ) );
+
+	// Drivers reject binaries they no longer understand, in which case we compile from source.
+	GLint Status = GL_FALSE;
+	glGetProgramiv( ProgramHandle, GL_LINK_STATUS, &Status );
+	if( Status != GL_TRUE )
+	{
+		Log::Event( Log::Warning, "Cached program binary of \"%s\" was rejected, recompiling.\n", FragmentLocation.c_str() );
+
+		CStateCache::Get().ReleaseProgram( ProgramHandle );
+		glDeleteProgram( ProgramHandle );
+		return false;
+	}
+
+	ReplaceProgram( ProgramHandle );
+	return true;
+}
+
+void CShader::ReplaceProgram( const GLuint ProgramHandle )
+{
+	if( Handles.Program != 0 && Handles.Program != ProgramHandle )
+	{
+		CStateCache::Get().ReleaseProgram( Handles.Program );
+		glDeleteProgram( Handles.Program );
+	}
+
+	Handles.Program = ProgramHandle;
+}
+
+void CShader::SaveProgramBinary( const std::string& CacheLocation ) const
+{
+	if( CacheLocation.empty() || Handles.Program == 0 )
+		return;
+
+	GLint Length = 0;
+	glGetProgramiv( Handles.Program, GL_PROGRAM_BINARY_LENGTH, &Length );
+	if( Length < 1 )
+		return;
+
+	std::vector<char> Binary( Length );
+	GLenum Format = 0;
+	glGetProgramBinary( Handles.Program, Length, nullptr, &Format, Binary.data() );
+
+	std::error_code Error;
+	std::filesystem::create_directories( ProgramCacheDirectory, Error );
+
+	std::ofstream Stream( CacheLocation.c_str(), std::ios::out | std::ios::binary );
+	if( Stream.fail() )
+	{
+		Log::Event( Log::Warning, "Failed to write program binary \"%s\".\n", CacheLocation.c_str() );
+		return;
+	}
+
+	Stream.write( reinterpret_cast<const char*>( &Format ), sizeof( Format ) );
+	Stream.write( Binary.data(), Binary.size() );
+}
+
+void CShader::CreateInstancedVariant()
+{
+	if( !InstancedVariant )
+	{
+		InstancedVariant = new CShader();
+		InstancedVariant->Defines = "#define INSTANCED 1\n";
+	}
+
+	// A variant that is still compiling is picked up by Update.
+	if( InstancedVariant->Pending )
+		return;
+
+	InstancedVariant->Asynchronous = Asynchronous;
+
+	InstancedVariant->VertexLocation = VertexLocation;
+	InstancedVariant->FragmentLocation = FragmentLocation;
+
+	if( !InstancedVariant->Load() )
+	{
+		Log::Event( Log::Warning, "Failed to compile the instanced variant of \"%s\".\n", FragmentLocation.c_str() );
+
+		delete InstancedVariant;
+		InstancedVariant = nullptr;
+	}
+}
+
+void CShader::Reflect()
+{
+	Locations.Reset();
+
+	if( Handles.Program == 0 )
+		return;
+
+	GLint UniformCount = 0;
+	glGetProgramiv( Handles.Program, GL_ACTIVE_UNIFORMS, &UniformCount );
+
+	GLint MaximumNameLength = 0;
+	glGetProgramiv( Handles.Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &MaximumNameLength );
+
+	if( MaximumNameLength < 1 )
+		return;
+
+	std::unordered_set<std::string> ArraySamplers;
+
+	GLchar* ActiveUniformName = new GLchar[MaximumNameLength];
+	for( GLint UniformIndex = 0; UniformIndex < UniformCount; UniformIndex++ )
+	{
+		GLsizei Length = 0;
+		GLint Size = 0;
+		GLenum Type = 0;
+		glGetActiveUniform( Handles.Program, static_cast<GLuint>( UniformIndex ), MaximumNameLength, &Length, &Size, &Type, ActiveUniformName );
+
+		const GLint Location = glGetUniformLocation( Handles.Program, ActiveUniformName );
+
+		// Uniforms that are part of a uniform block don't have a location.
+		if( Location < 0 )
+			continue;
+
+		// Arrays are reported by their first element, store them by their base name.
+		std::string Name( ActiveUniformName, Length );
+		const size_t Bracket = Name.find( '[' );
+		if( Bracket != std::string::npos )
+		{
+			Name = Name.substr( 0, Bracket );
+		}
+
+		if( Type == GL_SAMPLER_2D_ARRAY )
+		{
+			ArraySamplers.insert( Name );
+		}
+
+		Locations.Named.insert_or_assign( Name, Location );
+	}
+
+	delete[] ActiveUniformName;
+
+	for( uint32_t Index = 0; Index < EUniform::Maximum; Index++ )
+	{
+		auto Iterator = Locations.Named.find( UniformName[Index] );
+		if( Iterator != Locations.Named.end() )
+		{
+			Locations.Uniforms[Index] = Iterator->second;
+		}
+	}
+
+	// Sampler bindings never change so they only have to be assigned once.
+	CStateCache::Get().UseProgram( Handles.Program );
+
+	for( uint32_t Index = 0; Index < TextureSlots; Index++ )
+	{
+		auto Iterator = Locations.Named.find( TextureSlotName[Index] );
+		if( Iterator != Locations.Named.end() )
+		{
+			Locations.Textures[Index] = Iterator->second;
+			glUniform1i( Iterator->second, Index );
+
+			if( ArraySamplers.find( Iterator->first ) != ArraySamplers.end() )
+			{
+				Locations.TextureArrays |= 1u << Index;
+			}
+		}
+	}
+
+	// Connect the shared uniform blocks to their fixed binding points.
+	for( uint32_t Index = 0; Index < EUniformBlock::Maximum; Index++ )
+	{
+		const GLuint BlockIndex = glGetUniformBlockIndex( Handles.Program, UniformBlockName[Index] );
+		if( BlockIndex != GL_INVALID_INDEX )
+		{
+			glUniformBlockBinding( Handles.Program, BlockIndex, Index );
+		}
+	}
+}
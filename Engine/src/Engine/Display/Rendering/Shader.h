@@ -2,8 +2,12 @@
 #pragma once
 
 #include "glad/glad.h"
+#include <future>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include <Engine/Display/Rendering/TextureEnumerators.h>
 #include <Engine/Utility/File.h>
 
 enum class EShaderType : uint16_t
@@ -19,7 +23,8 @@ namespace EBlendMode
 	{
 		Opaque = 0,
 		Alpha,
-		Additive
+		Additive,
+		Maximum
 	};
 }
 
@@ -49,6 +54,78 @@ namespace EDepthTest
 	};
 }
 
+namespace EUniform
+{
+	enum Type
+	{
+		View = 0,
+		Projection,
+		CameraPosition,
+		CameraDirection,
+		ObjectPosition,
+		ObjectBoundsMinimum,
+		ObjectBoundsMaximum,
+		Viewport,
+		Model,
+		ObjectColor,
+		TextureLayers,
+
+		// int, one of EVertexFormat.
+		VertexFormat,
+		Maximum
+	};
+}
+
+static const char* UniformName[EUniform::Maximum] = {
+	"View",
+	"Projection",
+	"CameraPosition",
+	"CameraDirection",
+	"ObjectPosition",
+	"ObjectBoundsMinimum",
+	"ObjectBoundsMaximum",
+	"Viewport",
+	"Model",
+	"ObjectColor",
+	"TextureLayers",
+	"VertexFormat"
+};
+
+// Uniform locations of a linked program, reflected once after linking.
+struct FUniformLocations
+{
+	FUniformLocations()
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		for( uint32_t Index = 0; Index < EUniform::Maximum; Index++ )
+		{
+			Uniforms[Index] = -1;
+		}
+
+		for( uint32_t Index = 0; Index < TextureSlots; Index++ )
+		{
+			Textures[Index] = -1;
+		}
+
+		TextureArrays = 0;
+
+		Named.clear();
+	}
+
+	GLint Uniforms[EUniform::Maximum];
+	GLint Textures[TextureSlots];
+
+	// Slots that are declared as sampler2DArray, these sample texture array pages at the layer given by the TextureLayers uniform.
+	// Instanced variants read the layers from the InstanceLayers attribute instead, so batches can span a page.
+	uint32_t TextureArrays;
+
+	std::unordered_map<std::string, GLint> Named;
+};
+
 struct FProgramHandles
 {
 	FProgramHandles()
@@ -76,25 +153,96 @@ public:
 
 	bool Reload();
 
+	// Asynchronous shaders submit their compilation without waiting for it, they aren't ready until it has finished.
+	void SetAsynchronous( const bool Asynchronous );
+	bool IsReady() const;
+
 	GLuint Activate();
 	const FProgramHandles& GetHandles() const;
 	const EBlendMode::Type& GetBlendMode() const;
 	const EDepthMask::Type& GetDepthMask() const;
 	const EDepthTest::Type& GetDepthTest() const;
 
+	// Variant compiled with INSTANCED defined, only available for shaders that use the #instancing directive.
+	CShader* GetInstancedVariant() const;
+
+	GLint GetUniformLocation( const EUniform::Type& Uniform ) const;
+	GLint GetUniformLocation( const ETextureSlot& Slot ) const;
+	GLint GetUniformLocation( const std::string& Name ) const;
+
+	// Bit mask of the texture slots that sample texture array pages.
+	uint32_t GetTextureArrays() const;
+
+	// Returns the number of cached uniform lookups since the last call.
+	static int64_t FlushUniformLookups();
+
+	// Adds the lookups of the calling thread to the shared total, worker threads call this when they are done.
+	static void SubmitUniformLookups();
+
+	// Logs the time spent creating programs since the last call and how many came from the program cache.
+	static void LogLoadTime();
+
+	// Picks up asynchronous compilations that have finished, has to be called on the main thread.
+	static void Update();
+
+	// Shaders that were processed from a file that changed on disk since, either directly or through an include.
+	static std::vector<CShader*> GetOutdated();
+
+	// Shader that renderables draw with while their own shader isn't ready.
+	static void SetPlaceholder( CShader* Shader );
+	static CShader* GetPlaceholder();
+
 private:
 	std::string Process( const CFile& File );
+	void ResetDependencies();
+	void AddDependency( const std::string& Location, const time_t ModificationTime );
 	GLuint Link();
+	GLuint Compile( const bool Retrievable );
+
+	// Starts compiling without waiting for the result, returns false if there is no way to do so.
+	bool Submit( const std::string& CacheLocation );
+	bool Finish();
+
+	// Program binaries are cached on disk, keyed by the processed sources and the driver that compiled them.
+	std::string GetProgramCacheLocation() const;
+	bool LoadProgramBinary( const std::string& CacheLocation );
+	void SaveProgramBinary( const std::string& CacheLocation ) const;
+
+	// Deletes the current program, if any, before taking ownership of the given one.
+	void ReplaceProgram( const GLuint ProgramHandle );
+
+	void Reflect();
+	void CreateInstancedVariant();
 
 	FProgramHandles Handles;
+	FUniformLocations Locations;
 
 	std::string VertexLocation;
 	std::string FragmentLocation;
 
+	// Sources after include expansion, used to key the program cache.
+	std::string VertexSource;
+	std::string FragmentSource;
+
+	// Every file the sources were processed from and the modification time it had at that point.
+	std::unordered_map<std::string, time_t> Dependencies;
+
 	EBlendMode::Type BlendMode;
 	EDepthMask::Type DepthMask;
 	EDepthTest::Type DepthTest;
 
+	// Definitions injected after the #version directive.
+	std::string Defines;
+
+	bool Instancing;
+	CShader* InstancedVariant;
+
+	bool Asynchronous;
+	bool Pending;
+	GLuint PendingProgram;
+	std::future<GLuint> PendingWork;
+	std::string PendingCacheLocation;
+
 	time_t ModificationTime;
 
 };
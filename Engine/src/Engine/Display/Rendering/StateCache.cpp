@@ -0,0 +1,286 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "StateCache.h"
+
+static const GLuint UnknownHandle = static_cast<GLuint>( -1 );
+
+static const GLenum DepthTestToEnum[EDepthTest::Maximum]
+{
+	GL_NEVER,
+	GL_LESS,
+	GL_EQUAL,
+	GL_LEQUAL,
+	GL_GREATER,
+	GL_NOTEQUAL,
+	GL_GEQUAL,
+	GL_ALWAYS
+};
+
+static const GLenum BufferTargetToEnum[EBufferTarget::Maximum]
+{
+	GL_ARRAY_BUFFER,
+	GL_ELEMENT_ARRAY_BUFFER,
+	GL_UNIFORM_BUFFER,
+	GL_DRAW_INDIRECT_BUFFER
+};
+
+CStateCache::CStateCache()
+{
+	Invalidate();
+
+	Hits = 0;
+	Misses = 0;
+}
+
+void CStateCache::Invalidate()
+{
+	Program = UnknownHandle;
+	VertexArray = UnknownHandle;
+
+	for( uint32_t Index = 0; Index < EBufferTarget::Maximum; Index++ )
+	{
+		Buffers[Index] = UnknownHandle;
+	}
+
+	for( uint32_t Index = 0; Index < TextureSlots; Index++ )
+	{
+		Textures[Index] = UnknownHandle;
+		TextureArrays[Index] = UnknownHandle;
+	}
+
+	ActiveTextureSlot = UnknownHandle;
+
+	BlendMode = EBlendMode::Maximum;
+	DepthMask = EDepthMask::Maximum;
+	DepthTest = EDepthTest::Maximum;
+	Culling = -1;
+}
+
+void CStateCache::UseProgram( GLuint ProgramIn )
+{
+	if( Program == ProgramIn )
+	{
+		Hits++;
+		return;
+	}
+
+	glUseProgram( ProgramIn );
+	Program = ProgramIn;
+	Misses++;
+}
+
+void CStateCache::BindVertexArray( GLuint VertexArrayIn )
+{
+	if( VertexArray == VertexArrayIn )
+	{
+		Hits++;
+		return;
+	}
+
+	glBindVertexArray( VertexArrayIn );
+	VertexArray = VertexArrayIn;
+	Misses++;
+
+	// The element array binding is part of the vertex array object.
+	Buffers[EBufferTarget::ElementArray] = UnknownHandle;
+}
+
+void CStateCache::BindBuffer( GLenum Target, GLuint Buffer )
+{
+	for( uint32_t Index = 0; Index < EBufferTarget::Maximum; Index++ )
+	{
+		if( BufferTargetToEnum[Index] == Target )
+		{
+			if( Buffers[Index] == Buffer )
+			{
+				Hits++;
+				return;
+			}
+
+			Buffers[Index] = Buffer;
+			break;
+		}
+	}
+
+	glBindBuffer( Target, Buffer );
+	Misses++;
+}
+
+void CStateCache::BindTexture( const ETextureSlot& Slot, GLuint Texture )
+{
+	const auto Index = static_cast<ETextureSlotType>( Slot );
+	if( Textures[Index] == Texture )
+	{
+		Hits++;
+		return;
+	}
+
+	SetActiveTextureSlot( Index );
+
+	glBindTexture( GL_TEXTURE_2D, Texture );
+	Textures[Index] = Texture;
+	Misses++;
+}
+
+void CStateCache::BindTexture( GLuint Texture )
+{
+	const ETextureSlotType Index = ActiveTextureSlot != UnknownHandle ? ActiveTextureSlot : 0;
+	BindTexture( static_cast<ETextureSlot>( Index ), Texture );
+}
+
+void CStateCache::BindTextureArray( const ETextureSlot& Slot, GLuint Texture )
+{
+	const auto Index = static_cast<ETextureSlotType>( Slot );
+	if( TextureArrays[Index] == Texture )
+	{
+		Hits++;
+		return;
+	}
+
+	SetActiveTextureSlot( Index );
+
+	glBindTexture( GL_TEXTURE_2D_ARRAY, Texture );
+	TextureArrays[Index] = Texture;
+	Misses++;
+}
+
+void CStateCache::SetActiveTextureSlot( const ETextureSlotType Index )
+{
+	if( ActiveTextureSlot != Index )
+	{
+		glActiveTexture( GL_TEXTURE0 + Index );
+		ActiveTextureSlot = Index;
+	}
+}
+
+void CStateCache::SetBlendMode( const EBlendMode::Type& BlendModeIn )
+{
+	if( BlendMode == BlendModeIn )
+	{
+		Hits++;
+		return;
+	}
+
+	if( BlendModeIn == EBlendMode::Opaque )
+	{
+		glDisable( GL_BLEND );
+	}
+	else if( BlendModeIn == EBlendMode::Alpha )
+	{
+		glEnable( GL_BLEND );
+		glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	}
+	else if( BlendModeIn == EBlendMode::Additive )
+	{
+		glEnable( GL_BLEND );
+		glBlendFunc( GL_ONE, GL_ONE );
+	}
+
+	BlendMode = BlendModeIn;
+	Misses++;
+}
+
+void CStateCache::SetDepthMask( const EDepthMask::Type& DepthMaskIn )
+{
+	if( DepthMask == DepthMaskIn )
+	{
+		Hits++;
+		return;
+	}
+
+	glDepthMask( DepthMaskIn == EDepthMask::Write ? GL_TRUE : GL_FALSE );
+	DepthMask = DepthMaskIn;
+	Misses++;
+}
+
+void CStateCache::SetDepthTest( const EDepthTest::Type& DepthTestIn )
+{
+	if( DepthTest == DepthTestIn )
+	{
+		Hits++;
+		return;
+	}
+
+	glDepthFunc( DepthTestToEnum[DepthTestIn] );
+	DepthTest = DepthTestIn;
+	Misses++;
+}
+
+void CStateCache::SetCulling( const bool Enabled )
+{
+	const int32_t State = Enabled ? 1 : 0;
+	if( Culling == State )
+	{
+		Hits++;
+		return;
+	}
+
+	if( Enabled )
+	{
+		glEnable( GL_CULL_FACE );
+	}
+	else
+	{
+		glDisable( GL_CULL_FACE );
+	}
+
+	Culling = State;
+	Misses++;
+}
+
+void CStateCache::ReleaseProgram( GLuint ProgramIn )
+{
+	if( Program == ProgramIn )
+	{
+		Program = UnknownHandle;
+	}
+}
+
+void CStateCache::ReleaseVertexArray( GLuint VertexArrayIn )
+{
+	if( VertexArray == VertexArrayIn )
+	{
+		VertexArray = UnknownHandle;
+		Buffers[EBufferTarget::ElementArray] = UnknownHandle;
+	}
+}
+
+void CStateCache::ReleaseBuffer( GLuint Buffer )
+{
+	for( uint32_t Index = 0; Index < EBufferTarget::Maximum; Index++ )
+	{
+		if( Buffers[Index] == Buffer )
+		{
+			Buffers[Index] = UnknownHandle;
+		}
+	}
+}
+
+void CStateCache::ReleaseTexture( GLuint Texture )
+{
+	for( uint32_t Index = 0; Index < TextureSlots; Index++ )
+	{
+		if( Textures[Index] == Texture )
+		{
+			Textures[Index] = UnknownHandle;
+		}
+
+		if( TextureArrays[Index] == Texture )
+		{
+			TextureArrays[Index] = UnknownHandle;
+		}
+	}
+}
+
+int64_t CStateCache::FlushHits()
+{
+	const int64_t Count = Hits;
+	Hits = 0;
+	return Count;
+}
+
+int64_t CStateCache::FlushMisses()
+{
+	const int64_t Count = Misses;
+	Misses = 0;
+	return Count;
+}
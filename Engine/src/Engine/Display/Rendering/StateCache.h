@@ -0,0 +1,84 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <glad/glad.h>
+#include <stdint.h>
+
+#include <Engine/Display/Rendering/Shader.h>
+#include <Engine/Display/Rendering/TextureEnumerators.h>
+
+namespace EBufferTarget
+{
+	enum Type
+	{
+		Array = 0,
+		ElementArray,
+		Uniform,
+		DrawIndirect,
+		Maximum
+	};
+}
+
+// Shadows the OpenGL state that changes between draws so redundant calls never reach the driver.
+class CStateCache
+{
+public:
+	// Forgets all shadowed state, has to be called when code outside of the renderer touched the context.
+	void Invalidate();
+
+	void UseProgram( GLuint Program );
+	void BindVertexArray( GLuint VertexArray );
+	void BindBuffer( GLenum Target, GLuint Buffer );
+
+	// Binds a texture to the given slot, or the active slot if none is given.
+	void BindTexture( const ETextureSlot& Slot, GLuint Texture );
+	void BindTexture( GLuint Texture );
+
+	// Binds a texture array page to the given slot, array pages are tracked separately from regular textures.
+	void BindTextureArray( const ETextureSlot& Slot, GLuint Texture );
+
+	void SetBlendMode( const EBlendMode::Type& BlendMode );
+	void SetDepthMask( const EDepthMask::Type& DepthMask );
+	void SetDepthTest( const EDepthTest::Type& DepthTest );
+	void SetCulling( const bool Enabled );
+
+	// Object names can be reused after they have been deleted.
+	void ReleaseProgram( GLuint Program );
+	void ReleaseVertexArray( GLuint VertexArray );
+	void ReleaseBuffer( GLuint Buffer );
+	void ReleaseTexture( GLuint Texture );
+
+	// Returns the number of skipped and issued state changes since the last call.
+	int64_t FlushHits();
+	int64_t FlushMisses();
+
+private:
+	void SetActiveTextureSlot( const ETextureSlotType Index );
+
+	GLuint Program;
+	GLuint VertexArray;
+	GLuint Buffers[EBufferTarget::Maximum];
+	GLuint Textures[TextureSlots];
+	GLuint TextureArrays[TextureSlots];
+	GLuint ActiveTextureSlot;
+
+	EBlendMode::Type BlendMode;
+	EDepthMask::Type DepthMask;
+	EDepthTest::Type DepthTest;
+	int32_t Culling;
+
+	int64_t Hits;
+	int64_t Misses;
+
+public:
+	static CStateCache& Get()
+	{
+		static CStateCache StaticInstance;
+		return StaticInstance;
+	}
+private:
+	CStateCache();
+
+	CStateCache( CStateCache const& ) = delete;
+	void operator=( CStateCache const& ) = delete;
+};
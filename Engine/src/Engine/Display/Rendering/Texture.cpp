@@ -4,45 +4,22 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+
+#include <Engine/Configuration/Configuration.h>
+#include <Engine/Display/Rendering/StateCache.h>
 #include <Engine/Profiling/Logging.h>
 #include <Engine/Utility/Data.h>
 #include <Engine/Utility/File.h>
+#include <Engine/Utility/TextureBuilder.h>
 
-static const GLenum SlotToEnum[static_cast<ETextureSlotType>( ETextureSlot::Maximum )]
-{
-	GL_TEXTURE0,
-	GL_TEXTURE1,
-	GL_TEXTURE2,
-	GL_TEXTURE3,
-	GL_TEXTURE4,
-	GL_TEXTURE5,
-	GL_TEXTURE6,
-	GL_TEXTURE7,
-	GL_TEXTURE8,
-	GL_TEXTURE9,
-	GL_TEXTURE10,
-	GL_TEXTURE11,
-	GL_TEXTURE12,
-	GL_TEXTURE13,
-	GL_TEXTURE14,
-	GL_TEXTURE15,
-	GL_TEXTURE16,
-	GL_TEXTURE17,
-	GL_TEXTURE18,
-	GL_TEXTURE19,
-	GL_TEXTURE20,
-	GL_TEXTURE21,
-	GL_TEXTURE22,
-	GL_TEXTURE23,
-	GL_TEXTURE24,
-	GL_TEXTURE25,
-	GL_TEXTURE26,
-	GL_TEXTURE27,
-	GL_TEXTURE28,
-	GL_TEXTURE29,
-	GL_TEXTURE30,
-	GL_TEXTURE31
-};
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
 static const GLenum FilteringModeToEnum[static_cast<EFilteringModeType>( EFilteringMode::Maximum )]
 {
@@ -125,6 +102,60 @@ static const GLenum ImageFormatToInternalFormat[static_cast<EImageFormatType>( E
 	GL_RGBA32F,
 };
 
+static const GLenum CompressionToInternalFormat[EBlockCompression::Maximum]
+{
+	0,
+	GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+	GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+	GL_COMPRESSED_RG_RGTC2
+};
+
+static const EImageFormat CompressionToImageFormat[EBlockCompression::Maximum]
+{
+	EImageFormat::Unknown,
+	EImageFormat::RGB8,
+	EImageFormat::RGBA8,
+	EImageFormat::RG8
+};
+
+static const int CompressionToChannels[EBlockCompression::Maximum]
+{
+	0,
+	3,
+	4,
+	2
+};
+
+// BC5 is core, BC1 and BC3 are S3TC which drivers don't have to expose.
+static bool IsCompressionSupported( const EBlockCompression::Type Compression )
+{
+	if( Compression == EBlockCompression::BC1 || Compression == EBlockCompression::BC3 )
+		return GLAD_GL_EXT_texture_compression_s3tc != 0;
+
+	return Compression != EBlockCompression::None;
+}
+
+// Only 8-bit formats are compressed, higher precision formats are uploaded as they are.
+static EBlockCompression::Type ImageFormatToCompression( const EImageFormat Format )
+{
+	if( Format == EImageFormat::RGB8 && IsCompressionSupported( EBlockCompression::BC1 ) )
+		return EBlockCompression::BC1;
+
+	if( Format == EImageFormat::RGBA8 && IsCompressionSupported( EBlockCompression::BC3 ) )
+		return EBlockCompression::BC3;
+
+	if( Format == EImageFormat::RG8 )
+		return EBlockCompression::BC5;
+
+	return EBlockCompression::None;
+}
+
+static time_t GetModificationTime( const std::string& Location )
+{
+	struct stat Statistics;
+	return stat( Location.c_str(), &Statistics ) == 0 ? Statistics.st_mtime : 0;
+}
+
 CTexture::CTexture()
 {
 	Location = "";
@@ -142,6 +173,9 @@ CTexture::CTexture()
 	ImageData32F = nullptr;
 
 	FilteringMode = EFilteringMode::Linear;
+
+	Page = nullptr;
+	Layer = 0;
 }
 
 CTexture::CTexture( const char* FileLocation ) : CTexture()
@@ -159,15 +193,56 @@ CTexture::~CTexture()
 }
 
 bool CTexture::Load( const EFilteringMode Mode, const EImageFormat PreferredFormat )
+{
+	if( !Decode( Mode, PreferredFormat ) )
+		return false;
+
+	if( IsCompressed() )
+	{
+		Handle = Create( nullptr );
+		ReleaseCompressed();
+		return Handle != 0;
+	}
+
+	if( Load( nullptr, Width, Height, Channels, FilteringMode, PreferredFormat ) )
+	{
+		return true;
+	}
+
+	Log::Event( Log::Warning, "Invalid image data (\"%s\").\n", Location.c_str() );
+	return false;
+}
+
+bool CTexture::Decode( const EFilteringMode Mode, const EImageFormat PreferredFormat )
 {
 	CFile TextureSource( Location.c_str() );
 	const std::string Extension = TextureSource.Extension();
 
+	FilteringMode = Mode;
+	Format = PreferredFormat;
+
+	if( Extension == "lt" )
+	{
+		return LoadCompressed( Location, EBlockCompression::None );
+	}
+
+	static const bool CompressTextures = CConfiguration::Get().GetInteger( "compresstextures", 1 ) > 0;
+	const EBlockCompression::Type Compression = CompressTextures ? ImageFormatToCompression( PreferredFormat ) : EBlockCompression::None;
+
+	// Baked files are used for as long as they're newer than the image they were baked from.
+	const std::string CompressedLocation = GetCompressedLocation();
+	if( Compression != EBlockCompression::None && GetModificationTime( CompressedLocation ) >= TextureSource.ModificationDate() )
+	{
+		if( LoadCompressed( CompressedLocation, Compression ) )
+			return true;
+	}
+
 	// The STB header supports more than these types but we want to refrain from loading them since they're generally inefficient to load.
 	const bool Supported = Extension == "jpg" || Extension == "png" || Extension == "tga" || Extension == "hdr";
 
 	if( Supported && TextureSource.Load( true ) )
 	{
+		// Every texture is flipped so workers setting the flag concurrently agree on its value.
 		stbi_set_flip_vertically_on_load( 1 );
 
 		if( PreferredFormat > EImageFormat::RGBA16 )
@@ -183,10 +258,13 @@ bool CTexture::Load( const EFilteringMode Mode, const EImageFormat PreferredForm
 			ImageData8 = stbi_load_from_memory( TextureSource.Fetch<stbi_uc>(), static_cast<int>( TextureSource.Size() ), &Width, &Height, &Channels, 0 );
 		}
 
-		FilteringMode = Mode;
-
-		if( Load( nullptr, Width, Height, Channels, FilteringMode, PreferredFormat ) )
+		if( GetImageData() )
 		{
+			if( Compression != EBlockCompression::None && ImageData8 )
+			{
+				SaveCompressed( CompressedLocation, Compression );
+			}
+
 			return true;
 		}
 		else
@@ -216,75 +294,212 @@ bool CTexture::Load( unsigned char* Data, const int WidthIn, const int HeightIn,
 	if( !Pixels || WidthIn < 1 || HeightIn < 1 || ChannelsIn < 1 )
 		return false;
 
-	glGenTextures( 1, &Handle );
-	glBindTexture( GL_TEXTURE_2D, Handle );
+	FilteringMode = ModeIn;
+	Width = WidthIn;
+	Height = HeightIn;
+	Channels = ChannelsIn;
+	Format = PreferredFormatIn;
+
+	const GLuint NewHandle = Create( Pixels );
+	Supported = NewHandle != 0;
+
+	if( Supported )
+	{
+		Handle = NewHandle;
+		glGenerateMipmap( GL_TEXTURE_2D );
+	}
+
+	return Supported;
+}
+
+GLuint CTexture::Create( const void* Pixels ) const
+{
+	const bool PowerOfTwoWidth = ( Width & ( Width - 1 ) ) == 0;
+	const bool PowerOfTwoHeight = ( Height & ( Height - 1 ) ) == 0;
+	if( !PowerOfTwoWidth || !PowerOfTwoHeight )
+	{
+		Log::Event( Log::Warning, "Not a power of two texture (\"%s\").\n", Location.c_str() );
+		return 0;
+	}
+
+	const GLenum PixelFormat = GetPixelFormat();
+	if( PixelFormat == 0 )
+		return 0;
+
+	GLuint NewHandle = 0;
+	glGenTextures( 1, &NewHandle );
+	CStateCache::Get().BindTexture( NewHandle );
 
 	// Wrapping parameters
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
 
 	// Filtering parameters
-	FilteringMode = ModeIn;
 	const auto Mode = static_cast<EFilteringModeType>( FilteringMode );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, FilteringModeToEnum[Mode] );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, FilteringModeToEnum[Mode] );
 
-	Width = WidthIn;
-	Height = HeightIn;
-	Channels = ChannelsIn;
+	if( IsCompressed() )
+	{
+		const GLenum CompressedFormat = CompressionToInternalFormat[Compressed.Compression];
+		for( uint32_t Level = 0; Level < Compressed.MipCount; Level++ )
+		{
+			const FCompressedMip& Mip = Compressed.Mips[Level];
+			const GLsizei Size = static_cast<GLsizei>( Mip.Size * sizeof( uint64_t ) );
+			glCompressedTexImage2D( GL_TEXTURE_2D, Level, CompressedFormat, Mip.Width, Mip.Height, 0, Size, Compressed.Blocks.data() + Mip.Offset );
+		}
 
-	const auto ImageFormat = static_cast<EImageFormatType>( PreferredFormatIn );
-	// auto Format = ImageFormatToFormat[ImageFormat];
-	auto Type = ImageFormatToType[ImageFormat];
-	auto InternalFormat = ImageFormatToInternalFormat[ImageFormat];
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, Compressed.MipCount - 1 );
+		return NewHandle;
+	}
 
-	Format = PreferredFormatIn;
+	const auto ImageFormat = static_cast<EImageFormatType>( Format );
+	const auto InternalFormat = ImageFormatToInternalFormat[ImageFormat];
+	glTexImage2D( GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, PixelFormat, GetPixelType(), Pixels );
 
-	const bool PowerOfTwoWidth = ( Width & ( Width - 1 ) ) == 0;
-	const bool PowerOfTwoHeight = ( Height & ( Height - 1 ) ) == 0;
-	if( PowerOfTwoWidth && PowerOfTwoHeight )
+	return NewHandle;
+}
+
+GLenum CTexture::GetPixelFormat() const
+{
+	static const GLenum ChannelsToFormat[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	if( Channels < 1 || Channels > 4 )
+		return 0;
+
+	return ChannelsToFormat[Channels - 1];
+}
+
+GLenum CTexture::GetPixelType() const
+{
+	return ImageFormatToType[static_cast<EImageFormatType>( Format )];
+}
+
+bool CTexture::IsCompressed() const
+{
+	return Compressed.MipCount > 0;
+}
+
+size_t CTexture::GetCompressedSize() const
+{
+	// Counted from the mips since the blocks are released after uploading.
+	size_t Blocks = 0;
+	for( uint32_t Level = 0; Level < Compressed.MipCount; Level++ )
 	{
-		if( Channels == 1 )
-		{
-			glTexImage2D( GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, GL_RED, Type, Pixels );
-			Supported = true;
-		}
-		else if( Channels == 2 )
-		{
-			glTexImage2D( GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, GL_RG, Type, Pixels );
-			Supported = true;
-		}
-		else if( Channels == 3 )
-		{
-			glTexImage2D( GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, GL_RGB, Type, Pixels );
-			Supported = true;
-		}
-		else if( Channels == 4 )
-		{
-			glTexImage2D( GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, GL_RGBA, Type, Pixels );
-			Supported = true;
-		}
+		Blocks += Compressed.Mips[Level].Size;
 	}
-	else
+
+	return Blocks * sizeof( uint64_t );
+}
+
+void CTexture::ReleaseCompressed()
+{
+	std::vector<uint64_t>().swap( Compressed.Blocks );
+}
+
+GLenum CTexture::GetInternalFormat() const
+{
+	if( IsCompressed() )
+		return CompressionToInternalFormat[Compressed.Compression];
+
+	return ImageFormatToInternalFormat[static_cast<EImageFormatType>( Format )];
+}
+
+int CTexture::GetLevels() const
+{
+	if( IsCompressed() )
+		return static_cast<int>( Compressed.MipCount );
+
+	// Uncompressed textures have their full mip chain generated.
+	int Levels = 1;
+	for( int Size = std::max( Width, Height ); Size > 1; Size >>= 1 )
 	{
-		Log::Event( Log::Warning, "Not a power of two texture (\"%s\").\n", Location.c_str() );
+		Levels++;
 	}
 
-	if( Supported )
+	return Levels;
+}
+
+CTextureArray* CTexture::GetPage() const
+{
+	return Page;
+}
+
+uint32_t CTexture::GetLayer() const
+{
+	return Layer;
+}
+
+std::string CTexture::GetCompressedLocation() const
+{
+	const size_t ExtensionIndex = Location.rfind( '.' );
+	return Location.substr( 0, ExtensionIndex ) + ".lt";
+}
+
+bool CTexture::LoadCompressed( const std::string& CompressedLocation, const EBlockCompression::Type Compression )
+{
+	CFile File( CompressedLocation.c_str() );
+	if( !File.Load( true ) )
+		return false;
+
+	TextureBuilder::LT( Compressed, File );
+
+	// Files baked for a different format are baked again.
+	if( Compressed.MipCount == 0 || ( Compression != EBlockCompression::None && Compressed.Compression != Compression ) )
 	{
-		glGenerateMipmap( GL_TEXTURE_2D );
+		Compressed.MipCount = 0;
+		Compressed.Blocks.clear();
+		return false;
 	}
 
-	return Supported;
+	if( !IsCompressionSupported( static_cast<EBlockCompression::Type>( Compressed.Compression ) ) )
+	{
+		Log::Event( Log::Warning, "Block compression of \"%s\" isn't supported by this driver.\n", CompressedLocation.c_str() );
+		Compressed.MipCount = 0;
+		Compressed.Blocks.clear();
+		return false;
+	}
+
+	Width = static_cast<int>( Compressed.Mips[0].Width );
+	Height = static_cast<int>( Compressed.Mips[0].Height );
+	Channels = CompressionToChannels[Compressed.Compression];
+	Format = CompressionToImageFormat[Compressed.Compression];
+
+	return true;
+}
+
+void CTexture::SaveCompressed( const std::string& CompressedLocation, const EBlockCompression::Type Compression )
+{
+	if( !TextureBuilder::Compress( Compressed, ImageData8, Width, Height, Channels, Compression ) )
+		return;
+
+	Log::Event( "Baking compressed texture \"%s\".\n", CompressedLocation.c_str() );
+
+	CData Data;
+	Data << Compressed;
+
+	CFile File( CompressedLocation.c_str() );
+	File.Load( Data );
+	File.Save();
+
+	// The compressed levels replace the decoded image.
+	stbi_image_free( ImageData8 );
+	ImageData8 = nullptr;
+
+	Channels = CompressionToChannels[Compression];
+}
+
+size_t CTexture::GetPixelSize() const
+{
+	const GLenum Type = GetPixelType();
+	const size_t ComponentSize = Type == GL_UNSIGNED_BYTE ? 1 : ( Type == GL_UNSIGNED_SHORT ? 2 : 4 );
+	return ComponentSize * Channels;
 }
 
 void CTexture::Bind( ETextureSlot Slot )
 {
 	if( Handle )
 	{
-		const auto Index = static_cast<std::underlying_type<ETextureSlot>::type>( Slot );
-		glActiveTexture( SlotToEnum[Index] );
-		glBindTexture( GL_TEXTURE_2D, Handle );
+		CStateCache::Get().BindTexture( Slot, Handle );
 	}
 }
 
@@ -7,10 +7,14 @@
 #include <glad/glad.h>
 
 #include <Engine/Display/Rendering/TextureEnumerators.h>
+#include <Engine/Utility/CompressedImage.h>
 #include <Engine/Utility/Data.h>
 
+class CTextureArray;
+
 class CTexture
 {
+	friend class CTextureArray;
 public:
 	CTexture();
 	CTexture( const char* FileLocation );
@@ -20,6 +24,32 @@ public:
 	bool Load( unsigned char* Data, const int Width, const int Height, const int Channels, const EFilteringMode Mode = EFilteringMode::Linear, const EImageFormat PreferredFormat = EImageFormat::RGB8 );
 	void Bind( ETextureSlot Slot );
 
+	// Reads and decodes the image file without touching the context, safe to call from worker threads.
+	bool Decode( const EFilteringMode Mode = EFilteringMode::Linear, const EImageFormat PreferredFormat = EImageFormat::RGB8 );
+
+	// Creates a texture object that matches the decoded image, the pixels can be null when they're uploaded later.
+	GLuint Create( const void* Pixels ) const;
+
+	// Layout of the decoded image data for glTexSubImage2D.
+	GLenum GetPixelFormat() const;
+	GLenum GetPixelType() const;
+	size_t GetPixelSize() const;
+
+	// Compressed textures upload their baked mip chain as is.
+	bool IsCompressed() const;
+	size_t GetCompressedSize() const;
+
+	// Frees the baked blocks once they've been uploaded, the mip layout is kept.
+	void ReleaseCompressed();
+
+	// Storage format and number of mip levels of the texture object.
+	GLenum GetInternalFormat() const;
+	int GetLevels() const;
+
+	// Texture array page the texture has been packed into, if any.
+	CTextureArray* GetPage() const;
+	uint32_t GetLayer() const;
+
 	const std::string& GetLocation() const;
 	const GLuint GetHandle() const;
 	const int GetWidth() const;
@@ -31,6 +61,11 @@ public:
 	EFilteringMode FilteringMode;
 	GLuint Handle;
 protected:
+	// Location of the block compressed file that is baked next to the source image.
+	std::string GetCompressedLocation() const;
+	bool LoadCompressed( const std::string& CompressedLocation, const EBlockCompression::Type Compression );
+	void SaveCompressed( const std::string& CompressedLocation, const EBlockCompression::Type Compression );
+
 	EImageFormat Format;
 	std::string Location;
 
@@ -42,4 +77,9 @@ protected:
 	unsigned short* ImageData16;
 	unsigned int* ImageData32;
 	float* ImageData32F;
+
+	FCompressedImage Compressed;
+
+	CTextureArray* Page;
+	uint32_t Layer;
 };
@@ -0,0 +1,213 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#include <Engine/Configuration/Configuration.h>
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Display/Rendering/Texture.h>
+#include <Engine/Profiling/Logging.h>
+
+static std::vector<CTextureArray*> Pages;
+static uint32_t Generation = 0;
+
+CTextureArray::CTextureArray( const int WidthIn, const int HeightIn, const GLenum InternalFormatIn, const int LevelsIn, const EFilteringMode Mode, const uint32_t CapacityIn )
+{
+	Width = WidthIn;
+	Height = HeightIn;
+	InternalFormat = InternalFormatIn;
+	Levels = LevelsIn;
+	FilteringMode = Mode;
+
+	Layers = 0;
+	Capacity = CapacityIn;
+
+	glGenTextures( 1, &Handle );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, Handle );
+
+	// Views can only be created from immutable storage.
+	glTexStorage3D( GL_TEXTURE_2D_ARRAY, Levels, InternalFormat, Width, Height, Capacity );
+	SetParameters( GL_TEXTURE_2D_ARRAY );
+
+	glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+	// The state cache doesn't know about the binding above.
+	CStateCache::Get().ReleaseTexture( Handle );
+}
+
+CTextureArray::~CTextureArray()
+{
+	for( CTexture* Texture : Members )
+	{
+		Texture->Page = nullptr;
+		Texture->Layer = 0;
+	}
+
+	if( Handle )
+	{
+		CStateCache::Get().ReleaseTexture( Handle );
+		glDeleteTextures( 1, &Handle );
+	}
+}
+
+bool CTextureArray::Add( CTexture* Texture )
+{
+	if( IsFull() || !Matches( Texture ) )
+		return false;
+
+	const GLuint Source = Texture->Handle;
+	for( int Level = 0; Level < Levels; Level++ )
+	{
+		const GLsizei LevelWidth = std::max( Width >> Level, 1 );
+		const GLsizei LevelHeight = std::max( Height >> Level, 1 );
+		glCopyImageSubData( Source, GL_TEXTURE_2D, Level, 0, 0, 0, Handle, GL_TEXTURE_2D_ARRAY, Level, 0, 0, Layers, LevelWidth, LevelHeight, 1 );
+	}
+
+	GLuint View = 0;
+	glGenTextures( 1, &View );
+	glTextureView( View, GL_TEXTURE_2D, Handle, InternalFormat, 0, Levels, Layers, 1 );
+
+	CStateCache& StateCache = CStateCache::Get();
+	StateCache.BindTexture( View );
+	SetParameters( GL_TEXTURE_2D );
+
+	// The layer holds the only copy of the image from here on.
+	StateCache.ReleaseTexture( Source );
+	glDeleteTextures( 1, &Source );
+
+	Texture->Handle = View;
+	Texture->Page = this;
+	Texture->Layer = Layers++;
+	Members.emplace_back( Texture );
+
+	return true;
+}
+
+bool CTextureArray::Matches( const CTexture* Texture ) const
+{
+	return Texture && Texture->GetWidth() == Width && Texture->GetHeight() == Height && Texture->GetInternalFormat() == InternalFormat && Texture->GetLevels() == Levels && Texture->FilteringMode == FilteringMode;
+}
+
+bool CTextureArray::IsFull() const
+{
+	return Layers >= Capacity;
+}
+
+GLuint CTextureArray::GetHandle() const
+{
+	return Handle;
+}
+
+uint32_t CTextureArray::GetLayers() const
+{
+	return Layers;
+}
+
+bool CTextureArray::IsSupported()
+{
+	return GLAD_GL_VERSION_4_3 || ( GLAD_GL_ARB_texture_storage && GLAD_GL_ARB_copy_image && GLAD_GL_ARB_texture_view );
+}
+
+void CTextureArray::Pack( const std::vector<CTexture*>& Textures )
+{
+	if( !IsSupported() )
+		return;
+
+	static const int ConfiguredLayers = CConfiguration::Get().GetInteger( "texturearraylayers", 64 );
+
+	GLint SupportedLayers = 0;
+	glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &SupportedLayers );
+
+	const uint32_t MaximumLayers = static_cast<uint32_t>( std::max( 1, std::min( ConfiguredLayers, static_cast<int>( SupportedLayers ) ) ) );
+
+	// Textures that share a handle are still showing a placeholder.
+	std::unordered_map<GLuint, uint32_t> Handles;
+	for( CTexture* Texture : Textures )
+	{
+		if( Texture )
+		{
+			Handles[Texture->GetHandle()]++;
+		}
+	}
+
+	typedef std::tuple<int, int, GLenum, int, EFilteringModeType> FPageKey;
+	std::map<FPageKey, std::vector<CTexture*>> Groups;
+	for( CTexture* Texture : Textures )
+	{
+		if( !Texture || Texture->GetPage() || Texture->GetHandle() == 0 || Handles[Texture->GetHandle()] > 1 )
+			continue;
+
+		if( Texture->GetWidth() < 1 || Texture->GetHeight() < 1 )
+			continue;
+
+		const FPageKey Key( Texture->GetWidth(), Texture->GetHeight(), Texture->GetInternalFormat(), Texture->GetLevels(), static_cast<EFilteringModeType>( Texture->FilteringMode ) );
+		Groups[Key].emplace_back( Texture );
+	}
+
+	size_t Packed = 0;
+	for( auto& Group : Groups )
+	{
+		const std::vector<CTexture*>& Members = Group.second;
+		for( size_t Offset = 0; Offset < Members.size(); )
+		{
+			// Pages are sized to fit so no layers are wasted.
+			const uint32_t Capacity = static_cast<uint32_t>( std::min( Members.size() - Offset, static_cast<size_t>( MaximumLayers ) ) );
+
+			const CTexture* First = Members[Offset];
+			CTextureArray* Page = new CTextureArray( First->GetWidth(), First->GetHeight(), First->GetInternalFormat(), First->GetLevels(), First->FilteringMode, Capacity );
+			Pages.emplace_back( Page );
+
+			for( uint32_t Layer = 0; Layer < Capacity; Layer++ )
+			{
+				if( Page->Add( Members[Offset + Layer] ) )
+				{
+					Packed++;
+				}
+			}
+
+			Offset += Capacity;
+		}
+	}
+
+	if( Packed > 0 )
+	{
+		Generation++;
+		Log::Event( "Packed %zu textures into texture arrays (%zu pages).\n", Packed, Pages.size() );
+	}
+}
+
+void CTextureArray::Release()
+{
+	if( Pages.empty() )
+		return;
+
+	for( CTextureArray* Page : Pages )
+	{
+		delete Page;
+	}
+
+	Pages.clear();
+	Generation++;
+}
+
+uint32_t CTextureArray::GetGeneration()
+{
+	return Generation;
+}
+
+size_t CTextureArray::GetPageCount()
+{
+	return Pages.size();
+}
+
+void CTextureArray::SetParameters( const GLenum Target ) const
+{
+	const GLint Filter = FilteringMode == EFilteringMode::Nearest ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri( Target, GL_TEXTURE_WRAP_S, GL_REPEAT );
+	glTexParameteri( Target, GL_TEXTURE_WRAP_T, GL_REPEAT );
+	glTexParameteri( Target, GL_TEXTURE_MIN_FILTER, Filter );
+	glTexParameteri( Target, GL_TEXTURE_MAG_FILTER, Filter );
+}
@@ -0,0 +1,58 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <glad/glad.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <Engine/Display/Rendering/TextureEnumerators.h>
+
+class CTexture;
+
+// Immutable GL_TEXTURE_2D_ARRAY that holds textures of the same size, format and filtering as its layers.
+// Packed textures keep working with regular samplers through a view of their layer, shaders that declare a slot as sampler2DArray bind the page instead.
+class CTextureArray
+{
+public:
+	CTextureArray( const int Width, const int Height, const GLenum InternalFormat, const int Levels, const EFilteringMode Mode, const uint32_t Capacity );
+	~CTextureArray();
+
+	// Copies the texture into the next free layer, the texture's own handle is replaced by a view of that layer.
+	bool Add( CTexture* Texture );
+
+	bool Matches( const CTexture* Texture ) const;
+	bool IsFull() const;
+
+	GLuint GetHandle() const;
+	uint32_t GetLayers() const;
+
+	// Immutable storage, image copies and texture views are core in 4.3, older contexts need all three extensions.
+	static bool IsSupported();
+
+	// Groups the textures by size, format and filtering and packs them into new pages, textures that are already packed are skipped.
+	static void Pack( const std::vector<CTexture*>& Textures );
+
+	// Deletes every page, the textures that were packed into them lose their page and layer.
+	static void Release();
+
+	// Incremented whenever textures have been packed, texture handles change when that happens.
+	static uint32_t GetGeneration();
+	static size_t GetPageCount();
+
+private:
+	void SetParameters( const GLenum Target ) const;
+
+	GLuint Handle;
+
+	int Width;
+	int Height;
+	GLenum InternalFormat;
+	int Levels;
+	EFilteringMode FilteringMode;
+
+	uint32_t Layers;
+	uint32_t Capacity;
+
+	std::vector<CTexture*> Members;
+};
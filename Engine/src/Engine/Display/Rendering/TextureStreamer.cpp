@@ -0,0 +1,200 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "TextureStreamer.h"
+
+#include <Engine/Configuration/Configuration.h>
+#include <Engine/Display/Rendering/StateCache.h>
+#include <Engine/Display/Rendering/Texture.h>
+#include <Engine/Profiling/Logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static const size_t PixelBufferCount = 4;
+static const size_t PixelBufferSize = 1 << 20;
+
+CTextureStreamer::CTextureStreamer()
+{
+	NextBuffer = 0;
+
+	Enabled = CConfiguration::Get().GetInteger( "texturestreaming", 1 ) > 0;
+	FrameBudget = static_cast<size_t>( std::max( 1, CConfiguration::Get().GetInteger( "texturestreamingbudget", 4096 ) ) ) * 1024;
+}
+
+CTextureStreamer::~CTextureStreamer()
+{
+	// Waits for decodes that are still running, the buffers go away with the context.
+	Streams.clear();
+	Buffers.clear();
+}
+
+bool CTextureStreamer::IsEnabled() const
+{
+	return Enabled;
+}
+
+void CTextureStreamer::Queue( CTexture* Texture, const EFilteringMode Mode, const EImageFormat Format, const GLuint Placeholder )
+{
+	if( !Texture )
+		return;
+
+	Texture->Handle = Placeholder;
+
+	FTextureStream Stream;
+	Stream.Texture = Texture;
+	Stream.Decoded = std::async( std::launch::async, [Texture, Mode, Format] () {
+		return Texture->Decode( Mode, Format );
+	} );
+
+	Streams.emplace_back( std::move( Stream ) );
+}
+
+void CTextureStreamer::Update()
+{
+	size_t Budget = FrameBudget;
+	for( auto Iterator = Streams.begin(); Iterator != Streams.end(); )
+	{
+		FTextureStream& Stream = *Iterator;
+		if( Stream.Decoded.valid() )
+		{
+			if( Stream.Decoded.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+			{
+				++Iterator;
+				continue;
+			}
+
+			if( Stream.Decoded.get() )
+			{
+				Stream.Handle = Stream.Texture->Create( nullptr );
+			}
+
+			// Textures that couldn't be decoded keep using the placeholder.
+			if( Stream.Handle == 0 )
+			{
+				Log::Event( Log::Warning, "Failed to stream texture (\"%s\").\n", Stream.Texture->GetLocation().c_str() );
+				Iterator = Streams.erase( Iterator );
+				continue;
+			}
+
+			// Compressed levels are uploaded in full when the texture is created.
+			if( Stream.Texture->IsCompressed() )
+			{
+				Stream.Texture->ReleaseCompressed();
+				Swap( Stream );
+				Budget -= std::min( Budget, Stream.Texture->GetCompressedSize() );
+				Iterator = Streams.erase( Iterator );
+				continue;
+			}
+		}
+
+		if( Budget > 0 && Upload( Stream, Budget ) )
+		{
+			Iterator = Streams.erase( Iterator );
+		}
+		else
+		{
+			++Iterator;
+		}
+	}
+}
+
+size_t CTextureStreamer::GetPending() const
+{
+	return Streams.size();
+}
+
+bool CTextureStreamer::Upload( FTextureStream& Stream, size_t& Budget )
+{
+	CTexture* Texture = Stream.Texture;
+	const int Width = Texture->GetWidth();
+	const int Height = Texture->GetHeight();
+	const size_t RowSize = static_cast<size_t>( Width ) * Texture->GetPixelSize();
+	const char* Pixels = static_cast<const char*>( Texture->GetImageData() );
+
+	CStateCache& StateCache = CStateCache::Get();
+	StateCache.BindTexture( Stream.Handle );
+
+	// Decoded rows are tightly packed.
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+	while( Stream.Row < Height && Budget > 0 )
+	{
+		const size_t Rows = std::min( std::max( std::min( PixelBufferSize, Budget ) / RowSize, size_t( 1 ) ), static_cast<size_t>( Height - Stream.Row ) );
+		const size_t Size = Rows * RowSize;
+		const char* Source = Pixels + Stream.Row * RowSize;
+
+		if( Size > PixelBufferSize )
+		{
+			// Rows that don't fit in a pixel buffer are uploaded straight from the decoded data.
+			StateCache.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+			glTexSubImage2D( GL_TEXTURE_2D, 0, 0, Stream.Row, Width, static_cast<GLsizei>( Rows ), Texture->GetPixelFormat(), Texture->GetPixelType(), Source );
+		}
+		else
+		{
+			FPixelBuffer* Buffer = AcquireBuffer();
+			if( !Buffer )
+				break;
+
+			StateCache.BindBuffer( GL_PIXEL_UNPACK_BUFFER, Buffer->Buffer );
+
+			// The fence guarantees the previous upload from this buffer is done so it can be overwritten without syncing.
+			void* Mapped = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, Size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+			if( !Mapped )
+				break;
+
+			memcpy( Mapped, Source, Size );
+			glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+
+			glTexSubImage2D( GL_TEXTURE_2D, 0, 0, Stream.Row, Width, static_cast<GLsizei>( Rows ), Texture->GetPixelFormat(), Texture->GetPixelType(), nullptr );
+			Buffer->Fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		}
+
+		Stream.Row += static_cast<int>( Rows );
+		Budget -= std::min( Budget, Size );
+	}
+
+	StateCache.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+
+	if( Stream.Row < Height )
+		return false;
+
+	glGenerateMipmap( GL_TEXTURE_2D );
+	Swap( Stream );
+
+	return true;
+}
+
+void CTextureStreamer::Swap( FTextureStream& Stream )
+{
+	// Renderables key their texture sets on the texture itself rather than its handle, so they don't have to be told about the swap.
+	Stream.Texture->Handle = Stream.Handle;
+}
+
+FPixelBuffer* CTextureStreamer::AcquireBuffer()
+{
+	if( Buffers.empty() )
+	{
+		Buffers.resize( PixelBufferCount );
+		for( auto& Buffer : Buffers )
+		{
+			glGenBuffers( 1, &Buffer.Buffer );
+			CStateCache::Get().BindBuffer( GL_PIXEL_UNPACK_BUFFER, Buffer.Buffer );
+			glBufferData( GL_PIXEL_UNPACK_BUFFER, PixelBufferSize, nullptr, GL_STREAM_DRAW );
+		}
+	}
+
+	FPixelBuffer& Buffer = Buffers[NextBuffer];
+	if( Buffer.Fence )
+	{
+		// The ring is full when the oldest upload hasn't been consumed yet, the rest waits for the next frame.
+		if( glClientWaitSync( Buffer.Fence, 0, 0 ) == GL_TIMEOUT_EXPIRED )
+			return nullptr;
+
+		glDeleteSync( Buffer.Fence );
+		Buffer.Fence = nullptr;
+	}
+
+	NextBuffer = ( NextBuffer + 1 ) % Buffers.size();
+	return &Buffer;
+}
@@ -0,0 +1,74 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <glad/glad.h>
+#include <stdint.h>
+#include <deque>
+#include <future>
+#include <vector>
+
+#include <Engine/Display/Rendering/TextureEnumerators.h>
+
+class CTexture;
+
+struct FTextureStream
+{
+	CTexture* Texture = nullptr;
+	std::future<bool> Decoded;
+
+	// Created once decoding has finished, rows are uploaded from the bottom up.
+	GLuint Handle = 0;
+	int Row = 0;
+};
+
+// Slot in the pixel buffer ring, the fence is signaled once the upload that used it has been consumed.
+struct FPixelBuffer
+{
+	GLuint Buffer = 0;
+	GLsync Fence = nullptr;
+};
+
+// Decodes textures on worker threads and uploads them through a ring of pixel buffer objects, a slice per frame.
+class CTextureStreamer
+{
+public:
+	~CTextureStreamer();
+
+	bool IsEnabled() const;
+
+	// The texture uses the placeholder handle until all of its rows have been uploaded.
+	void Queue( CTexture* Texture, const EFilteringMode Mode, const EImageFormat Format, const GLuint Placeholder );
+
+	// Uploads decoded textures up to the frame budget, has to be called on the main thread.
+	void Update();
+
+	// Number of textures that are still being decoded or uploaded.
+	size_t GetPending() const;
+
+private:
+	// Returns true once every row of the texture has been uploaded.
+	bool Upload( FTextureStream& Stream, size_t& Budget );
+
+	// Replaces the placeholder with the streamed handle.
+	void Swap( FTextureStream& Stream );
+	FPixelBuffer* AcquireBuffer();
+
+	std::deque<FTextureStream> Streams;
+	std::vector<FPixelBuffer> Buffers;
+	size_t NextBuffer;
+
+	size_t FrameBudget;
+	bool Enabled;
+
+public:
+	static CTextureStreamer& Get()
+	{
+		static CTextureStreamer StaticInstance;
+		return StaticInstance;
+	}
+private:
+	CTextureStreamer();
+
+	CTextureStreamer( CTextureStreamer const& ) = delete;
+	void operator=( CTextureStreamer const& ) = delete;
+};
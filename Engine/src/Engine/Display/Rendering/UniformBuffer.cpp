@@ -0,0 +1,62 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "UniformBuffer.h"
+
+#include <Engine/Display/Rendering/StateCache.h>
+
+#include <unordered_map>
+
+static std::unordered_map<std::string, int32_t> GlobalIndices;
+
+CUniformBuffer::CUniformBuffer( EUniformBlock::Type BlockIn )
+{
+	Block = BlockIn;
+	Handle = 0;
+}
+
+CUniformBuffer::~CUniformBuffer()
+{
+
+}
+
+void CUniformBuffer::Destroy()
+{
+	if( Handle != 0 )
+	{
+		CStateCache::Get().ReleaseBuffer( Handle );
+		glDeleteBuffers( 1, &Handle );
+		Handle = 0;
+	}
+}
+
+void CUniformBuffer::Upload( const void* Data, const size_t Size )
+{
+	if( Handle == 0 )
+	{
+		glGenBuffers( 1, &Handle );
+	}
+
+	CStateCache::Get().BindBuffer( GL_UNIFORM_BUFFER, Handle );
+	glBufferData( GL_UNIFORM_BUFFER, Size, nullptr, GL_STREAM_DRAW );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, Size, Data );
+
+	glBindBufferBase( GL_UNIFORM_BUFFER, Block, Handle );
+}
+
+GLuint CUniformBuffer::GetHandle() const
+{
+	return Handle;
+}
+
+int32_t CUniformBuffer::GetGlobalIndex( const std::string& Name )
+{
+	auto Iterator = GlobalIndices.find( Name );
+	if( Iterator != GlobalIndices.end() )
+		return Iterator->second;
+
+	if( GlobalIndices.size() >= MaximumFrameGlobals )
+		return -1;
+
+	const int32_t Index = static_cast<int32_t>( GlobalIndices.size() );
+	GlobalIndices.emplace( Name, Index );
+	return Index;
+}
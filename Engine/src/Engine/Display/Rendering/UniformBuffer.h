@@ -0,0 +1,75 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+
+namespace EUniformBlock
+{
+	// Block types double as their binding points.
+	enum Type
+	{
+		Frame = 0,
+		View,
+		Maximum
+	};
+}
+
+static const char* UniformBlockName[EUniformBlock::Maximum] = {
+	"FrameData",
+	"ViewData"
+};
+
+static const uint32_t MaximumFrameGlobals = 16;
+
+// Layout of the std140 FrameData block, written once per frame.
+struct FFrameData
+{
+	glm::vec4 Time;
+	glm::vec4 Resolution;
+
+	// Scale of the scene target relative to the viewport, its reciprocal and the scene target size.
+	glm::vec4 RenderScale;
+
+	// Values set through CRenderer::SetUniformBuffer, shaders declare the ones they read with the #global directive.
+	glm::vec4 Globals[MaximumFrameGlobals];
+};
+
+// Layout of the std140 ViewData block, written once per render pass.
+struct FViewData
+{
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::vec4 CameraPosition;
+	glm::vec4 CameraDirection;
+	glm::vec4 Viewport;
+};
+
+class CUniformBuffer
+{
+public:
+	CUniformBuffer( EUniformBlock::Type Block );
+	~CUniformBuffer();
+
+	void Destroy();
+
+	// Orphans the previous contents and binds the buffer to the block's binding point.
+	void Upload( const void* Data, const size_t Size );
+
+	template<typename T>
+	void Upload( const T& Data )
+	{
+		Upload( &Data, sizeof( T ) );
+	}
+
+	GLuint GetHandle() const;
+
+	// Slot of the named global in FFrameData::Globals, assigned on first use and never reused. Returns -1 once the slots have run out.
+	static int32_t GetGlobalIndex( const std::string& Name );
+
+private:
+	EUniformBlock::Type Block;
+	GLuint Handle;
+};
@@ -8,6 +8,8 @@
 
 #include <Engine/Configuration/Configuration.h>
 #include <Engine/Display/UserInterface.h>
+#include <Engine/Display/Rendering/GeometryArena.h>
+#include <Engine/Display/Rendering/TextureArray.h>
 #include <Engine/Profiling/Logging.h>
 #include <Engine/Profiling/Profiling.h>
 
@@ -36,6 +38,7 @@ CWindow::CWindow()
 {
 	Initialized = false;
 	ShowCursor = false;
+	Headless = false;
 }
 
 void CWindow::Create( const char* Title )
@@ -52,6 +55,15 @@ void CWindow::Create( const char* Title )
 
 	// Make sure GLFW is terminated before initializing it in case the application is being re-initialized.
 	glfwTerminate();
+
+#if defined( GLFW_PLATFORM_NULL )
+	// Machines without a display can't initialize the windowing platforms, the null platform only offers offscreen contexts.
+	if( Headless && config.IsEnabled( "headlessnullplatform", true ) )
+	{
+		glfwInitHint( GLFW_PLATFORM, GLFW_PLATFORM_NULL );
+	}
+#endif
+
 	if( !glfwInit() )
 	{
 		Log::Event( Log::Fatal, "Failed to initialize GLFW\n" );
@@ -77,6 +89,82 @@ void CWindow::Create( const char* Title )
 		glfwWindowHint( GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE );
 	}
 
+	if( Headless )
+	{
+		// OSMesa renders into client memory so it works with software GL and no display, EGL can be used for hardware devices.
+		const std::string ContextAPI = config.GetString( "headlesscontext", "osmesa" );
+		if( ContextAPI == "osmesa" )
+		{
+			glfwWindowHint( GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API );
+		}
+		else if( ContextAPI == "egl" )
+		{
+			glfwWindowHint( GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API );
+		}
+
+		if( Width < 1 || Height < 1 )
+		{
+			Width = 1280;
+			Height = 720;
+		}
+
+		glfwWindowHint( GLFW_VISIBLE, GL_FALSE );
+		WindowHandle = glfwCreateWindow( Width, Height, Title, nullptr, ThreadContext( false ) );
+		if( !WindowHandle )
+		{
+			Log::Event( Log::Fatal, "Failed to create a headless context.\n" );
+			return;
+		}
+
+		glfwMakeContextCurrent( WindowHandle );
+		gladLoadGLLoader( (GLADloadproc) glfwGetProcAddress );
+
+		Log::Event( "OpenGL %s (%s, headless)\n", glGetString( GL_VERSION ), glGetString( GL_RENDERER ) );
+
+		// Benchmarks shouldn't be limited by the swap interval.
+		glfwSwapInterval( 0 );
+	}
+	else
+	{
+		CreateVisible( Title );
+	}
+
+#if defined(_DEBUG)
+	if( GLAD_GL_KHR_debug )
+	{
+		Log::Event( "KHR debug extention enabled.\n" );
+		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR );
+		glDebugMessageControlKHR( GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_HIGH_KHR, 0, nullptr, true );
+		glDebugMessageCallbackKHR( DebugCallbackOpenGL, nullptr );
+	}
+#endif
+
+	Log::Event( "Initializing ImGui.\n" );
+#if defined( IMGUI_ENABLED )
+	ImGui::CreateContext();
+	ImGui::StyleColorsDark();
+
+	ImGui_ImplGlfw_InitForOpenGL( WindowHandle, false );
+	ImGui_ImplOpenGL3_Init( "#version 130" );
+#endif
+
+	Initialized = true;
+	Log::Event( "Initialized window.\n" );
+
+	Renderer.Initialize();
+
+	// Benchmark runs are only comparable when they render at the same resolution every frame.
+	if( Headless )
+	{
+		Renderer.SetDynamicResolution( false );
+	}
+}
+
+void CWindow::CreateVisible( const char* Title )
+{
+	CConfiguration& config = CConfiguration::Get();
+
+	const bool EnableBorder = !config.IsEnabled( "noborder", false );
 	const bool FullScreen = EnableBorder && config.IsEnabled( "fullscreen", false );
 	const int TargetMonitor = config.GetInteger( "monitor", -1 );
 
@@ -160,33 +248,9 @@ void CWindow::Create( const char* Title )
 
 	Log::Event( "OpenGL %s\n", glGetString( GL_VERSION ) );
 
-#if defined(_DEBUG)
-	if( GLAD_GL_KHR_debug )
-	{
-		Log::Event( "KHR debug extention enabled.\n" );
-		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR );
-		glDebugMessageControlKHR( GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_HIGH_KHR, 0, nullptr, true );
-		glDebugMessageCallbackKHR( DebugCallbackOpenGL, nullptr );
-	}
-#endif
-
 	const int SwapInterval = config.GetInteger( "vsync", 0 );
 	Log::Event( "Swap interval: %i\n", SwapInterval );
 	glfwSwapInterval( SwapInterval );
-
-	Log::Event( "Initializing ImGui.\n" );
-#if defined( IMGUI_ENABLED )
-	ImGui::CreateContext();
-	ImGui::StyleColorsDark();
-
-	ImGui_ImplGlfw_InitForOpenGL( WindowHandle, false );
-	ImGui_ImplOpenGL3_Init( "#version 130" );
-#endif
-
-	Initialized = true;
-	Log::Event( "Initialized window.\n" );
-
-	Renderer.Initialize();
 }
 
 void CWindow::Terminate()
@@ -197,6 +261,10 @@ void CWindow::Terminate()
 	ImGui::DestroyContext();
 #endif
 
+	// Pages are shared between textures and meshes so they don't belong to any asset, free them while the context still exists.
+	CTextureArray::Release();
+	CGeometryArena::Get().Release();
+
 	glfwTerminate();
 }
 
@@ -261,6 +329,16 @@ bool CWindow::ShouldClose() const
 	return glfwWindowShouldClose( WindowHandle ) > 0;
 }
 
+void CWindow::SetHeadless( const bool Enable )
+{
+	Headless = Enable;
+}
+
+bool CWindow::IsHeadless() const
+{
+	return Headless;
+}
+
 void CWindow::EnableCursor( bool Enabled )
 {
 	ShowCursor = Enabled;
@@ -22,6 +22,10 @@ public:
 	bool Valid() const;
 	bool ShouldClose() const;
 
+	// Headless windows are never shown and don't need a display, they have to be requested before the window is created.
+	void SetHeadless( const bool Enable );
+	bool IsHeadless() const;
+
 	void EnableCursor( bool Enabled );
 	bool IsCursorEnabled() const;
 
@@ -36,11 +40,15 @@ public:
 	}
 
 private:
+	// Opens the visible window, on the monitor and at the position the configuration asks for.
+	void CreateVisible( const char* Title );
+
 	GLFWwindow* WindowHandle;
 	CRenderer Renderer;
 
 	bool Initialized;
 	bool ShowCursor;
+	bool Headless;
 
 	int Width;
 	int Height;
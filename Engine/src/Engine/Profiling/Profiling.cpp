@@ -98,6 +98,16 @@ void CProfiler::AddDebugMessage( const char* NameIn, const char* Body )
 	}
 }
 
+int64_t CProfiler::GetLatestTime( const FName& Name )
+{
+	auto Iterator = TimeEntries.find( Name );
+	if( Iterator == TimeEntries.end() )
+		return 0;
+
+	auto& Buffer = Iterator->second;
+	return Buffer.Get( Buffer.Offset( -1 ) ).Time;
+}
+
 void CProfiler::PlotPerformance()
 {
 	ImDrawList* DrawList = ImGui::GetWindowDrawList();
@@ -355,6 +365,11 @@ CTimerScope::~CTimerScope()
 	Depth--;
 };
 
+size_t CTimerScope::GetDepth()
+{
+	return Depth;
+}
+
 CTimer::CTimer( bool UpdateOnGetElapsed )
 {
 	IsRunning = false;
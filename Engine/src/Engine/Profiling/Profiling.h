@@ -67,6 +67,10 @@ public:
 	void AddCounterEntry( FProfileTimeEntry& TimeEntry, const bool PerFrame = false );
 	void AddCounterEntry( const char* NameIn, int TimeIn );
 	void AddDebugMessage( const char* NameIn, const char* Body );
+
+	// Duration of the most recent time entry with the given name in nanoseconds, zero if there is none.
+	int64_t GetLatestTime( const FName& Name );
+
 	void Display();
 	void Clear();
 	void ClearFrame();
@@ -104,6 +108,9 @@ public:
 	CTimerScope( const FName& ScopeNameIn, bool TextOnly = true );
 	~CTimerScope();
 
+	// Nesting depth of the scopes that are currently open.
+	static size_t GetDepth();
+
 private:
 	FName ScopeName;
 	std::chrono::steady_clock::time_point StartTime;
@@ -12,6 +12,8 @@
 #include <Engine/Display/Rendering/Mesh.h>
 #include <Engine/Display/Rendering/Shader.h>
 #include <Engine/Display/Rendering/Texture.h>
+#include <Engine/Display/Rendering/TextureArray.h>
+#include <Engine/Display/Rendering/TextureStreamer.h>
 
 #include <Engine/Sequencer/Sequencer.h>
 #include <Engine/Profiling/Logging.h>
@@ -22,9 +24,14 @@
 
 static bool ExportOBJToLM = false;
 
+// Format given to meshes imported from OBJ files, exported LM files keep it.
+static EVertexFormat::Type ImportVertexFormat = EVertexFormat::Full;
+
 CAssets::CAssets()
 {
 	ExportOBJToLM = CConfiguration::Get().GetInteger( "ExportOBJToLM", 1 ) > 0;
+	ImportVertexFormat = CConfiguration::Get().GetInteger( "compactvertices", 0 ) > 0 ? EVertexFormat::Compact : EVertexFormat::Full;
+	TexturesPacked = true;
 }
 
 void CAssets::Create( const std::string& Name, CMesh* NewMesh )
@@ -40,6 +47,7 @@ void CAssets::Create( const std::string& Name, CShader* NewShader )
 void CAssets::Create( const std::string& Name, CTexture* NewTexture )
 {
 	Textures.insert_or_assign( Name, NewTexture );
+	TexturesPacked = false;
 }
 
 void CAssets::Create( const std::string& Name, CSound* NewSound )
@@ -162,11 +170,11 @@ void CAssets::CreatedNamedAssets( std::vector<FPrimitivePayload>& Meshes, std::v
 			Log::Event( "Loading shader \"%s\".\n", Payload.Name.c_str() );
 			if( Payload.Locations.size() > 1 )
 			{
-				CreateNamedShader( Payload.Name.c_str(), Payload.Locations[0].c_str(), Payload.Locations[1].c_str() );
+				CreateNamedShader( Payload.Name.c_str(), Payload.Locations[0].c_str(), Payload.Locations[1].c_str(), true );
 			}
 			else
 			{
-				CreateNamedShader( Payload.Name.c_str(), Payload.Locations[0].c_str() );
+				CreateNamedShader( Payload.Name.c_str(), Payload.Locations[0].c_str(), true );
 			}
 		}
 		else if( Payload.Type == EAsset::Texture )
@@ -188,7 +196,7 @@ void CAssets::CreatedNamedAssets( std::vector<FPrimitivePayload>& Meshes, std::v
 				}
 			}
 
-			CreateNamedTexture( Payload.Name.c_str(), Payload.Locations[0].c_str(), Mode, ImageFormat );
+			CreateNamedTexture( Payload.Name.c_str(), Payload.Locations[0].c_str(), Mode, ImageFormat, true );
 		}
 		else if( Payload.Type == EAsset::Sound )
 		{
@@ -210,6 +218,11 @@ void CAssets::CreatedNamedAssets( std::vector<FPrimitivePayload>& Meshes, std::v
 		if( Payload.Native && Payload.Primitive.Vertices && Payload.Primitive.VertexCount > 0 )
 		{
 			Log::Event( "Loading mesh (2nd pass) \"%s\".\n", Payload.Name.c_str() );
+			if( Payload.VertexFormat != EVertexFormat::Default )
+			{
+				Payload.Primitive.VertexFormat = Payload.VertexFormat;
+			}
+
 			auto Mesh = CreateNamedMesh( Payload.Name.c_str(), Payload.Primitive );
 			if( Mesh )
 			{
@@ -220,7 +233,7 @@ void CAssets::CreatedNamedAssets( std::vector<FPrimitivePayload>& Meshes, std::v
 		{
 			Log::Event( "Loading non-native mesh \"%s\".\n", Payload.Name.c_str() );
 			// Try to load the mesh synchronously.
-			auto Mesh = CreateNamedMesh( Payload.Name.c_str(), Payload.Location.c_str() );
+			auto Mesh = CreateNamedMesh( Payload.Name.c_str(), Payload.Location.c_str(), false, Payload.VertexFormat );
 			if( Mesh )
 			{
 				Mesh->SetLocation( Payload.Location );
@@ -233,7 +246,7 @@ void CAssets::CreatedNamedAssets( std::vector<FPrimitivePayload>& Meshes, std::v
 	Log::Event( "Asset list load time: %ims\n", LoadTimer.GetElapsedTimeMilliseconds() );
 }
 
-CMesh* CAssets::CreateNamedMesh( const char* Name, const char* FileLocation, const bool ForceLoad )
+CMesh* CAssets::CreateNamedMesh( const char* Name, const char* FileLocation, const bool ForceLoad, const EVertexFormat::Type VertexFormat )
 {
 	// Transform given name into lower case string
 	std::string NameString = Name;
@@ -271,6 +284,7 @@ CMesh* CAssets::CreateNamedMesh( const char* Name, const char* FileLocation, con
 			{
 				File.Load();
 				MeshBuilder::OBJ( Primitive, File );
+				Primitive.VertexFormat = ImportVertexFormat;
 			}
 			else if( Extension == "lm" )
 			{
@@ -281,6 +295,11 @@ CMesh* CAssets::CreateNamedMesh( const char* Name, const char* FileLocation, con
 			{
 				Log::Event( Log::Warning, "Unknown mesh extension \"%s\".\n", Extension.c_str() );
 			}
+
+			if( VertexFormat != EVertexFormat::Default )
+			{
+				Primitive.VertexFormat = VertexFormat;
+			}
 		}
 
 		if( Primitive.Vertices )
@@ -367,7 +386,7 @@ CMesh* CAssets::CreateNamedMesh( const char* Name, const FPrimitive& Primitive )
 	return nullptr;
 }
 
-CShader* CAssets::CreateNamedShader( const char* Name, const char* FileLocation )
+CShader* CAssets::CreateNamedShader( const char* Name, const char* FileLocation, const bool Asynchronous )
 {
 	// Transform given name into lower case string
 	std::string NameString = Name;
@@ -380,6 +399,8 @@ CShader* CAssets::CreateNamedShader( const char* Name, const char* FileLocation
 	}
 
 	CShader* NewShader = new CShader();
+	NewShader->SetAsynchronous( Asynchronous );
+
 	const bool bSuccessfulCreation = NewShader->Load( FileLocation );
 
 	if( bSuccessfulCreation )
@@ -400,7 +421,7 @@ CShader* CAssets::CreateNamedShader( const char* Name, const char* FileLocation
 	return nullptr;
 }
 
-CShader* CAssets::CreateNamedShader( const char* Name, const char* VertexLocation, const char* FragmentLocation )
+CShader* CAssets::CreateNamedShader( const char* Name, const char* VertexLocation, const char* FragmentLocation, const bool Asynchronous )
 {
 	// Transform given name into lower case string
 	std::string NameString = Name;
@@ -413,6 +434,8 @@ CShader* CAssets::CreateNamedShader( const char* Name, const char* VertexLocatio
 	}
 
 	CShader* NewShader = new CShader();
+	NewShader->SetAsynchronous( Asynchronous );
+
 	const bool bSuccessfulCreation = NewShader->Load( VertexLocation, FragmentLocation );
 
 	if( bSuccessfulCreation )
@@ -433,7 +456,7 @@ CShader* CAssets::CreateNamedShader( const char* Name, const char* VertexLocatio
 	return nullptr;
 }
 
-CTexture* CAssets::CreateNamedTexture( const char* Name, const char* FileLocation, const EFilteringMode Mode, const EImageFormat Format )
+CTexture* CAssets::CreateNamedTexture( const char* Name, const char* FileLocation, const EFilteringMode Mode, const EImageFormat Format, const bool Asynchronous )
 {
 	// Transform given name into lower case string
 	std::string NameString = Name;
@@ -446,7 +469,20 @@ CTexture* CAssets::CreateNamedTexture( const char* Name, const char* FileLocatio
 	}
 
 	CTexture* NewTexture = new CTexture( FileLocation );
-	const bool bSuccessfulCreation = NewTexture->Load( Mode, Format );
+
+	bool bSuccessfulCreation = false;
+	CTextureStreamer& Streamer = CTextureStreamer::Get();
+	if( Asynchronous && Streamer.IsEnabled() )
+	{
+		// Streamed textures show the error texture until they have been uploaded.
+		CTexture* Placeholder = FindTexture( "error" );
+		Streamer.Queue( NewTexture, Mode, Format, Placeholder ? Placeholder->GetHandle() : 0 );
+		bSuccessfulCreation = true;
+	}
+	else
+	{
+		bSuccessfulCreation = NewTexture->Load( Mode, Format );
+	}
 
 	if( bSuccessfulCreation )
 	{
@@ -718,11 +754,43 @@ const std::string& CAssets::GetReadableImageFormat( EImageFormat Format )
 	return "unknown";
 }
 
+void CAssets::PackTextures()
+{
+	if( TexturesPacked || CTextureStreamer::Get().GetPending() > 0 )
+		return;
+
+	TexturesPacked = true;
+
+	static const bool PackTextureArrays = CConfiguration::Get().GetInteger( "texturearrays", 1 ) > 0;
+	if( !PackTextureArrays )
+		return;
+
+	// Textures stay separate on contexts that can't create views of array layers.
+	if( !CTextureArray::IsSupported() )
+	{
+		Log::Event( Log::Warning, "Texture arrays require OpenGL 4.3 or ARB_texture_storage, ARB_copy_image and ARB_texture_view.\n" );
+		return;
+	}
+
+	std::vector<CTexture*> Unpacked;
+	for( auto& Texture : Textures )
+	{
+		if( !Texture.second->GetPage() )
+		{
+			Unpacked.emplace_back( Texture.second );
+		}
+	}
+
+	CTextureArray::Pack( Unpacked );
+}
+
 void CAssets::ReloadShaders()
 {
-	Log::Event( "Reloading shaders.\n" );
-	for( auto Shader : Shaders )
+	// Only shaders that were processed from a file that changed since are recompiled.
+	const std::vector<CShader*> Outdated = CShader::GetOutdated();
+	Log::Event( "Reloading %u of %u shaders.\n", static_cast<uint32_t>( Outdated.size() ), static_cast<uint32_t>( Shaders.size() ) );
+	for( auto Shader : Outdated )
 	{
-		Shader.second->Reload();
+		Shader->Reload();
 	}
 }
@@ -19,6 +19,9 @@ struct FPrimitivePayload
 	std::string Location;
 	FPrimitive Primitive;
 	bool Native;
+
+	// Overrides the format stored in the file when set.
+	EVertexFormat::Type VertexFormat = EVertexFormat::Default;
 };
 
 namespace EAsset
@@ -52,11 +55,11 @@ public:
 
 	void CreatedNamedAssets( std::vector<FPrimitivePayload>& Meshes, std::vector<FGenericAssetPayload>& GenericAssets );
 
-	CMesh* CreateNamedMesh( const char* Name, const char* FileLocation, const bool ForceLoad = false );
+	CMesh* CreateNamedMesh( const char* Name, const char* FileLocation, const bool ForceLoad = false, const EVertexFormat::Type VertexFormat = EVertexFormat::Default );
 	CMesh* CreateNamedMesh( const char* Name, const FPrimitive& Primitive );
-	CShader* CreateNamedShader( const char* Name, const char* FileLocation );
-	CShader* CreateNamedShader( const char* Name, const char* VertexLocation, const char* FragmentLocation );
-	CTexture* CreateNamedTexture( const char* Name, const char* FileLocation, const EFilteringMode Mode = EFilteringMode::Linear, const EImageFormat Format = EImageFormat::RGB8 );
+	CShader* CreateNamedShader( const char* Name, const char* FileLocation, const bool Asynchronous = false );
+	CShader* CreateNamedShader( const char* Name, const char* VertexLocation, const char* FragmentLocation, const bool Asynchronous = false );
+	CTexture* CreateNamedTexture( const char* Name, const char* FileLocation, const EFilteringMode Mode = EFilteringMode::Linear, const EImageFormat Format = EImageFormat::RGB8, const bool Asynchronous = false );
 	CTexture* CreateNamedTexture( const char* Name, unsigned char* Data, const int Width, const int Height, const int Channels, const EFilteringMode Mode = EFilteringMode::Linear, const EImageFormat Format = EImageFormat::RGB8 );
 	CSound* CreateNamedSound( const char* Name, const char* FileLocation );
 	CSound* CreateNamedSound( const char* Name );
@@ -88,6 +91,9 @@ public:
 
 	void ReloadShaders();
 
+	// Packs textures that have finished loading into texture arrays, waits until no textures are being streamed.
+	void PackTextures();
+
 	const std::unordered_map<std::string, CMesh*>& GetMeshes() const
 	{
 		return Meshes;
@@ -120,6 +126,8 @@ private:
 	std::unordered_map<std::string, CSound*> Sounds;
 	std::unordered_map<std::string, CSequence*> Sequences;
 
+	bool TexturesPacked;
+
 public:
 	static CAssets& Get()
 	{
@@ -0,0 +1,144 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <Engine/Utility/Data.h>
+
+static const char CompressedImageIdentifier[5] = "LTEX"; // Lofty TEXture
+static const size_t CompressedImageVersion = 1;
+
+static const uint32_t MaximumMipLevels = 16;
+
+namespace EBlockCompression
+{
+	enum Type
+	{
+		None = 0,
+
+		// Opaque color.
+		BC1,
+
+		// Color with alpha.
+		BC3,
+
+		// Two independent channels.
+		BC5,
+
+		Maximum
+	};
+}
+
+// Number of 64-bit words in a 4x4 block.
+static const uint32_t BlockCompressionWords[EBlockCompression::Maximum] = {
+	0,
+	1,
+	2,
+	2
+};
+
+struct FCompressedMip
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+
+	// Range of the block data that belongs to this level, in 64-bit words.
+	uint32_t Offset = 0;
+	uint32_t Size = 0;
+};
+
+// Block compressed image with its full mip chain.
+struct FCompressedImage
+{
+	uint32_t Compression = EBlockCompression::None;
+	uint32_t MipCount = 0;
+	FCompressedMip Mips[MaximumMipLevels];
+	std::vector<uint64_t> Blocks;
+
+	friend CData& operator<<( CData& Data, FCompressedImage& Image )
+	{
+		Data << CompressedImageIdentifier;
+		Data << CompressedImageVersion;
+
+		Data << Image.Compression;
+		Data << Image.MipCount;
+
+		for( uint32_t Level = 0; Level < Image.MipCount; Level++ )
+		{
+			Data << Image.Mips[Level].Width;
+			Data << Image.Mips[Level].Height;
+			Data << Image.Mips[Level].Offset;
+			Data << Image.Mips[Level].Size;
+		}
+
+		uint32_t BlockCount = static_cast<uint32_t>( Image.Blocks.size() );
+		Data << BlockCount;
+
+		for( size_t Index = 0; Index < Image.Blocks.size(); Index++ )
+		{
+			Data << Image.Blocks[Index];
+		}
+
+		return Data;
+	};
+
+	friend CData& operator>>( CData& Data, FCompressedImage& Image )
+	{
+		char Identifier[5];
+		Data >> Identifier;
+
+		size_t Version;
+		Data >> Version;
+
+		Image.MipCount = 0;
+
+		if( strcmp( Identifier, CompressedImageIdentifier ) == 0 && Version == CompressedImageVersion )
+		{
+			uint32_t MipCount = 0;
+			Data >> Image.Compression;
+			Data >> MipCount;
+
+			if( Image.Compression == EBlockCompression::None || Image.Compression >= EBlockCompression::Maximum || MipCount > MaximumMipLevels )
+			{
+				Data.Invalidate();
+				return Data;
+			}
+
+			for( uint32_t Level = 0; Level < MipCount; Level++ )
+			{
+				Data >> Image.Mips[Level].Width;
+				Data >> Image.Mips[Level].Height;
+				Data >> Image.Mips[Level].Offset;
+				Data >> Image.Mips[Level].Size;
+			}
+
+			uint32_t BlockCount = 0;
+			Data >> BlockCount;
+
+			// Levels that point outside of the block data would be read past the end when uploading.
+			for( uint32_t Level = 0; Level < MipCount; Level++ )
+			{
+				if( static_cast<uint64_t>( Image.Mips[Level].Offset ) + Image.Mips[Level].Size > BlockCount )
+				{
+					Data.Invalidate();
+					return Data;
+				}
+			}
+
+			Image.Blocks.resize( BlockCount );
+			for( uint32_t Index = 0; Index < BlockCount; Index++ )
+			{
+				Data >> Image.Blocks[Index];
+			}
+
+			Image.MipCount = MipCount;
+		}
+		else
+		{
+			Data.Invalidate();
+		}
+
+		return Data;
+	};
+};
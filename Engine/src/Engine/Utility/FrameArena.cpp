@@ -0,0 +1,95 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "FrameArena.h"
+
+CFrameArena::CFrameArena( const size_t BlockSizeIn )
+{
+	BlockSize = BlockSizeIn;
+	CurrentBlock = 0;
+	Used = 0;
+	HighWaterMark = 0;
+}
+
+CFrameArena::~CFrameArena()
+{
+	Reset();
+
+	for( auto& Block : Blocks )
+	{
+		delete[] Block.Data;
+	}
+
+	Blocks.clear();
+}
+
+void* CFrameArena::Allocate( const size_t Size, const size_t Alignment )
+{
+	for( ; CurrentBlock < Blocks.size(); CurrentBlock++ )
+	{
+		FBlock& Block = Blocks[CurrentBlock];
+		const uintptr_t Address = reinterpret_cast<uintptr_t>( Block.Data + Block.Offset );
+		const size_t Padding = ( Alignment - ( Address % Alignment ) ) % Alignment;
+
+		if( Block.Offset + Padding + Size <= Block.Size )
+		{
+			void* Memory = Block.Data + Block.Offset + Padding;
+			Block.Offset += Padding + Size;
+
+			Used += Padding + Size;
+			HighWaterMark = Used > HighWaterMark ? Used : HighWaterMark;
+
+			return Memory;
+		}
+	}
+
+	// None of the blocks have enough space left, oversized allocations get a block of their own.
+	FBlock Block;
+	Block.Size = Size + Alignment > BlockSize ? Size + Alignment : BlockSize;
+	Block.Data = new uint8_t[Block.Size];
+	Block.Offset = 0;
+	Blocks.emplace_back( Block );
+	CurrentBlock = Blocks.size() - 1;
+
+	return Allocate( Size, Alignment );
+}
+
+bool CFrameArena::Owns( const void* Pointer ) const
+{
+	const uint8_t* Address = static_cast<const uint8_t*>( Pointer );
+	for( auto& Block : Blocks )
+	{
+		if( Address >= Block.Data && Address < Block.Data + Block.Size )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CFrameArena::Reset()
+{
+	for( auto Iterator = Destructors.rbegin(); Iterator != Destructors.rend(); ++Iterator )
+	{
+		Iterator->Destroy( Iterator->Object );
+	}
+
+	Destructors.clear();
+
+	for( auto& Block : Blocks )
+	{
+		Block.Offset = 0;
+	}
+
+	CurrentBlock = 0;
+	Used = 0;
+}
+
+size_t CFrameArena::GetUsed() const
+{
+	return Used;
+}
+
+size_t CFrameArena::GetHighWaterMark() const
+{
+	return HighWaterMark;
+}
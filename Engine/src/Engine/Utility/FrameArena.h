@@ -0,0 +1,67 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Linear allocator for data that only lives for a single frame, everything is released at once by Reset().
+class CFrameArena
+{
+public:
+	CFrameArena( const size_t BlockSize = 1 << 20 );
+	~CFrameArena();
+
+	void* Allocate( const size_t Size, const size_t Alignment = alignof( std::max_align_t ) );
+
+	template<typename T, typename... Arguments>
+	T* Emplace( Arguments&&... Parameters )
+	{
+		void* Memory = Allocate( sizeof( T ), alignof( T ) );
+		T* Object = new( Memory ) T( std::forward<Arguments>( Parameters )... );
+
+		if( !std::is_trivially_destructible<T>::value )
+		{
+			FDestructor Destructor;
+			Destructor.Object = Object;
+			Destructor.Destroy = []( void* Pointer ) { static_cast<T*>( Pointer )->~T(); };
+			Destructors.emplace_back( Destructor );
+		}
+
+		return Object;
+	}
+
+	// True if the pointer lies within one of the arena's blocks.
+	bool Owns( const void* Pointer ) const;
+
+	// Destroys all emplaced objects and rewinds the arena, blocks are kept for the next frame.
+	void Reset();
+
+	size_t GetUsed() const;
+	size_t GetHighWaterMark() const;
+
+private:
+	struct FBlock
+	{
+		uint8_t* Data;
+		size_t Size;
+		size_t Offset;
+	};
+
+	struct FDestructor
+	{
+		void* Object;
+		void( *Destroy )( void* );
+	};
+
+	std::vector<FBlock> Blocks;
+	std::vector<FDestructor> Destructors;
+
+	size_t BlockSize;
+	size_t CurrentBlock;
+	size_t Used;
+	size_t HighWaterMark;
+};
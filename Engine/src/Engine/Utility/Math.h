@@ -236,12 +236,14 @@ namespace Math
 
 struct FFrustumPlane
 {
+	FFrustumPlane()
+	{
+		Normal = Vector3D( 0.0f, 0.0f, 0.0f );
+		Distance = 0.0f;
+	}
 
-};
-
-struct FFrustum
-{
-	FFrustumPlane Planes[6];
+	Vector3D Normal;
+	float Distance;
 };
 
 struct FBounds
@@ -256,6 +258,66 @@ struct FBounds
 	Vector3D Maximum;
 };
 
+namespace EFrustumPlane
+{
+	enum Type
+	{
+		Left = 0,
+		Right,
+		Bottom,
+		Top,
+		Near,
+		Far,
+		Maximum
+	};
+}
+
+struct FFrustum
+{
+	// Extracts the planes from a combined projection and view matrix, normals point inwards.
+	void Extract( const glm::mat4& ProjectionView )
+	{
+		for( int Index = 0; Index < EFrustumPlane::Maximum; Index++ )
+		{
+			const int Row = Index / 2;
+			const float Sign = ( Index % 2 ) == 0 ? 1.0f : -1.0f;
+
+			Vector3D Normal;
+			Normal.X = ProjectionView[0][3] + Sign * ProjectionView[0][Row];
+			Normal.Y = ProjectionView[1][3] + Sign * ProjectionView[1][Row];
+			Normal.Z = ProjectionView[2][3] + Sign * ProjectionView[2][Row];
+			const float Distance = ProjectionView[3][3] + Sign * ProjectionView[3][Row];
+
+			const float InverseLength = 1.0f / ( Normal.Length() + FLT_EPSILON );
+			Planes[Index].Normal = Normal * InverseLength;
+			Planes[Index].Distance = Distance * InverseLength;
+		}
+	}
+
+	// Returns false if the box is entirely outside of any of the planes.
+	bool Contains( const FBounds& Bounds ) const
+	{
+		for( int Index = 0; Index < EFrustumPlane::Maximum; Index++ )
+		{
+			const FFrustumPlane& Plane = Planes[Index];
+
+			// Test the corner that lies furthest along the plane normal.
+			const float X = Plane.Normal.X > 0.0f ? Bounds.Maximum.X : Bounds.Minimum.X;
+			const float Y = Plane.Normal.Y > 0.0f ? Bounds.Maximum.Y : Bounds.Minimum.Y;
+			const float Z = Plane.Normal.Z > 0.0f ? Bounds.Maximum.Z : Bounds.Minimum.Z;
+
+			if( Plane.Normal.X * X + Plane.Normal.Y * Y + Plane.Normal.Z * Z + Plane.Distance < 0.0f )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	FFrustumPlane Planes[EFrustumPlane::Maximum];
+};
+
 struct FTransform
 {
 public:
@@ -1,7 +1,9 @@
 // Copyright  2017, Christiaan Bakker, All rights reserved.
 #include "MeshBuilder.h"
 
+#include <algorithm>
 #include <map>
+#include <queue>
 #include <sstream>
 
 #include <Engine/Profiling/Logging.h>
@@ -428,6 +430,9 @@ void MeshBuilder::OBJ( FPrimitive& Primitive, const CFile& File )
 		Primitive.Indices = IndexArray;
 		Primitive.IndexCount = static_cast<uint32_t>( VertexIndices.size() );
 	}
+
+	LevelsOfDetail( Primitive );
+	Optimize( Primitive );
 }
 
 void MeshBuilder::LM( FPrimitive& Primitive, const CFile& File )
@@ -456,7 +461,14 @@ void MeshBuilder::Mesh( FPrimitive& Primitive, CMesh* MeshInstance )
 		memcpy( Primitive.Vertices, VertexData.Vertices, Primitive.VertexCount * sizeof( FVertex ) );
 		memcpy( Primitive.Indices, IndexData.Indices, Primitive.IndexCount * sizeof( glm::uint ) );
 
+		Primitive.LevelOfDetailCount = MeshInstance->GetLevelOfDetailCount();
+		for( uint32_t Level = 0; Level < Primitive.LevelOfDetailCount; Level++ )
+		{
+			Primitive.LevelsOfDetail[Level] = MeshInstance->GetLevelOfDetail( Level );
+		}
+
 		Primitive.HasNormals = true;
+		Primitive.VertexFormat = MeshInstance->GetVertexFormat();
 	}
 }
 
@@ -507,4 +519,689 @@ void MeshBuilder::Soup( FPrimitive& Primitive, std::vector<Vector3D> Vertices )
 	Primitive.VertexCount = static_cast<uint32_t>( SoupCount );
 	Primitive.Indices = Indices;
 	Primitive.IndexCount = static_cast<uint32_t>( IndexCount );
+
+	Optimize( Primitive );
+}
+
+// Symmetric 4x4 matrix that measures the squared distance to a set of planes.
+struct FQuadric
+{
+	FQuadric()
+	{
+		memset( Terms, 0, sizeof( Terms ) );
+	}
+
+	FQuadric( const double A, const double B, const double C, const double D, const double Weight )
+	{
+		Terms[0] = A * A * Weight;
+		Terms[1] = A * B * Weight;
+		Terms[2] = A * C * Weight;
+		Terms[3] = A * D * Weight;
+		Terms[4] = B * B * Weight;
+		Terms[5] = B * C * Weight;
+		Terms[6] = B * D * Weight;
+		Terms[7] = C * C * Weight;
+		Terms[8] = C * D * Weight;
+		Terms[9] = D * D * Weight;
+	}
+
+	void operator+=( const FQuadric& Quadric )
+	{
+		for( int Index = 0; Index < 10; Index++ )
+		{
+			Terms[Index] += Quadric.Terms[Index];
+		}
+	}
+
+	double Error( const Vector3D& Position ) const
+	{
+		const double X = Position.X;
+		const double Y = Position.Y;
+		const double Z = Position.Z;
+		return Terms[0] * X * X + 2.0 * Terms[1] * X * Y + 2.0 * Terms[2] * X * Z + 2.0 * Terms[3] * X
+			+ Terms[4] * Y * Y + 2.0 * Terms[5] * Y * Z + 2.0 * Terms[6] * Y
+			+ Terms[7] * Z * Z + 2.0 * Terms[8] * Z
+			+ Terms[9];
+	}
+
+	double Terms[10];
+};
+
+struct FEdgeCollapse
+{
+	double Cost;
+	uint32_t From;
+	uint32_t To;
+	uint32_t FromVersion;
+	uint32_t ToVersion;
+
+	bool operator>( const FEdgeCollapse& Collapse ) const
+	{
+		return Cost > Collapse.Cost;
+	}
+};
+
+// Meshes with fewer triangles than this aren't worth simplifying.
+static const uint32_t MinimumSimplifyTriangles = 64;
+
+void MeshBuilder::LevelsOfDetail( FPrimitive& Primitive, const uint32_t Levels, const float Reduction )
+{
+	ProfileBareScope();
+
+	Primitive.LevelOfDetailCount = 0;
+
+	const uint32_t TriangleCount = Primitive.IndexCount / 3;
+	if( !Primitive.Vertices || !Primitive.Indices || TriangleCount < MinimumSimplifyTriangles || Levels < 2 )
+		return;
+
+	// Vertices that share a position are collapsed together so that texture and normal seams don't tear open.
+	std::vector<uint32_t> Representative( Primitive.VertexCount );
+	{
+		std::map<Vector3D, uint32_t, VectorComparator> Positions;
+		for( uint32_t Index = 0; Index < Primitive.VertexCount; Index++ )
+		{
+			auto Iterator = Positions.find( Primitive.Vertices[Index].Position );
+			if( Iterator == Positions.end() )
+			{
+				Positions.insert_or_assign( Primitive.Vertices[Index].Position, Index );
+				Representative[Index] = Index;
+			}
+			else
+			{
+				Representative[Index] = Iterator->second;
+			}
+		}
+	}
+
+	const uint32_t VertexCount = Primitive.VertexCount;
+	std::vector<uint32_t> Triangles( TriangleCount * 3 );
+	std::vector<bool> Live( TriangleCount, true );
+	std::vector<std::vector<uint32_t>> Adjacency( VertexCount );
+	std::vector<FQuadric> Quadrics( VertexCount );
+	std::map<uint64_t, uint32_t> EdgeUses;
+
+	auto EdgeKey = [] ( const uint32_t A, const uint32_t B )
+	{
+		return A < B ? ( uint64_t( A ) << 32 ) | B : ( uint64_t( B ) << 32 ) | A;
+	};
+
+	uint32_t LiveTriangles = 0;
+	for( uint32_t Triangle = 0; Triangle < TriangleCount; Triangle++ )
+	{
+		uint32_t* Corners = &Triangles[Triangle * 3];
+		for( uint32_t Corner = 0; Corner < 3; Corner++ )
+		{
+			Corners[Corner] = Representative[Primitive.Indices[Triangle * 3 + Corner]];
+		}
+
+		if( Corners[0] == Corners[1] || Corners[1] == Corners[2] || Corners[0] == Corners[2] )
+		{
+			Live[Triangle] = false;
+			continue;
+		}
+
+		LiveTriangles++;
+
+		const Vector3D& Position0 = Primitive.Vertices[Corners[0]].Position;
+		const Vector3D Cross = ( Primitive.Vertices[Corners[1]].Position - Position0 ).Cross( Primitive.Vertices[Corners[2]].Position - Position0 );
+		const double Length = Cross.Length();
+		if( Length > 0.0 )
+		{
+			// Weigh each plane by the area of the triangle it came from.
+			const Vector3D Normal = Cross * static_cast<float>( 1.0 / Length );
+			const FQuadric Quadric( Normal.X, Normal.Y, Normal.Z, -Normal.Dot( Position0 ), Length * 0.5 );
+			for( uint32_t Corner = 0; Corner < 3; Corner++ )
+			{
+				Quadrics[Corners[Corner]] += Quadric;
+			}
+		}
+
+		for( uint32_t Corner = 0; Corner < 3; Corner++ )
+		{
+			Adjacency[Corners[Corner]].emplace_back( Triangle );
+			EdgeUses[EdgeKey( Corners[Corner], Corners[( Corner + 1 ) % 3] )]++;
+		}
+	}
+
+	// Vertices on open or non-manifold edges keep their place to preserve the silhouette.
+	std::vector<bool> Locked( VertexCount, false );
+	for( auto& Edge : EdgeUses )
+	{
+		if( Edge.second != 2 )
+		{
+			Locked[Edge.first >> 32] = true;
+			Locked[Edge.first & 0xffffffff] = true;
+		}
+	}
+
+	std::vector<uint32_t> Versions( VertexCount, 0 );
+	std::vector<uint32_t> Collapsed( VertexCount );
+	for( uint32_t Index = 0; Index < VertexCount; Index++ )
+	{
+		Collapsed[Index] = Index;
+	}
+
+	std::priority_queue<FEdgeCollapse, std::vector<FEdgeCollapse>, std::greater<FEdgeCollapse>> Queue;
+	auto Push = [&] ( const uint32_t From, const uint32_t To )
+	{
+		if( Locked[From] )
+			return;
+
+		FQuadric Quadric = Quadrics[From];
+		Quadric += Quadrics[To];
+
+		FEdgeCollapse Collapse;
+		Collapse.Cost = Quadric.Error( Primitive.Vertices[To].Position );
+		Collapse.From = From;
+		Collapse.To = To;
+		Collapse.FromVersion = Versions[From];
+		Collapse.ToVersion = Versions[To];
+		Queue.push( Collapse );
+	};
+
+	for( auto& Edge : EdgeUses )
+	{
+		const uint32_t A = static_cast<uint32_t>( Edge.first >> 32 );
+		const uint32_t B = static_cast<uint32_t>( Edge.first & 0xffffffff );
+		Push( A, B );
+		Push( B, A );
+	}
+
+	// Rejects collapses that would flip or flatten a triangle around the vertex that is moved.
+	auto CanCollapse = [&] ( const uint32_t From, const uint32_t To )
+	{
+		const Vector3D& Target = Primitive.Vertices[To].Position;
+		for( auto Triangle : Adjacency[From] )
+		{
+			const uint32_t* Corners = &Triangles[Triangle * 3];
+			if( !Live[Triangle] || Corners[0] == To || Corners[1] == To || Corners[2] == To )
+				continue;
+
+			Vector3D Positions[3];
+			Vector3D Moved[3];
+			for( uint32_t Corner = 0; Corner < 3; Corner++ )
+			{
+				Positions[Corner] = Primitive.Vertices[Corners[Corner]].Position;
+				Moved[Corner] = Corners[Corner] == From ? Target : Positions[Corner];
+			}
+
+			const Vector3D Before = ( Positions[1] - Positions[0] ).Cross( Positions[2] - Positions[0] );
+			const Vector3D After = ( Moved[1] - Moved[0] ).Cross( Moved[2] - Moved[0] );
+			if( Before.Dot( After ) <= 0.0f )
+				return false;
+		}
+
+		return true;
+	};
+
+	std::vector<uint32_t> LevelIndices;
+	LevelIndices.reserve( Primitive.IndexCount );
+
+	Primitive.LevelsOfDetail[0].FirstIndex = 0;
+	Primitive.LevelsOfDetail[0].IndexCount = Primitive.IndexCount;
+	uint32_t LevelCount = 1;
+
+	uint32_t PreviousTriangles = LiveTriangles;
+	const uint32_t MaximumLevels = Levels < MaximumLevelsOfDetail ? Levels : MaximumLevelsOfDetail;
+	for( uint32_t Level = 1; Level < MaximumLevels; Level++ )
+	{
+		const uint32_t TargetTriangles = static_cast<uint32_t>( PreviousTriangles * Reduction );
+		while( LiveTriangles > TargetTriangles && !Queue.empty() )
+		{
+			const FEdgeCollapse Collapse = Queue.top();
+			Queue.pop();
+
+			const uint32_t From = Collapse.From;
+			const uint32_t To = Collapse.To;
+			if( Collapsed[From] != From || Collapsed[To] != To || Versions[From] != Collapse.FromVersion || Versions[To] != Collapse.ToVersion )
+				continue;
+
+			if( !CanCollapse( From, To ) )
+				continue;
+
+			for( auto Triangle : Adjacency[From] )
+			{
+				if( !Live[Triangle] )
+					continue;
+
+				uint32_t* Corners = &Triangles[Triangle * 3];
+				if( Corners[0] == To || Corners[1] == To || Corners[2] == To )
+				{
+					Live[Triangle] = false;
+					LiveTriangles--;
+					continue;
+				}
+
+				for( uint32_t Corner = 0; Corner < 3; Corner++ )
+				{
+					if( Corners[Corner] == From )
+					{
+						Corners[Corner] = To;
+					}
+				}
+
+				Adjacency[To].emplace_back( Triangle );
+			}
+
+			Adjacency[From].clear();
+			Collapsed[From] = To;
+			Quadrics[To] += Quadrics[From];
+			Versions[To]++;
+
+			// Only the costs of edges that touch the merged vertex have changed.
+			for( auto Triangle : Adjacency[To] )
+			{
+				if( !Live[Triangle] )
+					continue;
+
+				const uint32_t* Corners = &Triangles[Triangle * 3];
+				for( uint32_t Corner = 0; Corner < 3; Corner++ )
+				{
+					if( Corners[Corner] != To )
+					{
+						Push( Corners[Corner], To );
+						Push( To, Corners[Corner] );
+					}
+				}
+			}
+		}
+
+		// Stop once the simplifier can't make meaningful progress anymore.
+		if( LiveTriangles == 0 || LiveTriangles > PreviousTriangles * 0.9f )
+			break;
+
+		FLevelOfDetail& LevelOfDetail = Primitive.LevelsOfDetail[LevelCount];
+		LevelOfDetail.FirstIndex = Primitive.IndexCount + static_cast<uint32_t>( LevelIndices.size() );
+		for( uint32_t Triangle = 0; Triangle < TriangleCount; Triangle++ )
+		{
+			if( !Live[Triangle] )
+				continue;
+
+			for( uint32_t Corner = 0; Corner < 3; Corner++ )
+			{
+				// Corners that weren't moved keep their original vertex so seams keep their attributes.
+				const uint32_t Original = Primitive.Indices[Triangle * 3 + Corner];
+				const uint32_t Current = Triangles[Triangle * 3 + Corner];
+				LevelIndices.emplace_back( Representative[Original] == Current ? Original : Current );
+			}
+		}
+
+		LevelOfDetail.IndexCount = Primitive.IndexCount + static_cast<uint32_t>( LevelIndices.size() ) - LevelOfDetail.FirstIndex;
+		PreviousTriangles = LiveTriangles;
+		LevelCount++;
+	}
+
+	if( LevelCount < 2 )
+		return;
+
+	const uint32_t IndexCount = Primitive.IndexCount + static_cast<uint32_t>( LevelIndices.size() );
+	glm::uint* Indices = new glm::uint[IndexCount];
+	memcpy( Indices, Primitive.Indices, Primitive.IndexCount * sizeof( glm::uint ) );
+	memcpy( Indices + Primitive.IndexCount, LevelIndices.data(), LevelIndices.size() * sizeof( glm::uint ) );
+
+	delete[] Primitive.Indices;
+	Primitive.Indices = Indices;
+	Primitive.IndexCount = IndexCount;
+	Primitive.LevelOfDetailCount = LevelCount;
+
+	Log::Event( "Generated %u levels of detail, coarsest level has %u triangles.\n", LevelCount, PreviousTriangles );
+}
+
+// Size of the FIFO cache that ACMR is measured against, close to what current GPUs effectively reuse.
+static const uint32_t SimulatedCacheSize = 16;
+
+// Forsyth's scoring keeps a larger LRU cache so that vertices keep some score after they've left the real cache.
+static const uint32_t ScoringCacheSize = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+// Overdraw ordering may raise the ACMR of the cache optimized order by this much.
+static const float OverdrawThreshold = 1.05f;
+
+float MeshBuilder::ACMR( const glm::uint* Indices, const uint32_t IndexCount, const uint32_t CacheSize )
+{
+	const uint32_t TriangleCount = IndexCount / 3;
+	if( TriangleCount == 0 )
+		return 0.0f;
+
+	std::vector<glm::uint> Cache;
+	Cache.reserve( CacheSize );
+
+	uint32_t Misses = 0;
+	for( uint32_t Index = 0; Index < TriangleCount * 3; Index++ )
+	{
+		if( std::find( Cache.begin(), Cache.end(), Indices[Index] ) != Cache.end() )
+			continue;
+
+		Misses++;
+		if( Cache.size() == CacheSize )
+		{
+			Cache.erase( Cache.begin() );
+		}
+
+		Cache.emplace_back( Indices[Index] );
+	}
+
+	return static_cast<float>( Misses ) / static_cast<float>( TriangleCount );
+}
+
+static float VertexScore( const int32_t CachePosition, const uint32_t RemainingTriangles )
+{
+	if( RemainingTriangles == 0 )
+		return -1.0f;
+
+	float Score = 0.0f;
+	if( CachePosition >= 0 )
+	{
+		if( CachePosition < 3 )
+		{
+			// The triangle that was just added shouldn't win again straight away.
+			Score = LastTriangleScore;
+		}
+		else
+		{
+			const float Scale = 1.0f / static_cast<float>( ScoringCacheSize - 3 );
+			Score = powf( 1.0f - static_cast<float>( CachePosition - 3 ) * Scale, CacheDecayPower );
+		}
+	}
+
+	// Vertices with few triangles left are finished off first so they don't have to be transformed again later.
+	Score += ValenceBoostScale * powf( static_cast<float>( RemainingTriangles ), -ValenceBoostPower );
+	return Score;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimization, greedily emits the triangle whose vertices score highest.
+static void OptimizeVertexCache( glm::uint* Indices, const uint32_t IndexCount, const uint32_t VertexCount )
+{
+	const uint32_t TriangleCount = IndexCount / 3;
+	if( TriangleCount == 0 )
+		return;
+
+	// Triangles adjacent to every vertex, stored as offsets into one list.
+	std::vector<uint32_t> Remaining( VertexCount, 0 );
+	for( uint32_t Index = 0; Index < TriangleCount * 3; Index++ )
+	{
+		Remaining[Indices[Index]]++;
+	}
+
+	std::vector<uint32_t> AdjacencyOffset( VertexCount + 1, 0 );
+	for( uint32_t Vertex = 0; Vertex < VertexCount; Vertex++ )
+	{
+		AdjacencyOffset[Vertex + 1] = AdjacencyOffset[Vertex] + Remaining[Vertex];
+	}
+
+	std::vector<uint32_t> Adjacency( AdjacencyOffset[VertexCount] );
+	std::vector<uint32_t> AdjacencyFill( AdjacencyOffset.begin(), AdjacencyOffset.end() - 1 );
+	for( uint32_t Index = 0; Index < TriangleCount * 3; Index++ )
+	{
+		Adjacency[AdjacencyFill[Indices[Index]]++] = Index / 3;
+	}
+
+	std::vector<int32_t> CachePosition( VertexCount, -1 );
+	std::vector<float> Score( VertexCount, 0.0f );
+	for( uint32_t Vertex = 0; Vertex < VertexCount; Vertex++ )
+	{
+		Score[Vertex] = VertexScore( -1, Remaining[Vertex] );
+	}
+
+
+	std::vector<bool> Emitted( TriangleCount, false );
+	std::vector<glm::uint> Output;
+	Output.reserve( TriangleCount * 3 );
+
+	// Holds three extra entries while the vertices of a new triangle are pushed in front.
+	std::vector<uint32_t> Cache;
+	Cache.reserve( ScoringCacheSize + 3 );
+
+	uint32_t Cursor = 0;
+	int64_t Best = -1;
+	for( uint32_t Step = 0; Step < TriangleCount; Step++ )
+	{
+		// Nothing in the cache has triangles left, continue with the next triangle in the input order.
+		if( Best < 0 )
+		{
+			while( Emitted[Cursor] )
+			{
+				Cursor++;
+			}
+
+			Best = Cursor;
+		}
+
+		const uint32_t Triangle = static_cast<uint32_t>( Best );
+		Emitted[Triangle] = true;
+
+		std::vector<uint32_t> Updated( Cache.begin(), Cache.end() );
+		for( uint32_t Corner = 0; Corner < 3; Corner++ )
+		{
+			const uint32_t Vertex = Indices[Triangle * 3 + Corner];
+			Output.emplace_back( Vertex );
+
+			// Take the triangle out of the adjacency of its vertices, degenerate triangles appear more than once.
+			for( uint32_t Offset = AdjacencyOffset[Vertex]; Offset < AdjacencyOffset[Vertex] + Remaining[Vertex]; Offset++ )
+			{
+				if( Adjacency[Offset] == Triangle )
+				{
+					Adjacency[Offset] = Adjacency[AdjacencyOffset[Vertex] + Remaining[Vertex] - 1];
+					Remaining[Vertex]--;
+					break;
+				}
+			}
+		}
+
+		// Move the vertices of the triangle to the front of the cache, most recent first.
+		for( int32_t Corner = 2; Corner >= 0; Corner-- )
+		{
+			const uint32_t Vertex = Indices[Triangle * 3 + Corner];
+			auto Iterator = std::find( Cache.begin(), Cache.end(), Vertex );
+			if( Iterator != Cache.end() )
+			{
+				Cache.erase( Iterator );
+			}
+
+			Cache.insert( Cache.begin(), Vertex );
+			Updated.emplace_back( Vertex );
+		}
+
+		for( size_t Position = 0; Position < Cache.size(); Position++ )
+		{
+			CachePosition[Cache[Position]] = Position < ScoringCacheSize ? static_cast<int32_t>( Position ) : -1;
+		}
+
+		if( Cache.size() > ScoringCacheSize )
+		{
+			Cache.resize( ScoringCacheSize );
+		}
+
+		// Only vertices that were or are in the cache changed score, and only their triangles can become the best one.
+		for( const uint32_t Vertex : Updated )
+		{
+			Score[Vertex] = VertexScore( CachePosition[Vertex], Remaining[Vertex] );
+		}
+
+		Best = -1;
+		float BestScore = -1.0f;
+		for( const uint32_t Vertex : Updated )
+		{
+			for( uint32_t Offset = AdjacencyOffset[Vertex]; Offset < AdjacencyOffset[Vertex] + Remaining[Vertex]; Offset++ )
+			{
+				const uint32_t Adjacent = Adjacency[Offset];
+				const float NewScore = Score[Indices[Adjacent * 3]] + Score[Indices[Adjacent * 3 + 1]] + Score[Indices[Adjacent * 3 + 2]];
+				if( NewScore > BestScore )
+				{
+					BestScore = NewScore;
+					Best = Adjacent;
+				}
+			}
+		}
+	}
+
+	memcpy( Indices, Output.data(), Output.size() * sizeof( glm::uint ) );
+}
+
+struct FTriangleCluster
+{
+	uint32_t FirstTriangle;
+	uint32_t TriangleCount;
+	float Sort;
+};
+
+// Splits the cache optimized order into clusters wherever the cache has warmed up enough that a restart costs little,
+// then draws the clusters that face away from the center first so they occlude the ones behind them (Sander et al., Tipsify).
+static void OptimizeOverdraw( glm::uint* Indices, const uint32_t IndexCount, const FVertex* Vertices )
+{
+	const uint32_t TriangleCount = IndexCount / 3;
+	if( TriangleCount < 2 )
+		return;
+
+	const float Target = MeshBuilder::ACMR( Indices, IndexCount, SimulatedCacheSize ) * OverdrawThreshold;
+
+	std::vector<FTriangleCluster> Clusters;
+	{
+		std::vector<glm::uint> Cache;
+		Cache.reserve( SimulatedCacheSize );
+
+		FTriangleCluster Cluster = { 0, 0, 0.0f };
+		uint32_t Misses = 0;
+		for( uint32_t Triangle = 0; Triangle < TriangleCount; Triangle++ )
+		{
+			for( uint32_t Corner = 0; Corner < 3; Corner++ )
+			{
+				const glm::uint Vertex = Indices[Triangle * 3 + Corner];
+				if( std::find( Cache.begin(), Cache.end(), Vertex ) != Cache.end() )
+					continue;
+
+				Misses++;
+				if( Cache.size() == SimulatedCacheSize )
+				{
+					Cache.erase( Cache.begin() );
+				}
+
+				Cache.emplace_back( Vertex );
+			}
+
+			Cluster.TriangleCount++;
+			if( static_cast<float>( Misses ) <= Target * static_cast<float>( Cluster.TriangleCount ) || Triangle == TriangleCount - 1 )
+			{
+				Clusters.emplace_back( Cluster );
+				Cluster.FirstTriangle = Triangle + 1;
+				Cluster.TriangleCount = 0;
+				Misses = 0;
+				Cache.clear();
+			}
+		}
+	}
+
+	if( Clusters.size() < 2 )
+		return;
+
+	Vector3D Center( 0.0f, 0.0f, 0.0f );
+	float TotalArea = 0.0f;
+	std::vector<Vector3D> ClusterCenters( Clusters.size(), Vector3D( 0.0f, 0.0f, 0.0f ) );
+	std::vector<Vector3D> ClusterNormals( Clusters.size(), Vector3D( 0.0f, 0.0f, 0.0f ) );
+	for( size_t Index = 0; Index < Clusters.size(); Index++ )
+	{
+		float ClusterArea = 0.0f;
+		const FTriangleCluster& Cluster = Clusters[Index];
+		for( uint32_t Triangle = Cluster.FirstTriangle; Triangle < Cluster.FirstTriangle + Cluster.TriangleCount; Triangle++ )
+		{
+			const Vector3D& A = Vertices[Indices[Triangle * 3]].Position;
+			const Vector3D& B = Vertices[Indices[Triangle * 3 + 1]].Position;
+			const Vector3D& C = Vertices[Indices[Triangle * 3 + 2]].Position;
+
+			// The length of the cross product is twice the area, which weighs both sums the same way.
+			const Vector3D Normal = ( B - A ).Cross( C - A );
+			const float Area = Normal.Length();
+
+			ClusterCenters[Index] += ( A + B + C ) * ( Area / 3.0f );
+			ClusterNormals[Index] += Normal;
+			ClusterArea += Area;
+		}
+
+		Center += ClusterCenters[Index];
+		TotalArea += ClusterArea;
+
+		if( ClusterArea > 0.0f )
+		{
+			ClusterCenters[Index] = ClusterCenters[Index] / ClusterArea;
+		}
+	}
+
+	if( TotalArea > 0.0f )
+	{
+		Center = Center / TotalArea;
+	}
+
+	for( size_t Index = 0; Index < Clusters.size(); Index++ )
+	{
+		Clusters[Index].Sort = ( ClusterCenters[Index] - Center ).Dot( ClusterNormals[Index].Normalized() );
+	}
+
+	std::stable_sort( Clusters.begin(), Clusters.end(), [] ( const FTriangleCluster& A, const FTriangleCluster& B ) {
+		return A.Sort > B.Sort;
+	} );
+
+	std::vector<glm::uint> Output;
+	Output.reserve( TriangleCount * 3 );
+	for( const auto& Cluster : Clusters )
+	{
+		Output.insert( Output.end(), Indices + Cluster.FirstTriangle * 3, Indices + ( Cluster.FirstTriangle + Cluster.TriangleCount ) * 3 );
+	}
+
+	memcpy( Indices, Output.data(), Output.size() * sizeof( glm::uint ) );
+}
+
+void MeshBuilder::Optimize( FPrimitive& Primitive )
+{
+	ProfileBareScope();
+
+	if( !Primitive.Vertices || !Primitive.Indices || Primitive.IndexCount < 3 )
+		return;
+
+	const FLevelOfDetail Base = Primitive.GetLevelOfDetail( 0 );
+	const float Before = ACMR( Primitive.Indices + Base.FirstIndex, Base.IndexCount, SimulatedCacheSize );
+
+	// Levels of detail are drawn on their own, each range is optimized separately.
+	for( uint32_t Level = 0; Level < Primitive.GetLevelOfDetailCount(); Level++ )
+	{
+		const FLevelOfDetail Range = Primitive.GetLevelOfDetail( Level );
+		glm::uint* Indices = Primitive.Indices + Range.FirstIndex;
+
+		OptimizeVertexCache( Indices, Range.IndexCount, Primitive.VertexCount );
+		OptimizeOverdraw( Indices, Range.IndexCount, Primitive.Vertices );
+	}
+
+	// Vertices the index buffer doesn't use stay at the end.
+	const uint32_t Unused = UINT32_MAX;
+	std::vector<uint32_t> Remap( Primitive.VertexCount, Unused );
+	uint32_t NextVertex = 0;
+	for( uint32_t Index = 0; Index < Primitive.IndexCount; Index++ )
+	{
+		uint32_t& Vertex = Remap[Primitive.Indices[Index]];
+		if( Vertex == Unused )
+		{
+			Vertex = NextVertex++;
+		}
+
+		Primitive.Indices[Index] = Vertex;
+	}
+
+	FVertex* Vertices = new FVertex[Primitive.VertexCount];
+	for( uint32_t Vertex = 0; Vertex < Primitive.VertexCount; Vertex++ )
+	{
+		if( Remap[Vertex] == Unused )
+		{
+			Remap[Vertex] = NextVertex++;
+		}
+
+		Vertices[Remap[Vertex]] = Primitive.Vertices[Vertex];
+	}
+
+	delete[] Primitive.Vertices;
+	Primitive.Vertices = Vertices;
+
+	const float After = ACMR( Primitive.Indices + Base.FirstIndex, Base.IndexCount, SimulatedCacheSize );
+	Log::Event( "Optimized %u triangles, ACMR went from %.3f to %.3f.\n", Base.IndexCount / 3, Before, After );
 }
@@ -33,6 +33,17 @@ public:
 
 	static void Mesh( FPrimitive& Primitive, CMesh* MeshInstance );
 
+	// Appends simplified index ranges to the primitive using quadric error metric edge collapses.
+	// Every level aims for the given fraction of the triangles of the level before it.
+	static void LevelsOfDetail( FPrimitive& Primitive, const uint32_t Levels = MaximumLevelsOfDetail, const float Reduction = 0.5f );
+
+	// Reorders the triangles of every level of detail for the post-transform vertex cache and then for overdraw.
+	// Vertices are moved into the order in which the index buffer first uses them afterwards.
+	static void Optimize( FPrimitive& Primitive );
+
+	// Average cache miss ratio, the number of vertices that are transformed per triangle by a FIFO cache of the given size.
+	static float ACMR( const glm::uint* Indices, const uint32_t IndexCount, const uint32_t CacheSize );
+
 private:
 	static void Soup( FPrimitive& Primitive, std::vector<Vector3D> Vertices );
 };
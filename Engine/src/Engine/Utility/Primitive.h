@@ -5,7 +5,34 @@
 #include <Engine/Utility/Math.h>
 
 static const char PrimitiveIdentifier[5] = "LPRI"; // Lofty PRImitive
-static const size_t PrimitiveVersion = 1;
+static const size_t PrimitiveVersion = 3;
+
+// Oldest version that can still be read, version 1 files don't contain levels of detail and version 2 files don't store a vertex format.
+static const size_t PrimitiveVersionMinimum = 1;
+
+static const uint32_t MaximumLevelsOfDetail = 4;
+
+// Layout of the vertices once they're uploaded, primitives always keep full precision vertices on the CPU.
+namespace EVertexFormat
+{
+	enum Type : uint32_t
+	{
+		Full = 0,
+
+		// Positions quantized to the bounds, octahedral normals and half float texture coordinates.
+		Compact,
+
+		// Keeps the format the primitive was imported or saved with.
+		Default
+	};
+}
+
+// Range of the index buffer that makes up a level of detail, all levels share the same vertices.
+struct FLevelOfDetail
+{
+	uint32_t FirstIndex = 0;
+	uint32_t IndexCount = 0;
+};
 
 struct FVertex
 {
@@ -43,8 +70,10 @@ struct FPrimitive
 		VertexCount = 0;
 		Indices = nullptr;
 		IndexCount = 0;
+		LevelOfDetailCount = 0;
 
 		HasNormals = false;
+		VertexFormat = EVertexFormat::Full;
 	}
 
 	FPrimitive( const FPrimitive& Primitive )
@@ -58,7 +87,11 @@ struct FPrimitive
 		memcpy( Vertices, Vertices, Primitive.VertexCount * sizeof( FVertex ) );
 		memcpy( Indices, Indices, Primitive.IndexCount * sizeof( uint32_t ) );
 
+		LevelOfDetailCount = Primitive.LevelOfDetailCount;
+		memcpy( LevelsOfDetail, Primitive.LevelsOfDetail, sizeof( LevelsOfDetail ) );
+
 		HasNormals = Primitive.HasNormals;
+		VertexFormat = Primitive.VertexFormat;
 	}
 
 	~FPrimitive()
@@ -79,7 +112,29 @@ struct FPrimitive
 	uint32_t* Indices;
 	uint32_t IndexCount;
 
+	// Primitives without levels of detail use the entire index buffer as their only level.
+	FLevelOfDetail LevelsOfDetail[MaximumLevelsOfDetail];
+	uint32_t LevelOfDetailCount;
+
 	bool HasNormals;
+	EVertexFormat::Type VertexFormat;
+
+	uint32_t GetLevelOfDetailCount() const
+	{
+		return LevelOfDetailCount > 0 ? LevelOfDetailCount : 1;
+	}
+
+	FLevelOfDetail GetLevelOfDetail( const uint32_t Level ) const
+	{
+		if( LevelOfDetailCount == 0 )
+		{
+			FLevelOfDetail Base;
+			Base.IndexCount = IndexCount;
+			return Base;
+		}
+
+		return LevelsOfDetail[Level < LevelOfDetailCount ? Level : LevelOfDetailCount - 1];
+	}
 
 	friend CData& operator<<( CData& Data, FPrimitive& Primitive )
 	{
@@ -91,6 +146,16 @@ struct FPrimitive
 
 		Data << Primitive.HasNormals;
 
+		uint32_t VertexFormat = Primitive.VertexFormat;
+		Data << VertexFormat;
+
+		Data << Primitive.LevelOfDetailCount;
+		for( uint32_t Level = 0; Level < Primitive.LevelOfDetailCount; Level++ )
+		{
+			Data << Primitive.LevelsOfDetail[Level].FirstIndex;
+			Data << Primitive.LevelsOfDetail[Level].IndexCount;
+		}
+
 		for( size_t Index = 0; Index < Primitive.VertexCount; Index++ )
 		{
 			Data << Primitive.Vertices[Index];
@@ -112,13 +177,48 @@ struct FPrimitive
 		size_t Version;
 		Data >> Version;
 
-		if( strcmp( Identifier, PrimitiveIdentifier ) == 0 && Version >= PrimitiveVersion )
+		if( strcmp( Identifier, PrimitiveIdentifier ) == 0 && Version >= PrimitiveVersionMinimum )
 		{
 			Data >> Primitive.VertexCount;
 			Data >> Primitive.IndexCount;
 
 			Data >> Primitive.HasNormals;
 
+			Primitive.VertexFormat = EVertexFormat::Full;
+			if( Version >= 3 )
+			{
+				uint32_t VertexFormat;
+				Data >> VertexFormat;
+				Primitive.VertexFormat = VertexFormat == EVertexFormat::Compact ? EVertexFormat::Compact : EVertexFormat::Full;
+			}
+
+			Primitive.LevelOfDetailCount = 0;
+			if( Version >= 2 )
+			{
+				Data >> Primitive.LevelOfDetailCount;
+				if( Primitive.LevelOfDetailCount > MaximumLevelsOfDetail )
+				{
+					Data.Invalidate();
+					return Data;
+				}
+
+				bool ValidLevels = true;
+				for( uint32_t Level = 0; Level < Primitive.LevelOfDetailCount; Level++ )
+				{
+					FLevelOfDetail& LevelOfDetail = Primitive.LevelsOfDetail[Level];
+					Data >> LevelOfDetail.FirstIndex;
+					Data >> LevelOfDetail.IndexCount;
+
+					ValidLevels &= LevelOfDetail.FirstIndex <= Primitive.IndexCount && LevelOfDetail.IndexCount <= Primitive.IndexCount - LevelOfDetail.FirstIndex;
+				}
+
+				// Ranges past the end of the index buffer would make draws read out of bounds, the full buffer is drawn instead.
+				if( !ValidLevels )
+				{
+					Primitive.LevelOfDetailCount = 0;
+				}
+			}
+
 			Primitive.Vertices = new FVertex[Primitive.VertexCount];
 			for( size_t Index = 0; Index < Primitive.VertexCount; Index++ )
 			{
@@ -0,0 +1,285 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#include "TextureBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static uint16_t PackColor( const float Color[3] )
+{
+	const uint32_t Red = static_cast<uint32_t>( std::min( std::max( Color[0] * 31.0f / 255.0f + 0.5f, 0.0f ), 31.0f ) );
+	const uint32_t Green = static_cast<uint32_t>( std::min( std::max( Color[1] * 63.0f / 255.0f + 0.5f, 0.0f ), 63.0f ) );
+	const uint32_t Blue = static_cast<uint32_t>( std::min( std::max( Color[2] * 31.0f / 255.0f + 0.5f, 0.0f ), 31.0f ) );
+	return static_cast<uint16_t>( ( Red << 11 ) | ( Green << 5 ) | Blue );
+}
+
+static void UnpackColor( const uint16_t Packed, int Color[3] )
+{
+	const int Red = ( Packed >> 11 ) & 31;
+	const int Green = ( Packed >> 5 ) & 63;
+	const int Blue = Packed & 31;
+	Color[0] = ( Red << 3 ) | ( Red >> 2 );
+	Color[1] = ( Green << 2 ) | ( Green >> 4 );
+	Color[2] = ( Blue << 3 ) | ( Blue >> 2 );
+}
+
+uint64_t TextureBuilder::EncodeColor( const uint8_t Block[16][4] )
+{
+	float Mean[3] = { 0.0f, 0.0f, 0.0f };
+	for( uint32_t Index = 0; Index < 16; Index++ )
+	{
+		for( uint32_t Channel = 0; Channel < 3; Channel++ )
+		{
+			Mean[Channel] += Block[Index][Channel] / 16.0f;
+		}
+	}
+
+	// The endpoints are fitted along the principal axis of the colors in the block.
+	float Covariance[3][3] = {};
+	for( uint32_t Index = 0; Index < 16; Index++ )
+	{
+		const float Offset[3] = { Block[Index][0] - Mean[0], Block[Index][1] - Mean[1], Block[Index][2] - Mean[2] };
+		for( uint32_t Row = 0; Row < 3; Row++ )
+		{
+			for( uint32_t Column = 0; Column < 3; Column++ )
+			{
+				Covariance[Row][Column] += Offset[Row] * Offset[Column];
+			}
+		}
+	}
+
+	float Axis[3] = { 1.0f, 1.0f, 1.0f };
+	for( uint32_t Iteration = 0; Iteration < 8; Iteration++ )
+	{
+		float Next[3];
+		for( uint32_t Row = 0; Row < 3; Row++ )
+		{
+			Next[Row] = Covariance[Row][0] * Axis[0] + Covariance[Row][1] * Axis[1] + Covariance[Row][2] * Axis[2];
+		}
+
+		const float Length = std::sqrt( Next[0] * Next[0] + Next[1] * Next[1] + Next[2] * Next[2] );
+		if( Length < 1e-6f )
+			break;
+
+		for( uint32_t Row = 0; Row < 3; Row++ )
+		{
+			Axis[Row] = Next[Row] / Length;
+		}
+	}
+
+	float Minimum = 0.0f;
+	float Maximum = 0.0f;
+	for( uint32_t Index = 0; Index < 16; Index++ )
+	{
+		const float Projection = ( Block[Index][0] - Mean[0] ) * Axis[0] + ( Block[Index][1] - Mean[1] ) * Axis[1] + ( Block[Index][2] - Mean[2] ) * Axis[2];
+		Minimum = std::min( Minimum, Projection );
+		Maximum = std::max( Maximum, Projection );
+	}
+
+	float Start[3];
+	float End[3];
+	for( uint32_t Channel = 0; Channel < 3; Channel++ )
+	{
+		Start[Channel] = Mean[Channel] + Axis[Channel] * Maximum;
+		End[Channel] = Mean[Channel] + Axis[Channel] * Minimum;
+	}
+
+	uint16_t Color0 = PackColor( Start );
+	uint16_t Color1 = PackColor( End );
+
+	// The first endpoint has to be the larger one, otherwise the block is decoded with three colors and transparency.
+	if( Color0 < Color1 )
+	{
+		std::swap( Color0, Color1 );
+	}
+
+	uint32_t Indices = 0;
+	if( Color0 != Color1 )
+	{
+		int Palette[4][3];
+		UnpackColor( Color0, Palette[0] );
+		UnpackColor( Color1, Palette[1] );
+		for( uint32_t Channel = 0; Channel < 3; Channel++ )
+		{
+			Palette[2][Channel] = ( 2 * Palette[0][Channel] + Palette[1][Channel] ) / 3;
+			Palette[3][Channel] = ( Palette[0][Channel] + 2 * Palette[1][Channel] ) / 3;
+		}
+
+		for( uint32_t Index = 0; Index < 16; Index++ )
+		{
+			uint32_t Best = 0;
+			int BestDistance = INT32_MAX;
+			for( uint32_t Entry = 0; Entry < 4; Entry++ )
+			{
+				int Distance = 0;
+				for( uint32_t Channel = 0; Channel < 3; Channel++ )
+				{
+					const int Difference = Block[Index][Channel] - Palette[Entry][Channel];
+					Distance += Difference * Difference;
+				}
+
+				if( Distance < BestDistance )
+				{
+					Best = Entry;
+					BestDistance = Distance;
+				}
+			}
+
+			Indices |= Best << ( Index * 2 );
+		}
+	}
+
+	return static_cast<uint64_t>( Color0 ) | static_cast<uint64_t>( Color1 ) << 16 | static_cast<uint64_t>( Indices ) << 32;
+}
+
+uint64_t TextureBuilder::EncodeChannel( const uint8_t Block[16][4], const uint32_t Channel )
+{
+	int Maximum = 0;
+	int Minimum = 255;
+	for( uint32_t Index = 0; Index < 16; Index++ )
+	{
+		Maximum = std::max( Maximum, static_cast<int>( Block[Index][Channel] ) );
+		Minimum = std::min( Minimum, static_cast<int>( Block[Index][Channel] ) );
+	}
+
+	// Putting the larger value first selects the mode with eight interpolated values.
+	uint64_t Encoded = static_cast<uint64_t>( Maximum ) | static_cast<uint64_t>( Minimum ) << 8;
+	if( Maximum == Minimum )
+		return Encoded;
+
+	int Palette[8];
+	Palette[0] = Maximum;
+	Palette[1] = Minimum;
+	for( int Entry = 1; Entry < 7; Entry++ )
+	{
+		Palette[Entry + 1] = ( ( 7 - Entry ) * Maximum + Entry * Minimum ) / 7;
+	}
+
+	for( uint32_t Index = 0; Index < 16; Index++ )
+	{
+		uint64_t Best = 0;
+		int BestDistance = INT32_MAX;
+		for( uint32_t Entry = 0; Entry < 8; Entry++ )
+		{
+			const int Distance = std::abs( Block[Index][Channel] - Palette[Entry] );
+			if( Distance < BestDistance )
+			{
+				Best = Entry;
+				BestDistance = Distance;
+			}
+		}
+
+		Encoded |= Best << ( 16 + Index * 3 );
+	}
+
+	return Encoded;
+}
+
+bool TextureBuilder::Compress( FCompressedImage& Image, const uint8_t* Pixels, const int Width, const int Height, const int Channels, const EBlockCompression::Type Compression )
+{
+	if( !Pixels || Width < 1 || Height < 1 || Channels < 1 || Channels > 4 || Compression == EBlockCompression::None || Compression >= EBlockCompression::Maximum )
+		return false;
+
+	uint32_t LevelWidth = static_cast<uint32_t>( Width );
+	uint32_t LevelHeight = static_cast<uint32_t>( Height );
+
+	std::vector<uint8_t> Level( LevelWidth * LevelHeight * 4 );
+	for( size_t Texel = 0; Texel < static_cast<size_t>( LevelWidth ) * LevelHeight; Texel++ )
+	{
+		const uint8_t* Source = Pixels + Texel * Channels;
+		uint8_t* Target = &Level[Texel * 4];
+		Target[0] = Source[0];
+		Target[1] = Channels > 1 ? Source[1] : 0;
+		Target[2] = Channels > 2 ? Source[2] : 0;
+		Target[3] = Channels > 3 ? Source[3] : 255;
+	}
+
+	Image.Compression = Compression;
+	Image.MipCount = 0;
+	Image.Blocks.clear();
+
+	std::vector<uint8_t> NextLevel;
+	while( Image.MipCount < MaximumMipLevels )
+	{
+		FCompressedMip& Mip = Image.Mips[Image.MipCount++];
+		Mip.Width = LevelWidth;
+		Mip.Height = LevelHeight;
+		Mip.Offset = static_cast<uint32_t>( Image.Blocks.size() );
+
+		for( uint32_t BlockY = 0; BlockY < LevelHeight; BlockY += 4 )
+		{
+			for( uint32_t BlockX = 0; BlockX < LevelWidth; BlockX += 4 )
+			{
+				// Levels smaller than a block repeat their edge texels.
+				uint8_t Block[16][4];
+				for( uint32_t Y = 0; Y < 4; Y++ )
+				{
+					for( uint32_t X = 0; X < 4; X++ )
+					{
+						const uint32_t SourceX = std::min( BlockX + X, LevelWidth - 1 );
+						const uint32_t SourceY = std::min( BlockY + Y, LevelHeight - 1 );
+						memcpy( Block[Y * 4 + X], &Level[( SourceY * LevelWidth + SourceX ) * 4], 4 );
+					}
+				}
+
+				if( Compression == EBlockCompression::BC1 )
+				{
+					Image.Blocks.emplace_back( EncodeColor( Block ) );
+				}
+				else if( Compression == EBlockCompression::BC3 )
+				{
+					Image.Blocks.emplace_back( EncodeChannel( Block, 3 ) );
+					Image.Blocks.emplace_back( EncodeColor( Block ) );
+				}
+				else if( Compression == EBlockCompression::BC5 )
+				{
+					Image.Blocks.emplace_back( EncodeChannel( Block, 0 ) );
+					Image.Blocks.emplace_back( EncodeChannel( Block, 1 ) );
+				}
+			}
+		}
+
+		Mip.Size = static_cast<uint32_t>( Image.Blocks.size() ) - Mip.Offset;
+
+		if( LevelWidth == 1 && LevelHeight == 1 )
+			break;
+
+		const uint32_t NextWidth = std::max( LevelWidth / 2, 1u );
+		const uint32_t NextHeight = std::max( LevelHeight / 2, 1u );
+		NextLevel.resize( NextWidth * NextHeight * 4 );
+
+		for( uint32_t Y = 0; Y < NextHeight; Y++ )
+		{
+			for( uint32_t X = 0; X < NextWidth; X++ )
+			{
+				const uint32_t X0 = std::min( X * 2, LevelWidth - 1 );
+				const uint32_t X1 = std::min( X * 2 + 1, LevelWidth - 1 );
+				const uint32_t Y0 = std::min( Y * 2, LevelHeight - 1 );
+				const uint32_t Y1 = std::min( Y * 2 + 1, LevelHeight - 1 );
+
+				for( uint32_t Channel = 0; Channel < 4; Channel++ )
+				{
+					const uint32_t Sum = Level[( Y0 * LevelWidth + X0 ) * 4 + Channel] + Level[( Y0 * LevelWidth + X1 ) * 4 + Channel] +
+						Level[( Y1 * LevelWidth + X0 ) * 4 + Channel] + Level[( Y1 * LevelWidth + X1 ) * 4 + Channel];
+					NextLevel[( Y * NextWidth + X ) * 4 + Channel] = static_cast<uint8_t>( ( Sum + 2 ) / 4 );
+				}
+			}
+		}
+
+		Level.swap( NextLevel );
+		LevelWidth = NextWidth;
+		LevelHeight = NextHeight;
+	}
+
+	return true;
+}
+
+void TextureBuilder::LT( FCompressedImage& Image, const CFile& File )
+{
+	if( !File.Extract( Image ) )
+	{
+		Image.MipCount = 0;
+		Image.Blocks.clear();
+	}
+}
@@ -0,0 +1,22 @@
+// Copyright  2017, Christiaan Bakker, All rights reserved.
+#pragma once
+
+#include <stdint.h>
+
+#include <Engine/Utility/CompressedImage.h>
+#include <Engine/Utility/File.h>
+
+class TextureBuilder
+{
+public:
+	// Box filters 8-bit pixels down to a single texel and block compresses every level.
+	// Missing channels are treated the way glTexImage2D expands them, zero for color and opaque for alpha.
+	static bool Compress( FCompressedImage& Image, const uint8_t* Pixels, const int Width, const int Height, const int Channels, const EBlockCompression::Type Compression );
+
+	static void LT( FCompressedImage& Image, const CFile& File );
+
+private:
+	// Blocks are 4x4 RGBA texels in row order.
+	static uint64_t EncodeColor( const uint8_t Block[16][4] );
+	static uint64_t EncodeChannel( const uint8_t Block[16][4], const uint32_t Channel );
+};
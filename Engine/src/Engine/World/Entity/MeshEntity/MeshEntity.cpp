@@ -23,6 +23,7 @@ CMeshEntity::CMeshEntity()
 	Static = true;
 	Contact = false;
 	Collision = true;
+	Occluder = false;
 
 	Color = glm::vec4( 0.65f, 0.35f, 0.45f, 1.0f );
 }
@@ -77,6 +78,8 @@ void CMeshEntity::Construct()
 			}
 		}
 
+		Renderable->SetOccluder( Occluder );
+
 		FRenderDataInstanced& RenderData = Renderable->GetRenderData();
 		RenderData.Transform = Transform;
 		RenderData.Color = Color;
@@ -236,6 +239,17 @@ void CMeshEntity::Load( const JSON::Vector& Objects )
 				Static = true;
 			}
 		}
+		else if( Property->Key == "occluder" )
+		{
+			if( Property->Value == "0" )
+			{
+				Occluder = false;
+			}
+			else
+			{
+				Occluder = true;
+			}
+		}
 	}
 
 	if( TextureNames.size() == 0 )
@@ -52,5 +52,8 @@ protected:
 
 	bool Collision;
 	bool Static;
+
+	// Large meshes that hide others, used for occlusion culling.
+	bool Occluder;
 	CPhysicsComponent* PhysicsComponent;
 };
@@ -133,6 +133,9 @@ void CLevel::Load( const CFile& File, const bool AssetsOnly )
 							// Texture format storage
 							std::string ImageFormat = "";
 
+							// Mesh vertex format override, either "full" or "compact".
+							std::string VertexFormat = "";
+
 							for( auto Property : Asset->Objects )
 							{
 								if( Property->Key == "type" )
@@ -190,6 +193,10 @@ void CLevel::Load( const CFile& File, const bool AssetsOnly )
 								{
 									ImageFormat = Property->Value;
 								}
+								else if( Property->Key == "vertexformat" )
+								{
+									VertexFormat = Property->Value;
+								}
 							}
 
 							if( Name.length() > 0 && ( Paths.size() > 0 || ( VertexPath.size() > 0 && FragmentPath.size() > 0 ) ) )
@@ -201,6 +208,16 @@ void CLevel::Load( const CFile& File, const bool AssetsOnly )
 										FPrimitivePayload Payload;
 										Payload.Name = Name;
 										Payload.Location = Path;
+
+										if( VertexFormat == "compact" )
+										{
+											Payload.VertexFormat = EVertexFormat::Compact;
+										}
+										else if( VertexFormat == "full" )
+										{
+											Payload.VertexFormat = EVertexFormat::Full;
+										}
+
 										MeshList.emplace_back( Payload );
 									}
 								}